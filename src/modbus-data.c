@@ -28,6 +28,17 @@
 #include "modbus.h"
 #include <byteswap.h>
 
+#if HAVE_X86_CPU_DISPATCH
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__ARM_NEON) && defined(__BYTE_ORDER__) && \
+    __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#include <arm_neon.h>
+#define _MODBUS_BSWAP16_NEON
+#endif
+
 
 #if defined(__GNUC__)
 #  define GCC_VERSION (__GNUC__ * 100 + __GNUC_MINOR__ * 10)
@@ -64,6 +75,210 @@ static inline uint32_t bswap_32(uint32_t x)
 }
 #endif
 
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+/* 8 bits of a byte expanded to 8 bytes (0 or 1), the least significant bit in
+   the first byte */
+#define _BIT(b, n)  ((uint64_t)(((b) >> (n)) & 1) << ((n) * 8))
+#define _UNPACK(b)  (_BIT(b, 0) | _BIT(b, 1) | _BIT(b, 2) | _BIT(b, 3) | \
+                     _BIT(b, 4) | _BIT(b, 5) | _BIT(b, 6) | _BIT(b, 7))
+#define _UNPACK4(b) _UNPACK(b), _UNPACK((b) + 1), _UNPACK((b) + 2), _UNPACK((b) + 3)
+#define _UNPACK16(b) _UNPACK4(b), _UNPACK4((b) + 4), _UNPACK4((b) + 8), _UNPACK4((b) + 12)
+#define _UNPACK64(b) _UNPACK16(b), _UNPACK16((b) + 16), _UNPACK16((b) + 32), _UNPACK16((b) + 48)
+
+static const uint64_t table_unpack_bits[256] = {
+    _UNPACK64(0), _UNPACK64(64), _UNPACK64(128), _UNPACK64(192)
+};
+#define _MODBUS_BITS_WORDS
+#endif
+
+/* Expands the nb bits of src, the least significant bit of the first byte
+   first, to one byte by bit (0 or 1) in dest */
+static void unpack_bits_scalar(uint8_t *dest, const uint8_t *src, int nb)
+{
+    int i = 0;
+
+#ifdef _MODBUS_BITS_WORDS
+    for (; i + 8 <= nb; i += 8) {
+        memcpy(dest + i, &table_unpack_bits[src[i >> 3]], 8);
+    }
+#endif
+    for (; i < nb; i++) {
+        dest[i] = (src[i >> 3] >> (i & 7)) & 1;
+    }
+}
+
+/* Packs nb bytes of src (a byte which isn't null gives a bit set) in the bits
+   of dest, the first byte in the least significant bit. The unused bits of
+   the last byte are cleared. */
+static void pack_bits_scalar(uint8_t *dest, const uint8_t *src, int nb)
+{
+    int i = 0;
+    int shift;
+    int one_byte;
+
+#ifdef _MODBUS_BITS_WORDS
+    for (; i + 8 <= nb; i += 8) {
+        uint64_t v;
+
+        memcpy(&v, src + i, 8);
+        /* Bit 0 of each byte set if the byte isn't null */
+        v |= v >> 4;
+        v |= v >> 2;
+        v |= v >> 1;
+        v &= 0x0101010101010101ULL;
+        /* Moves the bit 0 of the byte k to the bit 56 + k */
+        dest[i >> 3] = (v * 0x0102040810204080ULL) >> 56;
+    }
+#endif
+    if (i < nb) {
+        for (one_byte = 0, shift = 0; i < nb; i++, shift++) {
+            if (src[i])
+                one_byte |= 1 << shift;
+            if (shift == 7) {
+                dest[i >> 3] = one_byte;
+                one_byte = 0;
+                shift = -1;
+            }
+        }
+        if (shift != 0)
+            dest[(nb - 1) >> 3] = one_byte;
+    }
+}
+
+#if defined(__SSE2__) || HAVE_X86_CPU_DISPATCH
+#if !defined(__SSE2__)
+__attribute__((target("sse2")))
+#endif
+static void unpack_bits_sse2(uint8_t *dest, const uint8_t *src, int nb)
+{
+    const __m128i bits = _mm_set1_epi64x((long long)0x8040201008040201ULL);
+    const __m128i one = _mm_set1_epi8(1);
+    int i;
+
+    for (i = 0; i + 16 <= nb; i += 16) {
+        /* Each of the 2 bytes repeated 8 times */
+        __m128i v = _mm_cvtsi32_si128(src[i >> 3] | (src[(i >> 3) + 1] << 8));
+
+        v = _mm_unpacklo_epi8(v, v);
+        v = _mm_unpacklo_epi16(v, v);
+        v = _mm_unpacklo_epi32(v, v);
+        v = _mm_cmpeq_epi8(_mm_and_si128(v, bits), bits);
+        _mm_storeu_si128((__m128i *)(dest + i), _mm_and_si128(v, one));
+    }
+    unpack_bits_scalar(dest + i, src + (i >> 3), nb - i);
+}
+
+#if !defined(__SSE2__)
+__attribute__((target("sse2")))
+#endif
+static void pack_bits_sse2(uint8_t *dest, const uint8_t *src, int nb)
+{
+    const __m128i zero = _mm_setzero_si128();
+    int i;
+
+    for (i = 0; i + 16 <= nb; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+        int mask = ~_mm_movemask_epi8(_mm_cmpeq_epi8(v, zero));
+
+        dest[i >> 3] = mask & 0xFF;
+        dest[(i >> 3) + 1] = (mask >> 8) & 0xFF;
+    }
+    pack_bits_scalar(dest + (i >> 3), src + i, nb - i);
+}
+#endif
+
+#if HAVE_X86_CPU_DISPATCH
+/* The tails are processed in the AVX2 kernels to avoid the AVX/SSE state
+   transitions (see bswap16_avx2) */
+__attribute__((target("avx2")))
+static void unpack_bits_avx2(uint8_t *dest, const uint8_t *src, int nb)
+{
+    /* Byte k of the 32 bits repeated in the bytes 8k to 8k + 7 */
+    const __m256i shuffle = _mm256_setr_epi8(
+        0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1,
+        2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3);
+    const __m256i bits = _mm256_set1_epi64x((long long)0x8040201008040201ULL);
+    const __m256i one = _mm256_set1_epi8(1);
+    int i;
+
+    for (i = 0; i + 32 <= nb; i += 32) {
+        uint32_t word;
+        __m256i v;
+
+        memcpy(&word, src + (i >> 3), sizeof(word));
+        v = _mm256_shuffle_epi8(_mm256_set1_epi32(word), shuffle);
+        v = _mm256_cmpeq_epi8(_mm256_and_si256(v, bits), bits);
+        _mm256_storeu_si256((__m256i *)(dest + i), _mm256_and_si256(v, one));
+    }
+    for (; i < nb; i++) {
+        dest[i] = (src[i >> 3] >> (i & 7)) & 1;
+    }
+}
+
+__attribute__((target("avx2")))
+static void pack_bits_avx2(uint8_t *dest, const uint8_t *src, int nb)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    int i;
+
+    for (i = 0; i + 32 <= nb; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(src + i));
+        uint32_t mask = ~(uint32_t)_mm256_movemask_epi8(
+            _mm256_cmpeq_epi8(v, zero));
+
+        memcpy(dest + (i >> 3), &mask, sizeof(mask));
+    }
+    if (i < nb) {
+        int shift;
+        int one_byte;
+
+        for (one_byte = 0, shift = 0; i < nb; i++, shift++) {
+            if (src[i])
+                one_byte |= 1 << shift;
+            if (shift == 7) {
+                dest[i >> 3] = one_byte;
+                one_byte = 0;
+                shift = -1;
+            }
+        }
+        if (shift != 0)
+            dest[(nb - 1) >> 3] = one_byte;
+    }
+}
+#endif
+
+static void unpack_bits(uint8_t *dest, const uint8_t *src, int nb)
+{
+#if HAVE_X86_CPU_DISPATCH
+    if (nb >= 32 && __builtin_cpu_supports("avx2"))
+        unpack_bits_avx2(dest, src, nb);
+    else if (nb >= 16 && __builtin_cpu_supports("sse2"))
+        unpack_bits_sse2(dest, src, nb);
+    else
+        unpack_bits_scalar(dest, src, nb);
+#elif defined(__SSE2__)
+    unpack_bits_sse2(dest, src, nb);
+#else
+    unpack_bits_scalar(dest, src, nb);
+#endif
+}
+
+static void pack_bits(uint8_t *dest, const uint8_t *src, int nb)
+{
+#if HAVE_X86_CPU_DISPATCH
+    if (nb >= 32 && __builtin_cpu_supports("avx2"))
+        pack_bits_avx2(dest, src, nb);
+    else if (nb >= 16 && __builtin_cpu_supports("sse2"))
+        pack_bits_sse2(dest, src, nb);
+    else
+        pack_bits_scalar(dest, src, nb);
+#elif defined(__SSE2__)
+    pack_bits_sse2(dest, src, nb);
+#else
+    pack_bits_scalar(dest, src, nb);
+#endif
+}
+
 /* Sets many bits from a single byte value (all 8 bits of the byte value are
    set) */
 void modbus_set_bits_from_byte(uint8_t *dest, int index, const uint8_t value)
@@ -80,15 +295,16 @@ void modbus_set_bits_from_byte(uint8_t *dest, int index, const uint8_t value)
 void modbus_set_bits_from_bytes(uint8_t *dest, int index, unsigned int nb_bits,
                                 const uint8_t *tab_byte)
 {
-    unsigned int i;
-    int shift = 0;
-
-    for (i = index; i < index + nb_bits; i++) {
-        dest[i] = tab_byte[(i - index) / 8] & (1 << shift) ? 1 : 0;
-        /* gcc doesn't like: shift = (++shift) % 8; */
-        shift++;
-        shift %= 8;
-    }
+    unpack_bits(dest + index, tab_byte, nb_bits);
+}
+
+/* Sets a table of bytes from many bits (the bits between index and
+   index + nb_bits are packed in dest, the unused bits of the last byte are
+   cleared) */
+void modbus_set_bytes_from_bits(uint8_t *dest, const uint8_t *src, int index,
+                                unsigned int nb_bits)
+{
+    pack_bits(dest, src + index, nb_bits);
 }
 
 /* Gets the byte value from many bits.
@@ -96,7 +312,6 @@ void modbus_set_bits_from_bytes(uint8_t *dest, int index, unsigned int nb_bits,
 uint8_t modbus_get_byte_from_bits(const uint8_t *src, int index,
                                   unsigned int nb_bits)
 {
-    unsigned int i;
     uint8_t value = 0;
 
     if (nb_bits > 8) {
@@ -105,13 +320,139 @@ uint8_t modbus_get_byte_from_bits(const uint8_t *src, int index,
         nb_bits = 8;
     }
 
-    for (i=0; i < nb_bits; i++) {
-        value |= (src[index+i] << i);
-    }
+    pack_bits_scalar(&value, src + index, nb_bits);
 
     return value;
 }
 
+/* Copies nb 16-bit values from src to dest and swaps the two bytes of each
+   value. The arrays may be unaligned (the registers of a frame start at an
+   odd offset) but must not overlap. */
+static void bswap16_scalar(uint8_t *dest, const uint8_t *src, int nb)
+{
+    int i;
+
+    for (i = 0; i < nb; i++) {
+        dest[i << 1] = src[(i << 1) + 1];
+        dest[(i << 1) + 1] = src[i << 1];
+    }
+}
+
+#if defined(__SSE2__) || HAVE_X86_CPU_DISPATCH
+#if !defined(__SSE2__)
+__attribute__((target("sse2")))
+#endif
+static void bswap16_sse2(uint8_t *dest, const uint8_t *src, int nb)
+{
+    int i;
+
+    for (i = 0; i + 8 <= nb; i += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(src + (i << 1)));
+
+        v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+        _mm_storeu_si128((__m128i *)(dest + (i << 1)), v);
+    }
+    bswap16_scalar(dest + (i << 1), src + (i << 1), nb - i);
+}
+#endif
+
+#if HAVE_X86_CPU_DISPATCH
+__attribute__((target("avx2")))
+static void bswap16_avx2(uint8_t *dest, const uint8_t *src, int nb)
+{
+    const __m256i shuffle = _mm256_setr_epi8(
+        1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14,
+        1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+    int i;
+
+    for (i = 0; i + 16 <= nb; i += 16) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(src + (i << 1)));
+
+        _mm256_storeu_si256((__m256i *)(dest + (i << 1)),
+                            _mm256_shuffle_epi8(v, shuffle));
+    }
+    /* The tail is processed here rather than by bswap16_sse2: its legacy SSE
+       instructions after the AVX ones cost a state transition (more than
+       100 ns on some processors) */
+    if (i + 8 <= nb) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(src + (i << 1)));
+
+        _mm_storeu_si128((__m128i *)(dest + (i << 1)),
+                         _mm_shuffle_epi8(v, _mm256_castsi256_si128(shuffle)));
+        i += 8;
+    }
+    for (; i < nb; i++) {
+        dest[i << 1] = src[(i << 1) + 1];
+        dest[(i << 1) + 1] = src[i << 1];
+    }
+}
+#endif
+
+#ifdef _MODBUS_BSWAP16_NEON
+static void bswap16_neon(uint8_t *dest, const uint8_t *src, int nb)
+{
+    int i;
+
+    for (i = 0; i + 8 <= nb; i += 8) {
+        vst1q_u8(dest + (i << 1), vrev16q_u8(vld1q_u8(src + (i << 1))));
+    }
+    bswap16_scalar(dest + (i << 1), src + (i << 1), nb - i);
+}
+#endif
+
+static void bswap16(uint8_t *dest, const uint8_t *src, int nb)
+{
+#if HAVE_X86_CPU_DISPATCH
+    if (nb >= 16 && __builtin_cpu_supports("avx2"))
+        bswap16_avx2(dest, src, nb);
+    else if (nb >= 8 && __builtin_cpu_supports("sse2"))
+        bswap16_sse2(dest, src, nb);
+    else
+        bswap16_scalar(dest, src, nb);
+#elif defined(__SSE2__)
+    bswap16_sse2(dest, src, nb);
+#elif defined(_MODBUS_BSWAP16_NEON)
+    bswap16_neon(dest, src, nb);
+#else
+    bswap16_scalar(dest, src, nb);
+#endif
+}
+
+/* Sets nb registers from a table of bytes in Modbus (big-endian) order */
+void modbus_set_registers_from_bytes(uint16_t *dest, int nb,
+                                     const uint8_t *tab_byte)
+{
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    memcpy(dest, tab_byte, nb * sizeof(uint16_t));
+#elif defined(__BYTE_ORDER__)
+    bswap16((uint8_t *)dest, tab_byte, nb);
+#else
+    int i;
+
+    for (i = 0; i < nb; i++) {
+        dest[i] = (tab_byte[i << 1] << 8) | tab_byte[(i << 1) + 1];
+    }
+#endif
+}
+
+/* Sets a table of bytes in Modbus (big-endian) order from nb registers */
+void modbus_set_bytes_from_registers(uint8_t *dest, int nb,
+                                     const uint16_t *src)
+{
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    memcpy(dest, src, nb * sizeof(uint16_t));
+#elif defined(__BYTE_ORDER__)
+    bswap16(dest, (const uint8_t *)src, nb);
+#else
+    int i;
+
+    for (i = 0; i < nb; i++) {
+        dest[i << 1] = src[i] >> 8;
+        dest[(i << 1) + 1] = src[i] & 0xFF;
+    }
+#endif
+}
+
 /* Get a float from 4 bytes in Modbus format (ABCD) */
 float modbus_get_float(const uint16_t *src)
 {
@@ -0,0 +1,756 @@
+/*
+ * Copyright © 2001-2011 Stéphane Raimbault <stephane.raimbault@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <config.h>
+
+#include "modbus-private.h"
+
+/* A concurrent mapping protects each block of values of its tables with a
+   sequence number (seqlock). A writer makes the sequence numbers of the
+   blocks it modifies odd, writes the values then makes them even again. A
+   reader copies the values and retries when a sequence number was odd or
+   has changed during the copy, so the readers never wait for a lock and
+   always get a consistent snapshot of the values. The writers are
+   serialized by a spin lock. */
+#if defined(__GNUC__)
+# define _MODBUS_MAPPING_CONCURRENT
+#endif
+
+/* Number of values (bits or registers) protected by a sequence number */
+#define _MAPPING_BLOCK_SHIFT 6
+
+/* Sequence numbers kept on the stack by a reader */
+#define _MAPPING_MAX_STACK_BLOCKS 64
+
+#define _MAPPING_NB_TABLES 4
+
+typedef struct _mapping_sync {
+    int write_lock;
+    unsigned int *seq[_MAPPING_NB_TABLES];
+} _mapping_sync_t;
+
+/* A mapping allocated with flags by modbus_mapping_new_ext() is the first
+   member of a private extension so modbus_mapping_t keeps the layout of the
+   mappings declared by the applications. The extensions are identified by
+   their addresses in a registry. */
+typedef struct _mapping_ext {
+    modbus_mapping_t mapping;
+    /* MODBUS_MAPPING_* flags the mapping has been allocated with */
+    int flags;
+    /* Synchronization of a concurrent mapping (NULL otherwise) */
+    _mapping_sync_t *sync;
+} _mapping_ext_t;
+
+/* The registry is a hash table of the addresses of the extensions, each
+   bucket is a list of chunks */
+#define _MAPPING_REGISTRY_BUCKETS 64
+#define _MAPPING_REGISTRY_SLOTS 8
+
+/* The chunks of the registry are never freed so the lookups don't take any
+   lock */
+typedef struct _mapping_registry {
+    _mapping_ext_t *slots[_MAPPING_REGISTRY_SLOTS];
+    struct _mapping_registry *next;
+} _mapping_registry_t;
+
+static _mapping_registry_t mapping_registry[_MAPPING_REGISTRY_BUCKETS];
+/* Number of extensions registered in each bucket, a mapping whose bucket is
+   empty (always the case of the plain mappings when there is no extension)
+   is not looked up */
+static int mapping_nb_ext[_MAPPING_REGISTRY_BUCKETS];
+
+#ifdef _MODBUS_MAPPING_CONCURRENT
+# define MAPPING_LOAD(p) __atomic_load_n(p, __ATOMIC_ACQUIRE)
+# define MAPPING_STORE(p, v) __atomic_store_n(p, v, __ATOMIC_RELEASE)
+# define MAPPING_CAS(p, expected, v) \
+    __atomic_compare_exchange_n(p, expected, v, 0, __ATOMIC_ACQ_REL, \
+                                __ATOMIC_ACQUIRE)
+# define MAPPING_ADD(p, v) __atomic_add_fetch(p, v, __ATOMIC_ACQ_REL)
+#else
+# define MAPPING_LOAD(p) (*(p))
+# define MAPPING_STORE(p, v) (*(p) = (v))
+# define MAPPING_CAS(p, expected, v) \
+    (*(p) == *(expected) ? (*(p) = (v), 1) : (*(expected) = *(p), 0))
+# define MAPPING_ADD(p, v) (*(p) += (v))
+#endif
+
+static unsigned int mapping_bucket(const modbus_mapping_t *mb_mapping)
+{
+    /* The low bits are the same for all the allocations */
+    size_t key = (size_t)mb_mapping >> 4;
+
+    return (unsigned int)((key ^ (key >> 6) ^ (key >> 12)) %
+                          _MAPPING_REGISTRY_BUCKETS);
+}
+
+/* Returns the extension of the mapping or NULL if it has been allocated
+   without flags */
+static _mapping_ext_t *mapping_ext(const modbus_mapping_t *mb_mapping)
+{
+    unsigned int bucket = mapping_bucket(mb_mapping);
+    _mapping_registry_t *chunk;
+    int i;
+
+    if (MAPPING_LOAD(&mapping_nb_ext[bucket]) == 0)
+        return NULL;
+
+    for (chunk = &mapping_registry[bucket]; chunk != NULL;
+         chunk = MAPPING_LOAD(&chunk->next)) {
+        for (i = 0; i < _MAPPING_REGISTRY_SLOTS; i++) {
+            _mapping_ext_t *ext = MAPPING_LOAD(&chunk->slots[i]);
+
+            if (ext != NULL && &ext->mapping == mb_mapping)
+                return ext;
+        }
+    }
+
+    return NULL;
+}
+
+static int mapping_register(_mapping_ext_t *ext)
+{
+    unsigned int bucket = mapping_bucket(&ext->mapping);
+    _mapping_registry_t *chunk = &mapping_registry[bucket];
+
+    for (;;) {
+        _mapping_registry_t *next;
+        int i;
+
+        for (i = 0; i < _MAPPING_REGISTRY_SLOTS; i++) {
+            _mapping_ext_t *expected = NULL;
+
+            if (MAPPING_LOAD(&chunk->slots[i]) == NULL &&
+                MAPPING_CAS(&chunk->slots[i], &expected, ext)) {
+                MAPPING_ADD(&mapping_nb_ext[bucket], 1);
+                return 0;
+            }
+        }
+
+        next = MAPPING_LOAD(&chunk->next);
+        if (next == NULL) {
+            _mapping_registry_t *expected = NULL;
+
+            next = calloc(1, sizeof(_mapping_registry_t));
+            if (next == NULL)
+                return -1;
+            if (!MAPPING_CAS(&chunk->next, &expected, next)) {
+                /* Appended by another thread */
+                free(next);
+                next = expected;
+            }
+        }
+        chunk = next;
+    }
+}
+
+static void mapping_unregister(_mapping_ext_t *ext)
+{
+    unsigned int bucket = mapping_bucket(&ext->mapping);
+    _mapping_registry_t *chunk;
+    int i;
+
+    for (chunk = &mapping_registry[bucket]; chunk != NULL;
+         chunk = MAPPING_LOAD(&chunk->next)) {
+        for (i = 0; i < _MAPPING_REGISTRY_SLOTS; i++) {
+            if (MAPPING_LOAD(&chunk->slots[i]) == ext) {
+                MAPPING_STORE(&chunk->slots[i], NULL);
+                MAPPING_ADD(&mapping_nb_ext[bucket], -1);
+                return;
+            }
+        }
+    }
+}
+
+static _mapping_sync_t *mapping_sync(const modbus_mapping_t *mb_mapping)
+{
+    _mapping_ext_t *ext = mapping_ext(mb_mapping);
+
+    return ext != NULL ? ext->sync : NULL;
+}
+
+/* Gives the array of the table, its number of values and the size of a
+   value, returns -1 if the table is unknown */
+static int mapping_table(modbus_mapping_t *mb_mapping, int table,
+                         uint8_t **values, int *nb, size_t *size)
+{
+    switch (table) {
+    case MODBUS_MAPPING_BITS:
+        *values = mb_mapping->tab_bits;
+        *nb = mb_mapping->nb_bits;
+        *size = sizeof(uint8_t);
+        break;
+    case MODBUS_MAPPING_INPUT_BITS:
+        *values = mb_mapping->tab_input_bits;
+        *nb = mb_mapping->nb_input_bits;
+        *size = sizeof(uint8_t);
+        break;
+    case MODBUS_MAPPING_REGISTERS:
+        *values = (uint8_t *)mb_mapping->tab_registers;
+        *nb = mb_mapping->nb_registers;
+        *size = sizeof(uint16_t);
+        break;
+    case MODBUS_MAPPING_INPUT_REGISTERS:
+        *values = (uint8_t *)mb_mapping->tab_input_registers;
+        *nb = mb_mapping->nb_input_registers;
+        *size = sizeof(uint16_t);
+        break;
+    default:
+        return -1;
+    }
+
+    return 0;
+}
+
+#ifdef _MODBUS_MAPPING_CONCURRENT
+
+static void mapping_cpu_relax(void)
+{
+#if defined(__i386__) || defined(__x86_64__)
+    __builtin_ia32_pause();
+#endif
+}
+
+static void mapping_write_lock(_mapping_sync_t *sync)
+{
+    while (__atomic_exchange_n(&sync->write_lock, 1, __ATOMIC_ACQUIRE)) {
+        while (__atomic_load_n(&sync->write_lock, __ATOMIC_RELAXED))
+            mapping_cpu_relax();
+    }
+}
+
+static void mapping_write_unlock(_mapping_sync_t *sync)
+{
+    __atomic_store_n(&sync->write_lock, 0, __ATOMIC_RELEASE);
+}
+
+#endif
+
+/* Copies the nb values of the table from addr to dest */
+typedef void (*mapping_copy_t)(const uint8_t *values, size_t size,
+                               int addr, int nb, void *dest);
+
+static void copy_values(const uint8_t *values, size_t size,
+                        int addr, int nb, void *dest)
+{
+    memcpy(dest, values + addr * size, nb * size);
+}
+
+/* Packs the bits of a table of one byte by bit into dest, the least
+   significant bit first */
+static void pack_bits(const uint8_t *values, size_t size,
+                      int addr, int nb, void *dest)
+{
+    (void)size;
+    modbus_set_bytes_from_bits(dest, values, addr, nb);
+}
+
+/* Copies the bits of a packed table from the bit addr to dest from its first
+   bit. The unused bits of the last byte of dest are cleared. */
+static void copy_packed_bits(const uint8_t *values, size_t size,
+                             int addr, int nb, void *dest)
+{
+    const uint8_t *src = values + (addr >> 3);
+    uint8_t *p = dest;
+    int shift = addr & 7;
+    int nb_bytes = (nb + 7) >> 3;
+    /* Number of bytes of src holding the bits */
+    int nb_src_bytes = (shift + nb + 7) >> 3;
+    int i = 0;
+
+    (void)size;
+    if (shift == 0) {
+        memcpy(p, src, nb_bytes);
+    } else {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        /* 64 bits by iteration while the 9 source bytes are in the table */
+        for (; i + 9 <= nb_src_bytes; i += 8) {
+            uint64_t word;
+
+            memcpy(&word, src + i, sizeof(word));
+            word = (word >> shift) | ((uint64_t)src[i + 8] << (64 - shift));
+            memcpy(p + i, &word, sizeof(word));
+        }
+#endif
+        for (; i < nb_bytes; i++) {
+            unsigned int one_byte = src[i] >> shift;
+
+            if (i + 1 < nb_src_bytes)
+                one_byte |= src[i + 1] << (8 - shift);
+            p[i] = one_byte;
+        }
+    }
+
+    if (nb & 7)
+        p[nb_bytes - 1] &= (1 << (nb & 7)) - 1;
+}
+
+/* Stores nb bits of src, from its first bit, in a packed table from the bit
+   addr */
+static void store_packed_bits(uint8_t *values, int addr, int nb,
+                              const uint8_t *src)
+{
+    uint8_t *p = values + (addr >> 3);
+    int shift = addr & 7;
+    int nb_bytes = (nb + 7) >> 3;
+    int i;
+
+    if (shift == 0 && (nb & 7) == 0) {
+        memcpy(p, src, nb_bytes);
+        return;
+    }
+
+    for (i = 0; i < nb_bytes; i++) {
+        int n = nb - (i << 3);
+        /* Mask and value of the bits over two bytes of the table */
+        unsigned int mask = ((n >= 8) ? 0xFF : ((1 << n) - 1)) << shift;
+        unsigned int value = (src[i] << shift) & mask;
+
+        p[i] = (p[i] & ~mask) | value;
+        if (mask >> 8)
+            p[i + 1] = (p[i + 1] & ~(mask >> 8)) | (value >> 8);
+    }
+}
+
+/* Copies the values with copy, retried until the copy is consistent when the
+   mapping is concurrent. Returns -1 if the memory can't be allocated. */
+static int mapping_read(modbus_mapping_t *mb_mapping, _mapping_sync_t *sync,
+                        int table, int addr, int nb, mapping_copy_t copy,
+                        void *dest)
+{
+    uint8_t *values = NULL;
+    size_t size = 0;
+    int nb_values;
+#ifdef _MODBUS_MAPPING_CONCURRENT
+    unsigned int stack_seq[_MAPPING_MAX_STACK_BLOCKS];
+    unsigned int *seq;
+    unsigned int *block_seq;
+    int first;
+    int nb_blocks;
+    int i;
+#endif
+
+    mapping_table(mb_mapping, table, &values, &nb_values, &size);
+
+#ifdef _MODBUS_MAPPING_CONCURRENT
+    if (sync == NULL || nb == 0) {
+        copy(values, size, addr, nb, dest);
+        return 0;
+    }
+
+    first = addr >> _MAPPING_BLOCK_SHIFT;
+    nb_blocks = ((addr + nb - 1) >> _MAPPING_BLOCK_SHIFT) - first + 1;
+    if (nb_blocks <= _MAPPING_MAX_STACK_BLOCKS) {
+        seq = stack_seq;
+    } else {
+        seq = malloc(nb_blocks * sizeof(unsigned int));
+        if (seq == NULL)
+            return -1;
+    }
+    block_seq = sync->seq[table] + first;
+
+    for (;;) {
+        int changed = 0;
+
+        for (i = 0; i < nb_blocks; i++) {
+            seq[i] = __atomic_load_n(&block_seq[i], __ATOMIC_ACQUIRE);
+            if (seq[i] & 1)
+                break;
+        }
+        if (i < nb_blocks) {
+            /* Being written */
+            mapping_cpu_relax();
+            continue;
+        }
+
+        copy(values, size, addr, nb, dest);
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        for (i = 0; i < nb_blocks; i++) {
+            if (__atomic_load_n(&block_seq[i], __ATOMIC_RELAXED) != seq[i]) {
+                changed = 1;
+                break;
+            }
+        }
+        if (!changed)
+            break;
+    }
+
+    if (seq != stack_seq)
+        free(seq);
+#else
+    (void)sync;
+    copy(values, size, addr, nb, dest);
+#endif
+
+    return 0;
+}
+
+/* Returns a consistent copy of the nb values of the table from addr. The
+   values of a mapping which isn't concurrent are not copied: the returned
+   pointer is in the table. Packed bits are read with
+   _modbus_mapping_get_bits. */
+const void *_modbus_mapping_snapshot(modbus_mapping_t *mb_mapping, int table,
+                                     int addr, int nb, void *dest)
+{
+    _mapping_sync_t *sync = mapping_sync(mb_mapping);
+    uint8_t *values = NULL;
+    size_t size = 0;
+    int nb_values;
+
+    mapping_table(mb_mapping, table, &values, &nb_values, &size);
+    if (sync == NULL || nb == 0)
+        return values + addr * size;
+
+    if (mapping_read(mb_mapping, sync, table, addr, nb, copy_values,
+                     dest) == -1)
+        return NULL;
+
+    return dest;
+}
+
+static int is_packed_bits(const _mapping_ext_t *ext, int table)
+{
+    return ext != NULL && (ext->flags & MODBUS_MAPPING_PACKED_BITS) &&
+        (table == MODBUS_MAPPING_BITS || table == MODBUS_MAPPING_INPUT_BITS);
+}
+
+static void mapping_write_begin(_mapping_sync_t *sync, int table,
+                                int addr, int nb);
+static void mapping_write_end(_mapping_sync_t *sync, int table,
+                              int addr, int nb);
+
+/* Writes the nb bits of the table from addr in dest, packed as in the Modbus
+   frames, and returns the number of bytes written or -1 if the memory can't
+   be allocated */
+int _modbus_mapping_get_bits(modbus_mapping_t *mb_mapping, int table,
+                             int addr, int nb, uint8_t *dest)
+{
+    _mapping_ext_t *ext = mapping_ext(mb_mapping);
+    mapping_copy_t copy;
+
+    copy = is_packed_bits(ext, table) ? copy_packed_bits : pack_bits;
+    if (mapping_read(mb_mapping, ext != NULL ? ext->sync : NULL, table,
+                     addr, nb, copy, dest) == -1)
+        return -1;
+
+    return (nb + 7) >> 3;
+}
+
+/* Sets the nb bits of the table from addr to the bits packed in src */
+void _modbus_mapping_set_bits(modbus_mapping_t *mb_mapping, int table,
+                              int addr, int nb, const uint8_t *src)
+{
+    _mapping_ext_t *ext = mapping_ext(mb_mapping);
+    _mapping_sync_t *sync = ext != NULL ? ext->sync : NULL;
+    uint8_t *values = NULL;
+    size_t size = 0;
+    int nb_values;
+
+    mapping_table(mb_mapping, table, &values, &nb_values, &size);
+
+    mapping_write_begin(sync, table, addr, nb);
+    if (is_packed_bits(ext, table))
+        store_packed_bits(values, addr, nb, src);
+    else
+        modbus_set_bits_from_bytes(values, addr, nb, src);
+    mapping_write_end(sync, table, addr, nb);
+}
+
+static void mapping_write_begin(_mapping_sync_t *sync, int table,
+                                int addr, int nb)
+{
+#ifdef _MODBUS_MAPPING_CONCURRENT
+    int last;
+    int i;
+
+    if (sync == NULL || nb == 0)
+        return;
+
+    mapping_write_lock(sync);
+
+    last = (addr + nb - 1) >> _MAPPING_BLOCK_SHIFT;
+    for (i = addr >> _MAPPING_BLOCK_SHIFT; i <= last; i++) {
+        __atomic_store_n(&sync->seq[table][i], sync->seq[table][i] + 1,
+                         __ATOMIC_RELAXED);
+    }
+    /* The odd sequence numbers are visible before the new values */
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+#else
+    (void)sync;
+    (void)table;
+    (void)addr;
+    (void)nb;
+#endif
+}
+
+static void mapping_write_end(_mapping_sync_t *sync, int table,
+                              int addr, int nb)
+{
+#ifdef _MODBUS_MAPPING_CONCURRENT
+    int last;
+    int i;
+
+    if (sync == NULL || nb == 0)
+        return;
+
+    last = (addr + nb - 1) >> _MAPPING_BLOCK_SHIFT;
+    for (i = addr >> _MAPPING_BLOCK_SHIFT; i <= last; i++) {
+        __atomic_store_n(&sync->seq[table][i], sync->seq[table][i] + 1,
+                         __ATOMIC_RELEASE);
+    }
+
+    mapping_write_unlock(sync);
+#else
+    (void)sync;
+    (void)table;
+    (void)addr;
+    (void)nb;
+#endif
+}
+
+/* The values of the table from addr to addr + nb can be modified between
+   _modbus_mapping_write_begin and _modbus_mapping_write_end */
+void _modbus_mapping_write_begin(modbus_mapping_t *mb_mapping, int table,
+                                 int addr, int nb)
+{
+    mapping_write_begin(mapping_sync(mb_mapping), table, addr, nb);
+}
+
+void _modbus_mapping_write_end(modbus_mapping_t *mb_mapping, int table,
+                               int addr, int nb)
+{
+    mapping_write_end(mapping_sync(mb_mapping), table, addr, nb);
+}
+
+int _modbus_mapping_is_concurrent(const modbus_mapping_t *mb_mapping)
+{
+    return mapping_sync(mb_mapping) != NULL;
+}
+
+/* Unregisters and frees the extension of the mapping, the mapping itself
+   (at the same address) is freed by modbus_mapping_free() */
+void _modbus_mapping_free_ext(modbus_mapping_t *mb_mapping)
+{
+    _mapping_ext_t *ext = mapping_ext(mb_mapping);
+    _mapping_sync_t *sync;
+    int i;
+
+    if (ext == NULL)
+        return;
+
+    mapping_unregister(ext);
+    sync = ext->sync;
+    if (sync == NULL)
+        return;
+
+    for (i = 0; i < _MAPPING_NB_TABLES; i++) {
+        free(sync->seq[i]);
+    }
+    free(sync);
+    ext->sync = NULL;
+}
+
+#ifdef _MODBUS_MAPPING_CONCURRENT
+static int mapping_init_sync(_mapping_ext_t *ext)
+{
+    _mapping_sync_t *sync;
+    int i;
+
+    sync = calloc(1, sizeof(_mapping_sync_t));
+    if (sync == NULL)
+        return -1;
+    ext->sync = sync;
+
+    for (i = 0; i < _MAPPING_NB_TABLES; i++) {
+        uint8_t *values;
+        size_t size;
+        int nb;
+
+        mapping_table(&ext->mapping, i, &values, &nb, &size);
+        sync->seq[i] = calloc((nb >> _MAPPING_BLOCK_SHIFT) + 1,
+                              sizeof(unsigned int));
+        if (sync->seq[i] == NULL)
+            return -1;
+    }
+
+    return 0;
+}
+#endif
+
+/* Allocates a mapping with the MODBUS_MAPPING_* flags */
+modbus_mapping_t* modbus_mapping_new_ext(int nb_bits, int nb_input_bits,
+                                         int nb_registers,
+                                         int nb_input_registers, int flags)
+{
+    modbus_mapping_t *mb_mapping;
+    _mapping_ext_t *ext;
+
+    if (flags & ~(MODBUS_MAPPING_CONCURRENT | MODBUS_MAPPING_PACKED_BITS)) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+#ifndef _MODBUS_MAPPING_CONCURRENT
+    if (flags & MODBUS_MAPPING_CONCURRENT) {
+        errno = ENOTSUP;
+        return NULL;
+    }
+#endif
+
+    if (!(flags & MODBUS_MAPPING_PACKED_BITS)) {
+        mb_mapping = modbus_mapping_new(nb_bits, nb_input_bits, nb_registers,
+                                        nb_input_registers);
+        if (mb_mapping == NULL)
+            return NULL;
+    } else {
+        if (nb_bits < 0 || nb_input_bits < 0) {
+            errno = EINVAL;
+            return NULL;
+        }
+
+        mb_mapping = modbus_mapping_new(0, 0, nb_registers,
+                                        nb_input_registers);
+        if (mb_mapping == NULL)
+            return NULL;
+
+        /* 8 bits by byte */
+        mb_mapping->nb_bits = nb_bits;
+        mb_mapping->nb_input_bits = nb_input_bits;
+        if (nb_bits != 0)
+            mb_mapping->tab_bits = calloc((nb_bits + 7) / 8, sizeof(uint8_t));
+        if (nb_input_bits != 0)
+            mb_mapping->tab_input_bits = calloc((nb_input_bits + 7) / 8,
+                                                sizeof(uint8_t));
+        if ((nb_bits != 0 && mb_mapping->tab_bits == NULL) ||
+            (nb_input_bits != 0 && mb_mapping->tab_input_bits == NULL)) {
+            modbus_mapping_free(mb_mapping);
+            errno = ENOMEM;
+            return NULL;
+        }
+    }
+    if (flags == 0)
+        return mb_mapping;
+
+    /* Moves the mapping in its extension */
+    ext = calloc(1, sizeof(_mapping_ext_t));
+    if (ext == NULL) {
+        modbus_mapping_free(mb_mapping);
+        errno = ENOMEM;
+        return NULL;
+    }
+    ext->mapping = *mb_mapping;
+    ext->flags = flags;
+    free(mb_mapping);
+    mb_mapping = &ext->mapping;
+
+    if (mapping_register(ext) == -1) {
+        modbus_mapping_free(mb_mapping);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+#ifdef _MODBUS_MAPPING_CONCURRENT
+    if ((flags & MODBUS_MAPPING_CONCURRENT) &&
+        mapping_init_sync(ext) == -1) {
+        modbus_mapping_free(mb_mapping);
+        errno = ENOMEM;
+        return NULL;
+    }
+#endif
+
+    return mb_mapping;
+}
+
+/* Allocates a mapping whose values can be read and written concurrently by
+   several threads (servers and application) */
+modbus_mapping_t* modbus_mapping_new_concurrent(int nb_bits, int nb_input_bits,
+                                                int nb_registers,
+                                                int nb_input_registers)
+{
+    return modbus_mapping_new_ext(nb_bits, nb_input_bits, nb_registers,
+                                  nb_input_registers,
+                                  MODBUS_MAPPING_CONCURRENT);
+}
+
+/* Copies nb values (one uint8_t by bit or uint16_t by register) of the
+   table from addr to dest. The bits of a packed table are copied packed. */
+int modbus_mapping_read(modbus_mapping_t *mb_mapping, int table,
+                        int addr, int nb, void *dest)
+{
+    const void *snapshot;
+    uint8_t *values;
+    size_t size;
+    int nb_values;
+
+    if (mb_mapping == NULL || dest == NULL ||
+        mapping_table(mb_mapping, table, &values, &nb_values, &size) == -1 ||
+        addr < 0 || nb < 0 || addr + nb > nb_values) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (is_packed_bits(mapping_ext(mb_mapping), table)) {
+        if (_modbus_mapping_get_bits(mb_mapping, table, addr, nb, dest) == -1) {
+            errno = ENOMEM;
+            return -1;
+        }
+        return nb;
+    }
+
+    snapshot = _modbus_mapping_snapshot(mb_mapping, table, addr, nb, dest);
+    if (snapshot == NULL) {
+        errno = ENOMEM;
+        return -1;
+    }
+    if (snapshot != dest)
+        memcpy(dest, snapshot, nb * size);
+
+    return nb;
+}
+
+/* Copies nb values (one uint8_t by bit or uint16_t by register) from src to
+   the table from addr. The bits of a packed table are copied packed. */
+int modbus_mapping_write(modbus_mapping_t *mb_mapping, int table,
+                         int addr, int nb, const void *src)
+{
+    uint8_t *values;
+    size_t size;
+    int nb_values;
+
+    if (mb_mapping == NULL || src == NULL ||
+        mapping_table(mb_mapping, table, &values, &nb_values, &size) == -1 ||
+        addr < 0 || nb < 0 || addr + nb > nb_values) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (is_packed_bits(mapping_ext(mb_mapping), table)) {
+        _modbus_mapping_set_bits(mb_mapping, table, addr, nb, src);
+        return nb;
+    }
+
+    _modbus_mapping_write_begin(mb_mapping, table, addr, nb);
+    memcpy(values + addr * size, src, nb * size);
+    _modbus_mapping_write_end(mb_mapping, table, addr, nb);
+
+    return nb;
+}
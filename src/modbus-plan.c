@@ -0,0 +1,318 @@
+/*
+ * Copyright © 2001-2011 Stéphane Raimbault <stephane.raimbault@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <config.h>
+
+#include "modbus-private.h"
+#include "modbus-plan.h"
+
+/* Range of a table read by one or several requests (split at the protocol
+   limit when a tag is larger) */
+typedef struct {
+    int function;
+    int addr;
+    int nb;
+    /* Position of the values in the buffer of the plan */
+    int offset;
+    int first_req;
+} _plan_block_t;
+
+typedef struct {
+    int index;
+    int function;
+    int addr;
+    int nb;
+} _plan_tag_t;
+
+struct _modbus_plan {
+    modbus_request_t *tags;
+    int nb_tags;
+    /* Block of each tag */
+    int *tag_block;
+    int nb_blocks;
+    _plan_block_t *blocks;
+    int nb_reqs;
+    modbus_request_t *reqs;
+    /* Values read by the requests, the blocks of bits and of registers don't
+       share the same buffer */
+    uint8_t *tab_bits;
+    uint16_t *tab_registers;
+};
+
+static int is_bits_function(int function)
+{
+    return function == MODBUS_FC_READ_COILS ||
+        function == MODBUS_FC_READ_DISCRETE_INPUTS;
+}
+
+static int max_read(int function)
+{
+    return is_bits_function(function) ?
+        MODBUS_MAX_READ_BITS : MODBUS_MAX_READ_REGISTERS;
+}
+
+/* By table then by address, the largest tag first */
+static int compare_tags(const void *a, const void *b)
+{
+    const _plan_tag_t *ta = (const _plan_tag_t *) a;
+    const _plan_tag_t *tb = (const _plan_tag_t *) b;
+
+    if (ta->function != tb->function)
+        return ta->function - tb->function;
+    if (ta->addr != tb->addr)
+        return ta->addr - tb->addr;
+    return tb->nb - ta->nb;
+}
+
+modbus_plan_t* modbus_plan_new(modbus_request_t *tags, int nb_tags,
+                               int max_gap)
+{
+    modbus_plan_t *plan;
+    _plan_tag_t *sorted;
+    _plan_block_t *b = NULL;
+    int nb_bits = 0;
+    int nb_registers = 0;
+    int i;
+
+    if (nb_tags < 0 || (nb_tags > 0 && tags == NULL) || max_gap < 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    for (i = 0; i < nb_tags; i++) {
+        modbus_request_t *t = &tags[i];
+
+        if (t->function < MODBUS_FC_READ_COILS ||
+            t->function > MODBUS_FC_READ_INPUT_REGISTERS ||
+            t->addr < 0 || t->nb < 1 || t->addr + t->nb > 0x10000 ||
+            t->data == NULL) {
+            errno = EINVAL;
+            return NULL;
+        }
+    }
+
+    plan = (modbus_plan_t *) calloc(1, sizeof(modbus_plan_t));
+    if (plan == NULL) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    plan->tags = tags;
+    plan->nb_tags = nb_tags;
+    if (nb_tags == 0)
+        return plan;
+
+    sorted = (_plan_tag_t *) malloc(nb_tags * sizeof(_plan_tag_t));
+    plan->tag_block = (int *) malloc(nb_tags * sizeof(int));
+    /* At worst, one block by tag */
+    plan->blocks = (_plan_block_t *) malloc(nb_tags * sizeof(_plan_block_t));
+    if (sorted == NULL || plan->tag_block == NULL || plan->blocks == NULL) {
+        free(sorted);
+        modbus_plan_free(plan);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    for (i = 0; i < nb_tags; i++) {
+        sorted[i].index = i;
+        sorted[i].function = tags[i].function;
+        sorted[i].addr = tags[i].addr;
+        sorted[i].nb = tags[i].nb;
+    }
+    qsort(sorted, nb_tags, sizeof(_plan_tag_t), compare_tags);
+
+    /* A tag joins the current block when the values skipped to reach it
+       don't exceed the gap. A block is split at the limit of the protocol
+       below, so the tag is only kept apart when reading the skipped values
+       would need more requests than reading the tag alone (never for
+       adjacent tags). */
+    for (i = 0; i < nb_tags; i++) {
+        _plan_tag_t *t = &sorted[i];
+        int tag_end = t->addr + t->nb;
+
+        if (b != NULL && b->function == t->function &&
+            t->addr <= b->addr + b->nb + max_gap) {
+            int max = max_read(b->function);
+            int block_end = b->addr + b->nb;
+
+            if (tag_end <= block_end) {
+                plan->tag_block[t->index] = plan->nb_blocks - 1;
+                continue;
+            }
+            if ((tag_end - b->addr + max - 1) / max <=
+                (b->nb + max - 1) / max + (t->nb + max - 1) / max) {
+                b->nb = tag_end - b->addr;
+                plan->tag_block[t->index] = plan->nb_blocks - 1;
+                continue;
+            }
+        }
+
+        b = &plan->blocks[plan->nb_blocks];
+        b->function = t->function;
+        b->addr = t->addr;
+        b->nb = t->nb;
+        plan->tag_block[t->index] = plan->nb_blocks++;
+    }
+    free(sorted);
+
+    for (i = 0; i < plan->nb_blocks; i++) {
+        b = &plan->blocks[i];
+        if (is_bits_function(b->function)) {
+            b->offset = nb_bits;
+            nb_bits += b->nb;
+        } else {
+            b->offset = nb_registers;
+            nb_registers += b->nb;
+        }
+        b->first_req = plan->nb_reqs;
+        plan->nb_reqs += (b->nb + max_read(b->function) - 1) /
+            max_read(b->function);
+    }
+
+    plan->reqs = (modbus_request_t *) calloc(plan->nb_reqs,
+                                             sizeof(modbus_request_t));
+    if (nb_bits > 0)
+        plan->tab_bits = (uint8_t *) malloc(nb_bits * sizeof(uint8_t));
+    if (nb_registers > 0)
+        plan->tab_registers = (uint16_t *) malloc(nb_registers * sizeof(uint16_t));
+    if (plan->reqs == NULL || (nb_bits > 0 && plan->tab_bits == NULL) ||
+        (nb_registers > 0 && plan->tab_registers == NULL)) {
+        modbus_plan_free(plan);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    for (i = 0; i < plan->nb_blocks; i++) {
+        int max;
+        int done;
+        modbus_request_t *r;
+
+        b = &plan->blocks[i];
+        max = max_read(b->function);
+        r = &plan->reqs[b->first_req];
+        for (done = 0; done < b->nb; done += max, r++) {
+            r->function = b->function;
+            r->addr = b->addr + done;
+            r->nb = (b->nb - done < max) ? b->nb - done : max;
+            if (is_bits_function(b->function))
+                r->data = plan->tab_bits + b->offset + done;
+            else
+                r->data = plan->tab_registers + b->offset + done;
+        }
+    }
+
+    return plan;
+}
+
+int modbus_plan_get_nb_requests(modbus_plan_t *plan)
+{
+    if (plan == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    return plan->nb_reqs;
+}
+
+/* Copies the values of a tag from the requests of its block or reports the
+   error of the first request failed */
+static int scatter_tag(modbus_plan_t *plan, modbus_request_t *t)
+{
+    _plan_block_t *b = &plan->blocks[plan->tag_block[t - plan->tags]];
+    int max = max_read(b->function);
+    int pos = t->addr - b->addr;
+    int j;
+
+    for (j = pos / max; j <= (pos + t->nb - 1) / max; j++) {
+        modbus_request_t *r = &plan->reqs[b->first_req + j];
+
+        if (r->rc == -1) {
+            t->rc = -1;
+            t->errnum = r->errnum;
+            return -1;
+        }
+    }
+
+    if (is_bits_function(b->function)) {
+        memcpy(t->data, plan->tab_bits + b->offset + pos,
+               t->nb * sizeof(uint8_t));
+    } else {
+        memcpy(t->data, plan->tab_registers + b->offset + pos,
+               t->nb * sizeof(uint16_t));
+    }
+    t->rc = t->nb;
+    t->errnum = 0;
+
+    return 0;
+}
+
+int modbus_plan_execute(modbus_t *ctx, modbus_plan_t *plan, int max_in_flight)
+{
+    int rc;
+    int saved_errno = 0;
+    int nb_ok = 0;
+    int i;
+
+    if (ctx == NULL || plan == NULL || max_in_flight < 1) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    /* The requests not sent when the pipeline fails keep this status */
+    for (i = 0; i < plan->nb_reqs; i++) {
+        plan->reqs[i].rc = -1;
+        plan->reqs[i].errnum = 0;
+    }
+
+    rc = modbus_pipeline(ctx, plan->reqs, plan->nb_reqs, max_in_flight);
+    if (rc == -1) {
+        saved_errno = errno;
+        for (i = 0; i < plan->nb_reqs; i++) {
+            if (plan->reqs[i].rc == -1 && plan->reqs[i].errnum == 0)
+                plan->reqs[i].errnum = saved_errno;
+        }
+    }
+
+    for (i = 0; i < plan->nb_tags; i++) {
+        if (scatter_tag(plan, &plan->tags[i]) == 0)
+            nb_ok++;
+    }
+
+    if (rc == -1) {
+        errno = saved_errno;
+        return -1;
+    }
+
+    return nb_ok;
+}
+
+void modbus_plan_free(modbus_plan_t *plan)
+{
+    if (plan == NULL)
+        return;
+
+    free(plan->tag_block);
+    free(plan->blocks);
+    free(plan->reqs);
+    free(plan->tab_bits);
+    free(plan->tab_registers);
+    free(plan);
+}
@@ -0,0 +1,39 @@
+/*
+ * Copyright © 2001-2011 Stéphane Raimbault <stephane.raimbault@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef _MODBUS_PLAN_H_
+#define _MODBUS_PLAN_H_
+
+#include "modbus.h"
+
+MODBUS_BEGIN_DECLS
+
+/* Read plan: the scattered tags read on each poll cycle are merged into the
+   fewest read requests, the values are copied back to the tags */
+typedef struct _modbus_plan modbus_plan_t;
+
+MODBUS_API modbus_plan_t* modbus_plan_new(modbus_request_t *tags, int nb_tags,
+                                          int max_gap);
+MODBUS_API int modbus_plan_get_nb_requests(modbus_plan_t *plan);
+MODBUS_API int modbus_plan_execute(modbus_t *ctx, modbus_plan_t *plan,
+                                   int max_in_flight);
+MODBUS_API void modbus_plan_free(modbus_plan_t *plan);
+
+MODBUS_END_DECLS
+
+#endif /* _MODBUS_PLAN_H_ */
@@ -0,0 +1,476 @@
+/*
+ * Copyright © 2001-2011 Stéphane Raimbault <stephane.raimbault@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <config.h>
+
+#if defined(_WIN32)
+# include <winsock2.h>
+#else
+# include <sys/socket.h>
+#endif
+
+#include "modbus-private.h"
+#include "modbus-tcp-private.h"
+#include "modbus-pool.h"
+
+#if HAVE_PTHREAD_H
+# define _MODBUS_POOL_THREADS
+# include <pthread.h>
+#endif
+
+/* Default delays between the connection attempts to an endpoint after a
+   failure, doubled on each failure */
+#define _POOL_MIN_DELAY_MS      100
+#define _POOL_MAX_DELAY_MS    30000
+
+typedef struct _modbus_pool_endpoint {
+    modbus_pool_t *pool;
+    char host[_MODBUS_TCP_PI_NODE_LENGTH];
+    char service[_MODBUS_TCP_PI_SERVICE_LENGTH];
+    /* Number of contexts created, in use or not */
+    int nb_ctxs;
+    /* Contexts not in use, the disconnected ones first */
+    int nb_idle;
+    modbus_t **idle;
+    /* Connection failures in a row and time of the next attempt allowed */
+    int nb_failures;
+    int64_t next_connect;
+#ifdef _MODBUS_POOL_THREADS
+    /* Signaled when a context is released */
+    pthread_cond_t released;
+#endif
+} _pool_endpoint_t;
+
+typedef struct {
+    int id;
+    int slave;
+    _pool_endpoint_t *endpoint;
+} _pool_route_t;
+
+struct _modbus_pool {
+    /* Max number of connections by endpoint */
+    int nb_connections;
+    int min_delay_ms;
+    int max_delay_ms;
+    int nb_endpoints;
+    _pool_endpoint_t **endpoints;
+    /* Sorted by identifier */
+    int nb_routes;
+    int max_routes;
+    _pool_route_t *routes;
+#ifdef _MODBUS_POOL_THREADS
+    pthread_mutex_t mutex;
+#endif
+};
+
+#ifdef _MODBUS_POOL_THREADS
+# define POOL_LOCK(pool) pthread_mutex_lock(&(pool)->mutex)
+# define POOL_UNLOCK(pool) pthread_mutex_unlock(&(pool)->mutex)
+#else
+# define POOL_LOCK(pool)
+# define POOL_UNLOCK(pool)
+#endif
+
+/* Has to be called with the lock held */
+static _pool_route_t *pool_find_route(modbus_pool_t *pool, int id)
+{
+    int low = 0;
+    int high = pool->nb_routes - 1;
+
+    while (low <= high) {
+        int mid = (low + high) / 2;
+
+        if (pool->routes[mid].id == id)
+            return &pool->routes[mid];
+        if (pool->routes[mid].id < id)
+            low = mid + 1;
+        else
+            high = mid - 1;
+    }
+
+    return NULL;
+}
+
+static _pool_endpoint_t *pool_get_endpoint(modbus_pool_t *pool,
+                                           const char *host,
+                                           const char *service)
+{
+    _pool_endpoint_t **endpoints;
+    _pool_endpoint_t *endpoint;
+    int i;
+
+    for (i = 0; i < pool->nb_endpoints; i++) {
+        endpoint = pool->endpoints[i];
+        if (strcmp(endpoint->host, host) == 0 &&
+            strcmp(endpoint->service, service) == 0) {
+            return endpoint;
+        }
+    }
+
+    endpoints = realloc(pool->endpoints,
+                        (pool->nb_endpoints + 1) * sizeof(_pool_endpoint_t *));
+    if (endpoints == NULL) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    pool->endpoints = endpoints;
+
+    endpoint = malloc(sizeof(_pool_endpoint_t));
+    if (endpoint == NULL) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    endpoint->idle = malloc(pool->nb_connections * sizeof(modbus_t *));
+    if (endpoint->idle == NULL) {
+        free(endpoint);
+        errno = ENOMEM;
+        return NULL;
+    }
+    endpoint->pool = pool;
+    strlcpy(endpoint->host, host, sizeof(endpoint->host));
+    strlcpy(endpoint->service, service, sizeof(endpoint->service));
+    endpoint->nb_ctxs = 0;
+    endpoint->nb_idle = 0;
+    endpoint->nb_failures = 0;
+    endpoint->next_connect = 0;
+#ifdef _MODBUS_POOL_THREADS
+    pthread_cond_init(&endpoint->released, NULL);
+#endif
+    pool->endpoints[pool->nb_endpoints++] = endpoint;
+
+    return endpoint;
+}
+
+/* Puts back a context not in use, has to be called with the lock held */
+static void pool_put_idle(_pool_endpoint_t *endpoint, modbus_t *ctx)
+{
+    if (ctx->s == -1) {
+        /* The connected contexts are handed out first */
+        memmove(endpoint->idle + 1, endpoint->idle,
+                endpoint->nb_idle * sizeof(modbus_t *));
+        endpoint->idle[0] = ctx;
+    } else {
+        endpoint->idle[endpoint->nb_idle] = ctx;
+    }
+    endpoint->nb_idle++;
+#ifdef _MODBUS_POOL_THREADS
+    pthread_cond_signal(&endpoint->released);
+#endif
+}
+
+/* Closes the connection when the server has closed it or when unexpected
+   bytes have been received while the context wasn't in use */
+static void pool_check_connection(modbus_t *ctx)
+{
+    struct timeval tv;
+    char c;
+
+    tv.tv_sec = 0;
+    tv.tv_usec = 0;
+    if (_modbus_wait(ctx->s, _MODBUS_WAIT_READ, &tv, NULL, -1) == 0)
+        return;
+
+    if (recv(ctx->s, &c, 1, MSG_PEEK) > 0) {
+        modbus_flush(ctx);
+    } else {
+        modbus_close(ctx);
+    }
+}
+
+modbus_pool_t* modbus_pool_new(int nb_connections)
+{
+    modbus_pool_t *pool;
+
+    if (nb_connections < 1) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    pool = malloc(sizeof(modbus_pool_t));
+    if (pool == NULL) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    pool->nb_connections = nb_connections;
+    pool->min_delay_ms = _POOL_MIN_DELAY_MS;
+    pool->max_delay_ms = _POOL_MAX_DELAY_MS;
+    pool->nb_endpoints = 0;
+    pool->endpoints = NULL;
+    pool->nb_routes = 0;
+    pool->max_routes = 0;
+    pool->routes = NULL;
+#ifdef _MODBUS_POOL_THREADS
+    pthread_mutex_init(&pool->mutex, NULL);
+#endif
+
+    return pool;
+}
+
+/* Defines or replaces the route of the device id to the unit identifier
+   slave of the server (or gateway) host:port */
+int modbus_pool_add_route(modbus_pool_t *pool, int id, const char *host,
+                          int port, int slave)
+{
+    _pool_endpoint_t *endpoint;
+    _pool_route_t *route;
+    char service[_MODBUS_TCP_PI_SERVICE_LENGTH];
+    int i;
+
+    if (pool == NULL || host == NULL ||
+        strlen(host) >= _MODBUS_TCP_PI_NODE_LENGTH ||
+        port < 0 || port > 65535 || slave < 0 || slave > 255) {
+        errno = EINVAL;
+        return -1;
+    }
+    snprintf(service, sizeof(service), "%d", port);
+
+    POOL_LOCK(pool);
+    endpoint = pool_get_endpoint(pool, host, service);
+    if (endpoint == NULL) {
+        POOL_UNLOCK(pool);
+        return -1;
+    }
+
+    route = pool_find_route(pool, id);
+    if (route == NULL) {
+        if (pool->nb_routes == pool->max_routes) {
+            int max_routes = pool->max_routes ? pool->max_routes * 2 : 16;
+            _pool_route_t *routes;
+
+            routes = realloc(pool->routes, max_routes * sizeof(_pool_route_t));
+            if (routes == NULL) {
+                POOL_UNLOCK(pool);
+                errno = ENOMEM;
+                return -1;
+            }
+            pool->routes = routes;
+            pool->max_routes = max_routes;
+        }
+
+        /* Insertion in order */
+        for (i = pool->nb_routes; i > 0 && pool->routes[i - 1].id > id; i--)
+            pool->routes[i] = pool->routes[i - 1];
+        route = &pool->routes[i];
+        route->id = id;
+        pool->nb_routes++;
+    }
+    route->slave = slave;
+    route->endpoint = endpoint;
+    POOL_UNLOCK(pool);
+
+    return 0;
+}
+
+int modbus_pool_set_backoff(modbus_pool_t *pool,
+                            const struct timeval *min_delay,
+                            const struct timeval *max_delay)
+{
+    int64_t min_ms;
+    int64_t max_ms;
+
+    if (pool == NULL || min_delay == NULL || max_delay == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    min_ms = (int64_t)min_delay->tv_sec * 1000 + min_delay->tv_usec / 1000;
+    max_ms = (int64_t)max_delay->tv_sec * 1000 + max_delay->tv_usec / 1000;
+    if (min_ms < 0 || max_ms < min_ms || max_ms > INT32_MAX) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    POOL_LOCK(pool);
+    pool->min_delay_ms = (int)min_ms;
+    pool->max_delay_ms = (int)max_ms;
+    POOL_UNLOCK(pool);
+
+    return 0;
+}
+
+/* Hands out a connected context to reach the device id, the unit identifier
+   of the route is set as slave. The context must be given back with
+   modbus_pool_release(). With threads, waits for a context to be released
+   when all the connections of the endpoint are in use. */
+modbus_t* modbus_pool_get(modbus_pool_t *pool, int id)
+{
+    _pool_endpoint_t *endpoint;
+    _pool_route_t *route;
+    modbus_t *ctx = NULL;
+    int slave;
+    int rc;
+
+    if (pool == NULL) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    POOL_LOCK(pool);
+    route = pool_find_route(pool, id);
+    if (route == NULL) {
+        POOL_UNLOCK(pool);
+        errno = EINVAL;
+        return NULL;
+    }
+    endpoint = route->endpoint;
+    slave = route->slave;
+
+    for (;;) {
+        if (endpoint->nb_idle > 0) {
+            ctx = endpoint->idle[--endpoint->nb_idle];
+            break;
+        }
+        if (endpoint->nb_ctxs < pool->nb_connections) {
+            /* New context reserved */
+            endpoint->nb_ctxs++;
+            break;
+        }
+#ifdef _MODBUS_POOL_THREADS
+        pthread_cond_wait(&endpoint->released, &pool->mutex);
+#else
+        POOL_UNLOCK(pool);
+        errno = EBUSY;
+        return NULL;
+#endif
+    }
+    POOL_UNLOCK(pool);
+
+    if (ctx != NULL && ctx->s != -1) {
+        pool_check_connection(ctx);
+        if (ctx->s != -1) {
+            modbus_set_slave(ctx, slave);
+            return ctx;
+        }
+    }
+
+    POOL_LOCK(pool);
+    if (_modbus_time_ms() < endpoint->next_connect) {
+        /* Too early to retry after a failure */
+        if (ctx != NULL) {
+            pool_put_idle(endpoint, ctx);
+        } else {
+            endpoint->nb_ctxs--;
+#ifdef _MODBUS_POOL_THREADS
+            pthread_cond_signal(&endpoint->released);
+#endif
+        }
+        POOL_UNLOCK(pool);
+        errno = EAGAIN;
+        return NULL;
+    }
+    POOL_UNLOCK(pool);
+
+    if (ctx == NULL) {
+        ctx = modbus_new_tcp_pi(endpoint->host, endpoint->service);
+        if (ctx == NULL) {
+            int saved_errno = errno;
+
+            POOL_LOCK(pool);
+            endpoint->nb_ctxs--;
+#ifdef _MODBUS_POOL_THREADS
+            pthread_cond_signal(&endpoint->released);
+#endif
+            POOL_UNLOCK(pool);
+            errno = saved_errno;
+            return NULL;
+        }
+        ctx->pool_endpoint = endpoint;
+    }
+
+    rc = modbus_connect(ctx);
+
+    POOL_LOCK(pool);
+    if (rc == -1) {
+        int saved_errno = errno;
+        int64_t delay = pool->min_delay_ms;
+        int i;
+
+        for (i = 0; i < endpoint->nb_failures && delay < pool->max_delay_ms; i++)
+            delay *= 2;
+        if (delay > pool->max_delay_ms)
+            delay = pool->max_delay_ms;
+        endpoint->nb_failures++;
+        endpoint->next_connect = _modbus_time_ms() + delay;
+
+        /* The context is kept to reconnect later */
+        pool_put_idle(endpoint, ctx);
+        POOL_UNLOCK(pool);
+        errno = saved_errno;
+        return NULL;
+    }
+    endpoint->nb_failures = 0;
+    endpoint->next_connect = 0;
+    POOL_UNLOCK(pool);
+
+    modbus_set_slave(ctx, slave);
+
+    return ctx;
+}
+
+/* Gives back a context handed out by modbus_pool_get(), the connection is
+   kept open for the next requests unless the context has been closed */
+int modbus_pool_release(modbus_pool_t *pool, modbus_t *ctx)
+{
+    if (pool == NULL || ctx == NULL || ctx->pool_endpoint == NULL ||
+        ctx->pool_endpoint->pool != pool) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    POOL_LOCK(pool);
+    pool_put_idle(ctx->pool_endpoint, ctx);
+    POOL_UNLOCK(pool);
+
+    return 0;
+}
+
+/* The contexts handed out must be released before */
+void modbus_pool_free(modbus_pool_t *pool)
+{
+    int i;
+
+    if (pool == NULL)
+        return;
+
+    for (i = 0; i < pool->nb_endpoints; i++) {
+        _pool_endpoint_t *endpoint = pool->endpoints[i];
+        int j;
+
+        for (j = 0; j < endpoint->nb_idle; j++) {
+            modbus_close(endpoint->idle[j]);
+            modbus_free(endpoint->idle[j]);
+        }
+#ifdef _MODBUS_POOL_THREADS
+        pthread_cond_destroy(&endpoint->released);
+#endif
+        free(endpoint->idle);
+        free(endpoint);
+    }
+#ifdef _MODBUS_POOL_THREADS
+    pthread_mutex_destroy(&pool->mutex);
+#endif
+    free(pool->endpoints);
+    free(pool->routes);
+    free(pool);
+}
@@ -0,0 +1,43 @@
+/*
+ * Copyright © 2001-2011 Stéphane Raimbault <stephane.raimbault@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef _MODBUS_POOL_H_
+#define _MODBUS_POOL_H_
+
+#include "modbus.h"
+
+MODBUS_BEGIN_DECLS
+
+/* Persistent Modbus/TCP connections shared by the threads of a client, the
+   devices are reached through a routing table of identifiers to (host, port,
+   unit identifier) */
+typedef struct _modbus_pool modbus_pool_t;
+
+MODBUS_API modbus_pool_t* modbus_pool_new(int nb_connections);
+MODBUS_API int modbus_pool_add_route(modbus_pool_t *pool, int id,
+                                     const char *host, int port, int slave);
+MODBUS_API int modbus_pool_set_backoff(modbus_pool_t *pool,
+                                       const struct timeval *min_delay,
+                                       const struct timeval *max_delay);
+MODBUS_API modbus_t* modbus_pool_get(modbus_pool_t *pool, int id);
+MODBUS_API int modbus_pool_release(modbus_pool_t *pool, modbus_t *ctx);
+MODBUS_API void modbus_pool_free(modbus_pool_t *pool);
+
+MODBUS_END_DECLS
+
+#endif /* _MODBUS_POOL_H_ */
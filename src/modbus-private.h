@@ -45,12 +45,19 @@ MODBUS_BEGIN_DECLS
 
 #define _REPORT_SLAVE_ID 180
 
+/* Max between RTU and TCP max adu length (so TCP) */
+#define MAX_MESSAGE_LENGTH 260
+
 #define _MODBUS_EXCEPTION_RSP_LENGTH 5
 
 /* Timeouts in microsecond (0.5 s) */
 #define _RESPONSE_TIMEOUT    500000
 #define _BYTE_TIMEOUT        500000
 
+/* Events waited by _modbus_wait() */
+#define _MODBUS_WAIT_READ     1
+#define _MODBUS_WAIT_WRITE    2
+
 /* Function codes */
 #define _FC_READ_COILS                0x01
 #define _FC_READ_DISCRETE_INPUTS      0x02
@@ -115,9 +122,11 @@ typedef struct _modbus_backend {
     int (*pre_check_confirmation) (modbus_t *ctx, const uint8_t *req,
                                    const uint8_t *rsp, int rsp_length);
     int (*connect) (modbus_t *ctx);
+    int (*connect_async) (modbus_t *ctx);
     void (*close) (modbus_t *ctx);
+    void (*set_socket) (modbus_t *ctx, int s);
     int (*flush) (modbus_t *ctx);
-    int (*select) (modbus_t *ctx, fd_set *rset, struct timeval *tv, int msg_length, int* pIsActive);
+    int (*wait) (modbus_t *ctx, struct timeval *tv, int msg_length, int* pIsActive);
     void (*free) (modbus_t *ctx);
 } modbus_backend_t;
 
@@ -134,13 +143,57 @@ struct _modbus {
     void *backend_data;
     void (*traceCallback)(uint8_t*, int, int, void*);
     void* traceState;
+    /* Requests submitted with modbus_submit_request() (NULL if none) */
+    struct _modbus_async *async;
+    /* Handle interrupting the waits, set by modbus_set_cancel() */
+    modbus_cancel_t *cancel;
+    /* Endpoint of the pool owning the context (NULL if none) */
+    struct _modbus_pool_endpoint *pool_endpoint;
+    /* Reconnection policy (if has_reconnect_policy) and connection attempts:
+       failures in a row, time of the next attempt allowed and connection
+       started by modbus_connect_async() */
+    int has_reconnect_policy;
+    modbus_reconnect_policy_t reconnect_policy;
+    int nb_connect_failures;
+    int64_t next_connect;
+    int connecting;
+    unsigned int jitter_seed;
+    /* The backend only reads the bytes already received, set by
+       modbus_process_events() */
+    int recv_nowait;
+};
+
+struct _modbus_cancel {
+    /* Readable once signaled until reset, both ends are the same eventfd
+       descriptor when available (self-pipe otherwise) */
+    int fd_read;
+    int fd_write;
 };
 
 void _modbus_init_common(modbus_t *ctx);
+void _modbus_async_free(modbus_t *ctx);
 void _error_print(modbus_t *ctx, const char *context);
 int _modbus_receive_msg(modbus_t *ctx, uint8_t *msg, msg_type_t msg_type, int* pIsActive);
 
+const void *_modbus_mapping_snapshot(modbus_mapping_t *mb_mapping, int table,
+                                     int addr, int nb, void *dest);
+void _modbus_mapping_write_begin(modbus_mapping_t *mb_mapping, int table,
+                                 int addr, int nb);
+void _modbus_mapping_write_end(modbus_mapping_t *mb_mapping, int table,
+                               int addr, int nb);
+int _modbus_mapping_get_bits(modbus_mapping_t *mb_mapping, int table,
+                             int addr, int nb, uint8_t *dest);
+void _modbus_mapping_set_bits(modbus_mapping_t *mb_mapping, int table,
+                              int addr, int nb, const uint8_t *src);
+int _modbus_mapping_is_concurrent(const modbus_mapping_t *mb_mapping);
+void _modbus_mapping_free_ext(modbus_mapping_t *mb_mapping);
+
 void _sleep_response_timeout(modbus_t *ctx);
+int64_t _modbus_time_ms(void);
+int64_t _modbus_time_us(void);
+int _modbus_wait(int s, int events, const struct timeval *tv, int *pIsActive,
+                 int cancel_fd);
+int _modbus_cancel_fd(modbus_t *ctx);
 uint8_t compute_meta_length_after_function(int function, msg_type_t msg_type);
 int compute_data_length_after_meta(modbus_t *ctx, uint8_t *msg, msg_type_t msg_type);
 #ifndef HAVE_STRLCPY
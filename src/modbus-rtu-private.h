@@ -37,9 +37,9 @@
 
 #define _MODBUS_RTU_CHECKSUM_LENGTH    2
 
-/* Time waited beetween the RTS switch before transmit data or after transmit
-   data before to read */
-#define _MODBUS_RTU_TIME_BETWEEN_RTS_SWITCH 10000
+/* The RS485 delays of the kernel are in ms, the RTS delay (us) is rounded to
+   the nearest ms */
+#define _MODBUS_RTU_RTS_DELAY_MS(us)   (((us) + 500) / 1000)
 
 #if defined(_WIN32)
 #if !defined(ENOTSUP)
@@ -58,6 +58,27 @@ struct win32_ser {
 };
 #endif /* _WIN32 */
 
+/* Highest address of a slave on a serial line */
+#define _MODBUS_RTU_MAX_SLAVE       247
+
+/* Samples kept by slave to compute the percentiles, the timing of a slave
+   is tuned every _MODBUS_RTU_TUNING_PERIOD responses */
+#define _MODBUS_RTU_STATS_WINDOW    64
+#define _MODBUS_RTU_TUNING_PERIOD   16
+
+/* Measures and timing of a slave in adaptive mode (microseconds) */
+typedef struct {
+    uint32_t nb_responses;
+    uint32_t nb_timeouts;
+    uint32_t nb_bad_frames;
+    uint32_t latency[_MODBUS_RTU_STATS_WINDOW];
+    uint32_t gap[_MODBUS_RTU_STATS_WINDOW];
+    uint32_t latency_max;
+    uint32_t gap_max;
+    uint32_t frame_gap;
+    uint32_t response_timeout;
+} _rtu_slave_stats_t;
+
 typedef struct _modbus_rtu {
     /* Device: "/dev/ttyS0", "/dev/ttyUSB0" or "/dev/tty.USA19*" on Mac OS X. */
     char *device;
@@ -78,15 +99,46 @@ typedef struct _modbus_rtu {
 #endif
 #if HAVE_DECL_TIOCSRS485
     int serial_mode;
+    /* SER_RS485_* flags given to the kernel in RS485 mode */
+    int rs485_flags;
 #endif
 #if HAVE_DECL_TIOCM_RTS
     int rts;
+    /* Delay (us) between the RTS switch and the first or last bit sent */
+    int rts_delay;
     int onebyte_time;
 #endif
     /* To handle many slaves on the same link */
     int confirmation_to_ignore;
-    
+    /* MODBUS_RTU_RECV_BYTE or MODBUS_RTU_RECV_BULK */
+    int recv_mode;
+    /* MODBUS_RTU_STALE_* policy of the data received before a request */
+    int stale_mode;
+    /* The last message received was complete with a valid CRC */
+    int clean;
+    /* Stale bytes discarded since the creation of the context */
+    uint64_t stale_bytes;
+
     unsigned long frameTiming;
+
+    /* Adaptive timing, the statistics are allocated on the first request
+       to each slave */
+    int adaptive;
+    uint32_t min_frame_gap;
+    uint32_t max_frame_gap;
+    uint32_t min_response_timeout;
+    uint32_t max_response_timeout;
+    _rtu_slave_stats_t *slave_stats[_MODBUS_RTU_MAX_SLAVE + 1];
+    /* Measures of the request in progress (NULL if none) */
+    _rtu_slave_stats_t *current;
+    int current_slave;
+    /* Slave of the last request sent, measured from the wait of its
+       confirmation (-1 if none) */
+    int sent_slave;
+    int64_t sent_us;
+    int64_t first_byte_us;
+    int64_t last_read_us;
+    uint32_t frame_gap_max;
 } modbus_rtu_t;
 
 #endif /* _MODBUS_RTU_PRIVATE_H_ */
@@ -31,7 +31,7 @@
 #include "modbus-rtu.h"
 #include "modbus-rtu-private.h"
 
-#if HAVE_DECL_TIOCSRS485 || HAVE_DECL_TIOCM_RTS
+#if !defined(_WIN32)
 #include <sys/ioctl.h>
 #endif
 
@@ -39,65 +39,9 @@
 #include <linux/serial.h>
 #endif
 
-/* Table of CRC values for high-order byte */
-static const uint8_t table_crc_hi[] = {
-    0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x01, 0xC0,
-    0x80, 0x41, 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41,
-    0x00, 0xC1, 0x81, 0x40, 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0,
-    0x80, 0x41, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81, 0x40,
-    0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1,
-    0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x01, 0xC0, 0x80, 0x41,
-    0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1,
-    0x81, 0x40, 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41,
-    0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x01, 0xC0,
-    0x80, 0x41, 0x00, 0xC1, 0x81, 0x40, 0x00, 0xC1, 0x81, 0x40,
-    0x01, 0xC0, 0x80, 0x41, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1,
-    0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81, 0x40,
-    0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x01, 0xC0,
-    0x80, 0x41, 0x00, 0xC1, 0x81, 0x40, 0x00, 0xC1, 0x81, 0x40,
-    0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0,
-    0x80, 0x41, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81, 0x40,
-    0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x01, 0xC0,
-    0x80, 0x41, 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41,
-    0x00, 0xC1, 0x81, 0x40, 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0,
-    0x80, 0x41, 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41,
-    0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0,
-    0x80, 0x41, 0x00, 0xC1, 0x81, 0x40, 0x00, 0xC1, 0x81, 0x40,
-    0x01, 0xC0, 0x80, 0x41, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1,
-    0x81, 0x40, 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41,
-    0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x01, 0xC0,
-    0x80, 0x41, 0x00, 0xC1, 0x81, 0x40
-};
-
-/* Table of CRC values for low-order byte */
-static const uint8_t table_crc_lo[] = {
-    0x00, 0xC0, 0xC1, 0x01, 0xC3, 0x03, 0x02, 0xC2, 0xC6, 0x06,
-    0x07, 0xC7, 0x05, 0xC5, 0xC4, 0x04, 0xCC, 0x0C, 0x0D, 0xCD,
-    0x0F, 0xCF, 0xCE, 0x0E, 0x0A, 0xCA, 0xCB, 0x0B, 0xC9, 0x09,
-    0x08, 0xC8, 0xD8, 0x18, 0x19, 0xD9, 0x1B, 0xDB, 0xDA, 0x1A,
-    0x1E, 0xDE, 0xDF, 0x1F, 0xDD, 0x1D, 0x1C, 0xDC, 0x14, 0xD4,
-    0xD5, 0x15, 0xD7, 0x17, 0x16, 0xD6, 0xD2, 0x12, 0x13, 0xD3,
-    0x11, 0xD1, 0xD0, 0x10, 0xF0, 0x30, 0x31, 0xF1, 0x33, 0xF3,
-    0xF2, 0x32, 0x36, 0xF6, 0xF7, 0x37, 0xF5, 0x35, 0x34, 0xF4,
-    0x3C, 0xFC, 0xFD, 0x3D, 0xFF, 0x3F, 0x3E, 0xFE, 0xFA, 0x3A,
-    0x3B, 0xFB, 0x39, 0xF9, 0xF8, 0x38, 0x28, 0xE8, 0xE9, 0x29,
-    0xEB, 0x2B, 0x2A, 0xEA, 0xEE, 0x2E, 0x2F, 0xEF, 0x2D, 0xED,
-    0xEC, 0x2C, 0xE4, 0x24, 0x25, 0xE5, 0x27, 0xE7, 0xE6, 0x26,
-    0x22, 0xE2, 0xE3, 0x23, 0xE1, 0x21, 0x20, 0xE0, 0xA0, 0x60,
-    0x61, 0xA1, 0x63, 0xA3, 0xA2, 0x62, 0x66, 0xA6, 0xA7, 0x67,
-    0xA5, 0x65, 0x64, 0xA4, 0x6C, 0xAC, 0xAD, 0x6D, 0xAF, 0x6F,
-    0x6E, 0xAE, 0xAA, 0x6A, 0x6B, 0xAB, 0x69, 0xA9, 0xA8, 0x68,
-    0x78, 0xB8, 0xB9, 0x79, 0xBB, 0x7B, 0x7A, 0xBA, 0xBE, 0x7E,
-    0x7F, 0xBF, 0x7D, 0xBD, 0xBC, 0x7C, 0xB4, 0x74, 0x75, 0xB5,
-    0x77, 0xB7, 0xB6, 0x76, 0x72, 0xB2, 0xB3, 0x73, 0xB1, 0x71,
-    0x70, 0xB0, 0x50, 0x90, 0x91, 0x51, 0x93, 0x53, 0x52, 0x92,
-    0x96, 0x56, 0x57, 0x97, 0x55, 0x95, 0x94, 0x54, 0x9C, 0x5C,
-    0x5D, 0x9D, 0x5F, 0x9F, 0x9E, 0x5E, 0x5A, 0x9A, 0x9B, 0x5B,
-    0x99, 0x59, 0x58, 0x98, 0x88, 0x48, 0x49, 0x89, 0x4B, 0x8B,
-    0x8A, 0x4A, 0x4E, 0x8E, 0x8F, 0x4F, 0x8D, 0x4D, 0x4C, 0x8C,
-    0x44, 0x84, 0x85, 0x45, 0x87, 0x47, 0x46, 0x86, 0x82, 0x42,
-    0x43, 0x83, 0x41, 0x81, 0x80, 0x40
-};
+#if HAVE_CLOCK_NANOSLEEP
+#include <time.h>
+#endif
 
 /* Define the slave ID of the remote device to talk in master mode or set the
  * internal slave ID in slave mode */
@@ -141,22 +85,6 @@ static int _modbus_rtu_build_response_basis(sft_t *sft, uint8_t *rsp)
     return _MODBUS_RTU_PRESET_RSP_LENGTH;
 }
 
-static uint16_t crc16(uint8_t *buffer, uint16_t buffer_length)
-{
-    uint8_t crc_hi = 0xFF; /* high CRC byte initialized */
-    uint8_t crc_lo = 0xFF; /* low CRC byte initialized */
-    unsigned int i; /* will index into CRC lookup */
-
-    /* pass through message buffer */
-    while (buffer_length--) {
-        i = crc_hi ^ *buffer++; /* calculate the CRC  */
-        crc_hi = crc_lo ^ table_crc_hi[i];
-        crc_lo = table_crc_lo[i];
-    }
-
-    return (crc_hi << 8 | crc_lo);
-}
-
 static int _modbus_rtu_prepare_response_tid(const uint8_t *req, int *req_length)
 {
     (*req_length) -= _MODBUS_RTU_CHECKSUM_LENGTH;
@@ -166,7 +94,7 @@ static int _modbus_rtu_prepare_response_tid(const uint8_t *req, int *req_length)
 
 static int _modbus_rtu_send_msg_pre(uint8_t *req, int req_length)
 {
-    uint16_t crc = crc16(req, req_length);
+    uint16_t crc = modbus_crc16(req, req_length);
     req[req_length++] = crc >> 8;
     req[req_length++] = crc & 0x00FF;
 
@@ -273,9 +201,263 @@ static void _modbus_rtu_ioctl_rts(int fd, int on)
     }
     ioctl(fd, TIOCMSET, &flags);
 }
+
+/* Sleeps us microseconds, with the precision of the monotonic clock when
+   available as the delays around the RTS switch are often under 1 ms */
+static void _modbus_rtu_sleep_us(int us)
+{
+#if HAVE_CLOCK_NANOSLEEP
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    ts.tv_sec += us / 1000000;
+    ts.tv_nsec += (long)(us % 1000000) * 1000;
+    if (ts.tv_nsec >= 1000000000) {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000;
+    }
+    /* Absolute time so the signals don't extend the delay */
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR);
+#else
+    usleep(us);
+#endif
+}
 #endif
 
-static ssize_t _modbus_rtu_send(modbus_t *ctx, const uint8_t *req, int req_length)
+#if HAVE_DECL_TIOCSRS485
+/* Enables the RS485 mode of the driver, which switches RTS itself around the
+   transmission with the polarity and the delays of the context */
+static int _modbus_rtu_ioctl_rs485(modbus_t *ctx)
+{
+    modbus_rtu_t *ctx_rtu = ctx->backend_data;
+    struct serial_rs485 rs485conf;
+
+    memset(&rs485conf, 0x0, sizeof(struct serial_rs485));
+    rs485conf.flags = ctx_rtu->rs485_flags;
+#if HAVE_DECL_TIOCM_RTS
+    /* Level of RTS while sending, the flags of modbus_rtu_set_serial_mode()
+       are kept without RTS mode */
+    if (ctx_rtu->rts == MODBUS_RTU_RTS_UP) {
+        rs485conf.flags |= SER_RS485_RTS_ON_SEND;
+        rs485conf.flags &= ~SER_RS485_RTS_AFTER_SEND;
+    } else if (ctx_rtu->rts == MODBUS_RTU_RTS_DOWN) {
+        rs485conf.flags &= ~SER_RS485_RTS_ON_SEND;
+        rs485conf.flags |= SER_RS485_RTS_AFTER_SEND;
+    }
+    rs485conf.delay_rts_before_send = _MODBUS_RTU_RTS_DELAY_MS(ctx_rtu->rts_delay);
+    rs485conf.delay_rts_after_send = _MODBUS_RTU_RTS_DELAY_MS(ctx_rtu->rts_delay);
+#endif
+
+    return ioctl(ctx->s, TIOCSRS485, &rs485conf);
+}
+#endif
+
+static int64_t timeval_to_us(const struct timeval *tv)
+{
+    return (int64_t)tv->tv_sec * 1000000 + tv->tv_usec;
+}
+
+/* The timing is measured on 32 bits (more than one hour) */
+static uint32_t timeval_to_timing(const struct timeval *tv)
+{
+    int64_t us = timeval_to_us(tv);
+
+    return us > UINT32_MAX ? UINT32_MAX : (uint32_t)us;
+}
+
+static void us_to_timeval(uint32_t us, struct timeval *tv)
+{
+    tv->tv_sec = us / 1000000;
+    tv->tv_usec = us % 1000000;
+}
+
+static uint32_t clamp_us(uint32_t us, uint32_t min, uint32_t max)
+{
+    if (us < min)
+        return min;
+    if (us > max)
+        return max;
+    return us;
+}
+
+static int compare_us(const void *a, const void *b)
+{
+    uint32_t ua = *(const uint32_t *) a;
+    uint32_t ub = *(const uint32_t *) b;
+
+    return (ua > ub) - (ua < ub);
+}
+
+/* Sorts the samples of the window of nb_responses responses into sorted and
+   returns their number */
+static int sort_samples(const uint32_t *samples, uint32_t nb_responses,
+                        uint32_t *sorted)
+{
+    int n = nb_responses < _MODBUS_RTU_STATS_WINDOW ?
+        (int) nb_responses : _MODBUS_RTU_STATS_WINDOW;
+
+    memcpy(sorted, samples, n * sizeof(uint32_t));
+    qsort(sorted, n, sizeof(uint32_t), compare_us);
+
+    return n;
+}
+
+static uint32_t percentile(const uint32_t *sorted, int n, int p)
+{
+    return sorted[(n - 1) * p / 100];
+}
+
+/* Tunes the timing of a slave from its last responses: the frame ends after
+   a silence 1.5 times longer than the longest one measured inside the frames
+   (t3.5 at least) and the response timeout is twice the 99th percentile of
+   the latency plus the frame end */
+static void rtu_tune(modbus_rtu_t *ctx_rtu, _rtu_slave_stats_t *st)
+{
+    uint32_t sorted[_MODBUS_RTU_STATS_WINDOW];
+    uint32_t gap;
+    int n;
+
+    n = sort_samples(st->gap, st->nb_responses, sorted);
+    gap = sorted[n - 1] + sorted[n - 1] / 2;
+    if (gap < ctx_rtu->frameTiming)
+        gap = ctx_rtu->frameTiming;
+    st->frame_gap = clamp_us(gap, ctx_rtu->min_frame_gap,
+                             ctx_rtu->max_frame_gap);
+
+    n = sort_samples(st->latency, st->nb_responses, sorted);
+    st->response_timeout = clamp_us(2 * percentile(sorted, n, 99) + st->frame_gap,
+                                    ctx_rtu->min_response_timeout,
+                                    ctx_rtu->max_response_timeout);
+}
+
+static void rtu_free_stats(modbus_rtu_t *ctx_rtu)
+{
+    int i;
+
+    for (i = 0; i <= _MODBUS_RTU_MAX_SLAVE; i++) {
+        free(ctx_rtu->slave_stats[i]);
+        ctx_rtu->slave_stats[i] = NULL;
+    }
+    ctx_rtu->current = NULL;
+}
+
+/* Starts the measure of the response to the request sent to the slave */
+static void rtu_stats_request(modbus_rtu_t *ctx_rtu, int slave)
+{
+    _rtu_slave_stats_t *st;
+
+    ctx_rtu->current = NULL;
+    if (!ctx_rtu->adaptive || slave < 1 || slave > _MODBUS_RTU_MAX_SLAVE)
+        return;
+
+    st = ctx_rtu->slave_stats[slave];
+    if (st == NULL) {
+        st = (_rtu_slave_stats_t *) calloc(1, sizeof(_rtu_slave_stats_t));
+        if (st == NULL)
+            return;
+        /* Conservative timing until the first tuning */
+        st->frame_gap = ctx_rtu->max_frame_gap;
+        st->response_timeout = ctx_rtu->max_response_timeout;
+        ctx_rtu->slave_stats[slave] = st;
+    }
+
+    ctx_rtu->current = st;
+    ctx_rtu->current_slave = slave;
+    ctx_rtu->first_byte_us = -1;
+    ctx_rtu->last_read_us = -1;
+    ctx_rtu->frame_gap_max = 0;
+}
+
+/* Ends the measure of the request in progress with the frame received */
+static void rtu_stats_frame(modbus_rtu_t *ctx_rtu, int slave, int valid)
+{
+    _rtu_slave_stats_t *st = ctx_rtu->current;
+    uint32_t latency;
+    int i;
+
+    if (st == NULL)
+        return;
+
+    if (!valid) {
+        /* The frame may have been cut by a silence too short */
+        st->nb_bad_frames++;
+        st->frame_gap = clamp_us(2 * st->frame_gap, ctx_rtu->min_frame_gap,
+                                 ctx_rtu->max_frame_gap);
+        ctx_rtu->current = NULL;
+        return;
+    }
+
+    if (slave != ctx_rtu->current_slave)
+        return;
+    ctx_rtu->current = NULL;
+
+    latency = ctx_rtu->first_byte_us > ctx_rtu->sent_us ?
+        (uint32_t)(ctx_rtu->first_byte_us - ctx_rtu->sent_us) : 0;
+    i = st->nb_responses % _MODBUS_RTU_STATS_WINDOW;
+    st->latency[i] = latency;
+    st->gap[i] = ctx_rtu->frame_gap_max;
+    if (latency > st->latency_max)
+        st->latency_max = latency;
+    if (ctx_rtu->frame_gap_max > st->gap_max)
+        st->gap_max = ctx_rtu->frame_gap_max;
+
+    st->nb_responses++;
+    if (st->nb_responses % _MODBUS_RTU_TUNING_PERIOD == 0)
+        rtu_tune(ctx_rtu, st);
+}
+
+/* Discards the characters received since the last message (late response
+   to a request timed out, noise) so they aren't taken for the beginning of
+   the next one. Nothing is read if the driver has nothing buffered. */
+static void _modbus_rtu_discard_stale(modbus_t *ctx)
+{
+    modbus_rtu_t *ctx_rtu = ctx->backend_data;
+    int clean = ctx_rtu->clean;
+    int nb_bytes = 0;
+
+    ctx_rtu->clean = FALSE;
+    if (ctx_rtu->stale_mode == MODBUS_RTU_STALE_CLEAN && clean)
+        return;
+
+#if defined(_WIN32)
+    nb_bytes = ctx_rtu->w_ser.n_bytes;
+    if (nb_bytes == 0)
+        return;
+    if (ctx->traceCallback && ctx_rtu->stale_mode != MODBUS_RTU_STALE_FLUSH)
+        ctx->traceCallback(ctx_rtu->w_ser.buf, nb_bytes, -1, ctx->traceState);
+    ctx_rtu->w_ser.n_bytes = 0;
+#else
+    if (ioctl(ctx->s, FIONREAD, &nb_bytes) == -1 || nb_bytes <= 0)
+        return;
+
+    if (ctx_rtu->stale_mode == MODBUS_RTU_STALE_FLUSH) {
+        tcflush(ctx->s, TCIFLUSH);
+    } else {
+        uint8_t buf[MODBUS_RTU_MAX_ADU_LENGTH];
+        int left = nb_bytes;
+
+        nb_bytes = 0;
+        while (left > 0) {
+            int rc = read(ctx->s, buf, left < (int) sizeof(buf) ? left : (int) sizeof(buf));
+
+            if (rc <= 0)
+                break;
+            if (ctx->traceCallback)
+                ctx->traceCallback(buf, rc, -1, ctx->traceState);
+            nb_bytes += rc;
+            left -= rc;
+        }
+    }
+#endif
+
+    ctx_rtu->stale_bytes += nb_bytes;
+    if (ctx->debug) {
+        printf("%d unexpected bytes discarded before sending a new message\n",
+               nb_bytes);
+    }
+}
+
+static ssize_t _modbus_rtu_write(modbus_t *ctx, const uint8_t *req, int req_length)
 {
 #if defined(_WIN32)
     modbus_rtu_t *ctx_rtu = ctx->backend_data;
@@ -284,7 +466,12 @@ static ssize_t _modbus_rtu_send(modbus_t *ctx, const uint8_t *req, int req_lengt
 #else
 #if HAVE_DECL_TIOCM_RTS
     modbus_rtu_t *ctx_rtu = ctx->backend_data;
-    if (ctx_rtu->rts != MODBUS_RTU_RTS_NONE) {
+    /* The RTS switch is done by the kernel in RS485 mode */
+    if (ctx_rtu->rts != MODBUS_RTU_RTS_NONE
+#if HAVE_DECL_TIOCSRS485
+        && ctx_rtu->serial_mode != MODBUS_RTU_RS485
+#endif
+        ) {
         ssize_t size;
 
         if (ctx->debug) {
@@ -292,11 +479,14 @@ static ssize_t _modbus_rtu_send(modbus_t *ctx, const uint8_t *req, int req_lengt
         }
 
         _modbus_rtu_ioctl_rts(ctx->s, ctx_rtu->rts == MODBUS_RTU_RTS_UP);
-        usleep(_MODBUS_RTU_TIME_BETWEEN_RTS_SWITCH);
+        _modbus_rtu_sleep_us(ctx_rtu->rts_delay);
 
         size = write(ctx->s, req, req_length);
 
-        usleep(ctx_rtu->onebyte_time * req_length + _MODBUS_RTU_TIME_BETWEEN_RTS_SWITCH);
+        /* Waits for the transmission of the last byte instead of estimating
+           its duration */
+        tcdrain(ctx->s);
+        _modbus_rtu_sleep_us(ctx_rtu->rts_delay);
         _modbus_rtu_ioctl_rts(ctx->s, ctx_rtu->rts != MODBUS_RTU_RTS_UP);
 
         return size;
@@ -309,11 +499,34 @@ static ssize_t _modbus_rtu_send(modbus_t *ctx, const uint8_t *req, int req_lengt
 #endif
 }
 
+static ssize_t _modbus_rtu_send(modbus_t *ctx, const uint8_t *req, int req_length)
+{
+    modbus_rtu_t *ctx_rtu = ctx->backend_data;
+    ssize_t size;
+
+    _modbus_rtu_discard_stale(ctx);
+
+    size = _modbus_rtu_write(ctx, req, req_length);
+    /* The measure starts with the wait of a confirmation, a reply of a
+       server isn't measured */
+    ctx_rtu->current = NULL;
+    if (ctx_rtu->adaptive) {
+        ctx_rtu->sent_slave = req[0];
+        ctx_rtu->sent_us = _modbus_time_us();
+    }
+
+    return size;
+}
+
 static int _modbus_rtu_receive(modbus_t *ctx, uint8_t *req, int* pIsActive)
 {
     int rc;
     modbus_rtu_t *ctx_rtu = ctx->backend_data;
 
+    /* The indications aren't measured */
+    ctx_rtu->current = NULL;
+    ctx_rtu->sent_slave = -1;
+
     if (ctx_rtu->confirmation_to_ignore) {
         _modbus_receive_msg(ctx, req, MSG_CONFIRMATION, pIsActive);
         /* Ignore errors and reset the flag */
@@ -338,21 +551,55 @@ static ssize_t _modbus_rtu_recv(modbus_t *ctx, uint8_t *rsp, int rsp_length)
     return win32_ser_read(&((modbus_rtu_t *)ctx->backend_data)->w_ser, rsp, rsp_length);
 #else
     struct timeval tv;
-    fd_set rset;
-
-    FD_ZERO(&rset);
-    FD_SET(ctx->s, &rset);
-
     int readBytes = 0;
     modbus_rtu_t *ctx_rtu = ctx->backend_data;
-    tv.tv_usec = ctx_rtu->frameTiming;
-    tv.tv_sec = 0;
 
-    while(select(ctx->s+1, &rset, NULL, NULL, &tv) > 0) {
-    	readBytes += read(ctx->s, rsp+readBytes, 1);
+    /* Only the bytes received, the frame is assembled by the caller */
+    if (ctx->recv_nowait) {
+        ssize_t rc = read(ctx->s, rsp, rsp_length);
+
+        if (rc > 0 && ctx_rtu->current != NULL) {
+            int64_t now = _modbus_time_us();
+
+            if (ctx_rtu->last_read_us != -1 &&
+                now - ctx_rtu->last_read_us > ctx_rtu->frame_gap_max)
+                ctx_rtu->frame_gap_max = now - ctx_rtu->last_read_us;
+            ctx_rtu->last_read_us = now;
+        }
+        return rc;
+    }
+
+    if (ctx_rtu->current != NULL) {
+        us_to_timeval(ctx_rtu->current->frame_gap, &tv);
+    } else {
+        tv.tv_sec = 0;
+        tv.tv_usec = ctx_rtu->frameTiming;
+    }
+
+    /* The frame ends when no character has been received during frameTiming
+       (t3.5). In bulk mode, all the characters already buffered by the driver
+       are read at once so the silence is checked once per chunk instead of
+       once per character. */
+    while (_modbus_wait(ctx->s, _MODBUS_WAIT_READ, &tv, NULL, -1) > 0) {
+        int rc;
+
+        if (ctx_rtu->recv_mode == MODBUS_RTU_RECV_BULK)
+            rc = read(ctx->s, rsp+readBytes, MODBUS_RTU_MAX_ADU_LENGTH - readBytes);
+        else
+            rc = read(ctx->s, rsp+readBytes, 1);
+        if (rc == -1)
+            return readBytes > 0 ? readBytes : -1;
+        if (ctx_rtu->current != NULL) {
+            int64_t now = _modbus_time_us();
+
+            if (ctx_rtu->last_read_us != -1 &&
+                now - ctx_rtu->last_read_us > ctx_rtu->frame_gap_max)
+                ctx_rtu->frame_gap_max = now - ctx_rtu->last_read_us;
+            ctx_rtu->last_read_us = now;
+        }
+        readBytes += rc;
         if(readBytes >= MODBUS_RTU_MAX_ADU_LENGTH)
             return readBytes;
-        tv.tv_usec = ctx_rtu->frameTiming; //reinit timeval
     }
     return readBytes;
 #endif
@@ -398,13 +645,16 @@ static int _modbus_rtu_check_integrity(modbus_t *ctx, uint8_t *msg,
         return 0;
     }
 
-    crc_calculated = crc16(msg, msg_length - 2);
+    crc_calculated = modbus_crc16(msg, msg_length - 2);
     crc_received = (msg[msg_length - 2] << 8) | msg[msg_length - 1];
 
     /* Check CRC of msg */
     if (crc_calculated == crc_received) {
+        ((modbus_rtu_t *)ctx->backend_data)->clean = TRUE;
+        rtu_stats_frame(ctx->backend_data, slave, TRUE);
         return msg_length;
     } else {
+        rtu_stats_frame(ctx->backend_data, slave, FALSE);
         if (ctx->debug) {
             fprintf(stderr, "ERROR CRC received %0X != CRC calculated %0X\n",
                     crc_received, crc_calculated);
@@ -927,10 +1177,10 @@ int modbus_rtu_set_serial_mode(modbus_t *ctx, int mode, bool useNewKernelFlags)
         memset(&rs485conf, 0x0, sizeof(struct serial_rs485));
 
         if (mode == MODBUS_RTU_RS485) {
-            rs485conf.flags = SER_RS485_ENABLED;
+            ctx_rtu->rs485_flags = SER_RS485_ENABLED;
             if (useNewKernelFlags)
-                rs485conf.flags = rs485conf.flags | SER_RS485_RTS_ON_SEND;
-            if (ioctl(ctx->s, TIOCSRS485, &rs485conf) < 0) {
+                ctx_rtu->rs485_flags |= SER_RS485_RTS_ON_SEND;
+            if (_modbus_rtu_ioctl_rs485(ctx) < 0) {
                 return -1;
             }
 
@@ -998,7 +1248,21 @@ int modbus_rtu_set_rts(modbus_t *ctx, int mode)
 
         if (mode == MODBUS_RTU_RTS_NONE || mode == MODBUS_RTU_RTS_UP ||
             mode == MODBUS_RTU_RTS_DOWN) {
+#if HAVE_DECL_TIOCSRS485
+            int old_mode = ctx_rtu->rts;
+
+            ctx_rtu->rts = mode;
+            /* Gives the new polarity to the kernel */
+            if (ctx_rtu->serial_mode == MODBUS_RTU_RS485) {
+                if (_modbus_rtu_ioctl_rs485(ctx) < 0) {
+                    ctx_rtu->rts = old_mode;
+                    return -1;
+                }
+                return 0;
+            }
+#else
             ctx_rtu->rts = mode;
+#endif
 
             /* Set the RTS bit in order to not reserve the RS485 bus */
             _modbus_rtu_ioctl_rts(ctx->s, ctx_rtu->rts != MODBUS_RTU_RTS_UP);
@@ -1045,6 +1309,256 @@ int modbus_rtu_get_rts(modbus_t *ctx)
     }
 }
 
+int modbus_rtu_set_rts_delay(modbus_t *ctx, int us)
+{
+    if (ctx == NULL || us < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (ctx->backend->backend_type == _MODBUS_BACKEND_TYPE_RTU) {
+#if HAVE_DECL_TIOCM_RTS
+        modbus_rtu_t *ctx_rtu = ctx->backend_data;
+        int old_delay = ctx_rtu->rts_delay;
+
+        ctx_rtu->rts_delay = us;
+#if HAVE_DECL_TIOCSRS485
+        /* Gives the new delays to the kernel */
+        if (ctx_rtu->serial_mode == MODBUS_RTU_RS485 &&
+            _modbus_rtu_ioctl_rs485(ctx) < 0) {
+            ctx_rtu->rts_delay = old_delay;
+            return -1;
+        }
+#else
+        (void)old_delay;
+#endif
+        return 0;
+#else
+        if (ctx->debug) {
+            fprintf(stderr, "This function isn't supported on your platform\n");
+        }
+        errno = ENOTSUP;
+        return -1;
+#endif
+    }
+    /* Wrong backend */
+    errno = EINVAL;
+    return -1;
+}
+
+int modbus_rtu_get_rts_delay(modbus_t *ctx)
+{
+    if (ctx == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (ctx->backend->backend_type == _MODBUS_BACKEND_TYPE_RTU) {
+#if HAVE_DECL_TIOCM_RTS
+        modbus_rtu_t *ctx_rtu = ctx->backend_data;
+        return ctx_rtu->rts_delay;
+#else
+        if (ctx->debug) {
+            fprintf(stderr, "This function isn't supported on your platform\n");
+        }
+        errno = ENOTSUP;
+        return -1;
+#endif
+    } else {
+        errno = EINVAL;
+        return -1;
+    }
+}
+
+int modbus_rtu_set_recv_mode(modbus_t *ctx, int mode)
+{
+    if (ctx == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (ctx->backend->backend_type == _MODBUS_BACKEND_TYPE_RTU) {
+        modbus_rtu_t *ctx_rtu = ctx->backend_data;
+
+        if (mode == MODBUS_RTU_RECV_BYTE || mode == MODBUS_RTU_RECV_BULK) {
+            ctx_rtu->recv_mode = mode;
+            return 0;
+        }
+    }
+
+    /* Wrong backend or invalid mode specified */
+    errno = EINVAL;
+    return -1;
+}
+
+int modbus_rtu_get_recv_mode(modbus_t *ctx)
+{
+    if (ctx == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (ctx->backend->backend_type == _MODBUS_BACKEND_TYPE_RTU) {
+        modbus_rtu_t *ctx_rtu = ctx->backend_data;
+        return ctx_rtu->recv_mode;
+    } else {
+        errno = EINVAL;
+        return -1;
+    }
+}
+
+int modbus_rtu_set_stale_mode(modbus_t *ctx, int mode)
+{
+    if (ctx == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (ctx->backend->backend_type == _MODBUS_BACKEND_TYPE_RTU) {
+        modbus_rtu_t *ctx_rtu = ctx->backend_data;
+
+        if (mode == MODBUS_RTU_STALE_CLEAN || mode == MODBUS_RTU_STALE_DRAIN ||
+            mode == MODBUS_RTU_STALE_FLUSH) {
+            ctx_rtu->stale_mode = mode;
+            return 0;
+        }
+    }
+
+    /* Wrong backend or invalid mode specified */
+    errno = EINVAL;
+    return -1;
+}
+
+int modbus_rtu_get_stale_mode(modbus_t *ctx)
+{
+    if (ctx == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (ctx->backend->backend_type == _MODBUS_BACKEND_TYPE_RTU) {
+        modbus_rtu_t *ctx_rtu = ctx->backend_data;
+        return ctx_rtu->stale_mode;
+    } else {
+        errno = EINVAL;
+        return -1;
+    }
+}
+
+int modbus_rtu_get_stale_bytes(modbus_t *ctx, uint64_t *nb_bytes)
+{
+    if (ctx == NULL || nb_bytes == NULL ||
+        ctx->backend->backend_type != _MODBUS_BACKEND_TYPE_RTU) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    *nb_bytes = ((modbus_rtu_t *)ctx->backend_data)->stale_bytes;
+    return 0;
+}
+
+int modbus_rtu_set_adaptive_timing(modbus_t *ctx,
+                                   const modbus_rtu_timing_bounds_t *bounds)
+{
+    modbus_rtu_t *ctx_rtu;
+
+    if (ctx == NULL || ctx->backend->backend_type != _MODBUS_BACKEND_TYPE_RTU) {
+        errno = EINVAL;
+        return -1;
+    }
+    ctx_rtu = ctx->backend_data;
+
+    if (bounds == NULL) {
+        ctx_rtu->adaptive = FALSE;
+        ctx_rtu->sent_slave = -1;
+        rtu_free_stats(ctx_rtu);
+        return 0;
+    }
+
+    if (bounds->min_frame_gap.tv_sec < 0 || bounds->min_frame_gap.tv_usec < 0 ||
+        bounds->min_frame_gap.tv_usec > 999999 ||
+        bounds->max_frame_gap.tv_sec < 0 || bounds->max_frame_gap.tv_usec < 0 ||
+        bounds->max_frame_gap.tv_usec > 999999 ||
+        bounds->min_response_timeout.tv_sec < 0 ||
+        bounds->min_response_timeout.tv_usec < 0 ||
+        bounds->min_response_timeout.tv_usec > 999999 ||
+        bounds->max_response_timeout.tv_sec < 0 ||
+        bounds->max_response_timeout.tv_usec < 0 ||
+        bounds->max_response_timeout.tv_usec > 999999 ||
+        timeval_to_us(&bounds->max_frame_gap) == 0 ||
+        timeval_to_us(&bounds->max_response_timeout) == 0 ||
+        timeval_to_us(&bounds->min_frame_gap) >
+        timeval_to_us(&bounds->max_frame_gap) ||
+        timeval_to_us(&bounds->min_response_timeout) >
+        timeval_to_us(&bounds->max_response_timeout)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    /* The measures start again with the new bounds */
+    rtu_free_stats(ctx_rtu);
+    ctx_rtu->sent_slave = -1;
+    ctx_rtu->min_frame_gap = timeval_to_timing(&bounds->min_frame_gap);
+    ctx_rtu->max_frame_gap = timeval_to_timing(&bounds->max_frame_gap);
+    ctx_rtu->min_response_timeout =
+        timeval_to_timing(&bounds->min_response_timeout);
+    ctx_rtu->max_response_timeout =
+        timeval_to_timing(&bounds->max_response_timeout);
+    ctx_rtu->adaptive = TRUE;
+
+    return 0;
+}
+
+int modbus_rtu_get_slave_stats(modbus_t *ctx, int slave,
+                               modbus_rtu_slave_stats_t *stats)
+{
+    modbus_rtu_t *ctx_rtu;
+    _rtu_slave_stats_t *st;
+    uint32_t sorted[_MODBUS_RTU_STATS_WINDOW];
+    int n;
+
+    if (ctx == NULL || stats == NULL || slave < 1 ||
+        slave > _MODBUS_RTU_MAX_SLAVE ||
+        ctx->backend->backend_type != _MODBUS_BACKEND_TYPE_RTU ||
+        !((modbus_rtu_t *)ctx->backend_data)->adaptive) {
+        errno = EINVAL;
+        return -1;
+    }
+    ctx_rtu = ctx->backend_data;
+
+    memset(stats, 0, sizeof(modbus_rtu_slave_stats_t));
+    st = ctx_rtu->slave_stats[slave];
+    if (st == NULL) {
+        /* No request sent to this slave yet */
+        stats->frame_gap = ctx_rtu->max_frame_gap;
+        stats->response_timeout = ctx_rtu->max_response_timeout;
+        return 0;
+    }
+
+    stats->nb_responses = st->nb_responses;
+    stats->nb_timeouts = st->nb_timeouts;
+    stats->nb_bad_frames = st->nb_bad_frames;
+    stats->latency_max = st->latency_max;
+    stats->gap_max = st->gap_max;
+    stats->frame_gap = st->frame_gap;
+    stats->response_timeout = st->response_timeout;
+    if (st->nb_responses > 0) {
+        n = sort_samples(st->latency, st->nb_responses, sorted);
+        stats->latency_p50 = percentile(sorted, n, 50);
+        stats->latency_p99 = percentile(sorted, n, 99);
+        n = sort_samples(st->gap, st->nb_responses, sorted);
+        stats->gap_p99 = percentile(sorted, n, 99);
+    }
+
+    return 0;
+}
+
+/* Opening the serial port doesn't wait */
+static int _modbus_rtu_connect_async(modbus_t *ctx)
+{
+    return _modbus_rtu_connect(ctx);
+}
+
 static void _modbus_rtu_close(modbus_t *ctx)
 {
     /* Restore line settings and close file descriptor in RTU mode */
@@ -1066,6 +1580,19 @@ static void _modbus_rtu_close(modbus_t *ctx)
         ctx->s = -1;
     }
 #endif
+    ctx_rtu->clean = FALSE;
+}
+
+/* The state of the line (last frame clean, measure in progress) doesn't apply
+   to another descriptor */
+static void _modbus_rtu_set_socket(modbus_t *ctx, int s)
+{
+    modbus_rtu_t *ctx_rtu = ctx->backend_data;
+
+    ctx->s = s;
+    ctx_rtu->clean = FALSE;
+    ctx_rtu->current = NULL;
+    ctx_rtu->sent_slave = -1;
 }
 
 static int _modbus_rtu_flush(modbus_t *ctx)
@@ -1079,56 +1606,48 @@ static int _modbus_rtu_flush(modbus_t *ctx)
 #endif
 }
 
-static int _modbus_rtu_select(modbus_t *ctx, fd_set *rset,
-                       struct timeval *tv, int length_to_read, int* pIsActive)
+static int _modbus_rtu_wait(modbus_t *ctx, struct timeval *tv,
+                            int length_to_read, int* pIsActive)
 {
+    modbus_rtu_t *ctx_rtu = ctx->backend_data;
+    struct timeval adaptive_tv;
     int s_rc;
-#if defined(_WIN32)
-    s_rc = win32_ser_select(&(((modbus_rtu_t*)ctx->backend_data)->w_ser),
-                            length_to_read, tv);
-    if (s_rc == 0) {
-        errno = ETIMEDOUT;
-        return -1;
-    }
 
-    if (s_rc < 0) {
-        return -1;
+    if (ctx_rtu->sent_slave != -1) {
+        /* The indications are waited without timeout */
+        if (tv != NULL)
+            rtu_stats_request(ctx_rtu, ctx_rtu->sent_slave);
+        ctx_rtu->sent_slave = -1;
+    }
+    if (ctx_rtu->current != NULL && ctx_rtu->first_byte_us == -1 &&
+        tv != NULL && (tv->tv_sec > 0 || tv->tv_usec > 0)) {
+        /* Response timeout of the slave instead of the one of the context
+           (the polls of the event loops aren't extended) */
+        us_to_timeval(ctx_rtu->current->response_timeout, &adaptive_tv);
+        tv = &adaptive_tv;
     }
-#else
-    struct timeval* pTV = tv;
-    struct timeval timeVal;
-    timeVal.tv_sec = 1;
-    timeVal.tv_usec = 0;
-    if (!pTV && pIsActive)
-        pTV = &timeVal;
-
-    s_rc = select(ctx->s+1, rset, NULL, NULL, pTV);
-    while ((s_rc == -1) // Repeat as long as an error occured
-        || (pIsActive && *pIsActive && s_rc == 0 && pTV == &timeVal)) // OR: While pIsActive is a valid pointer and points to a true-value and the 1sec timeout occured
-    {
-        if (s_rc == -1)
-        {
-            if (errno == EINTR) {
-                if (ctx->debug) {
-                    fprintf(stderr, "A non blocked signal was caught\n");
-                }
-                /* Necessary after an error */
-                FD_ZERO(rset);
-                FD_SET(ctx->s, rset);
-            } else {
-                return -1;
-            }
-        }
 
-        if (s_rc == -1
-            || (pIsActive && *pIsActive && s_rc == 0 && pTV == &timeVal))
-        {
-            timeVal.tv_sec = 1;
-            timeVal.tv_usec = 0;
-            /* Necessary after a timeout */
-            FD_ZERO(rset);
-            FD_SET(ctx->s, rset);
-            s_rc = select(ctx->s+1, rset, NULL, NULL, pTV);
+#if defined(_WIN32)
+    s_rc = win32_ser_select(&ctx_rtu->w_ser, length_to_read, tv);
+#else
+    s_rc = _modbus_wait(ctx->s, _MODBUS_WAIT_READ, tv, pIsActive,
+                        _modbus_cancel_fd(ctx));
+#endif
+    if (ctx_rtu->current != NULL && ctx_rtu->first_byte_us == -1) {
+        if (s_rc > 0) {
+            ctx_rtu->first_byte_us = _modbus_time_us();
+            ctx_rtu->last_read_us = ctx_rtu->first_byte_us;
+        } else if (s_rc == 0 && tv != NULL &&
+                   (tv->tv_sec > 0 || tv->tv_usec > 0)) {
+            /* The latency may have grown, the timeout is doubled until the
+               next tuning (the polls of the event loops don't count) */
+            _rtu_slave_stats_t *st = ctx_rtu->current;
+
+            st->nb_timeouts++;
+            st->response_timeout = clamp_us(2 * st->response_timeout,
+                                            ctx_rtu->min_response_timeout,
+                                            ctx_rtu->max_response_timeout);
+            ctx_rtu->current = NULL;
         }
     }
 
@@ -1137,12 +1656,12 @@ static int _modbus_rtu_select(modbus_t *ctx, fd_set *rset,
         errno = ETIMEDOUT;
         return -1;
     }
-#endif
 
-    return s_rc;
+    return s_rc < 0 ? -1 : s_rc;
 }
 
 static void _modbus_rtu_free(modbus_t *ctx) {
+    rtu_free_stats(ctx->backend_data);
     free(((modbus_rtu_t*)ctx->backend_data)->device);
     free(ctx->backend_data);
     free(ctx);
@@ -1164,9 +1683,11 @@ const modbus_backend_t _modbus_rtu_backend = {
     _modbus_rtu_check_integrity,
     _modbus_rtu_pre_check_confirmation,
     _modbus_rtu_connect,
+    _modbus_rtu_connect_async,
     _modbus_rtu_close,
+    _modbus_rtu_set_socket,
     _modbus_rtu_flush,
-    _modbus_rtu_select,
+    _modbus_rtu_wait,
     _modbus_rtu_free
 };
 
@@ -1209,6 +1730,7 @@ modbus_t* modbus_new_rtu(const char *device,
 #if HAVE_DECL_TIOCSRS485
     /* The RS232 mode has been set by default */
     ctx_rtu->serial_mode = MODBUS_RTU_RS232;
+    ctx_rtu->rs485_flags = 0;
 #endif
 
 #if HAVE_DECL_TIOCM_RTS
@@ -1217,9 +1739,19 @@ modbus_t* modbus_new_rtu(const char *device,
 
     /* Calculate estimated time in micro second to send one byte */
     ctx_rtu->onebyte_time = (1000 * 1000) * (1 + data_bit + (parity == 'N' ? 0 : 1) + stop_bit) / baud;
+    /* Time of one character by default */
+    ctx_rtu->rts_delay = ctx_rtu->onebyte_time;
 #endif
 
     ctx_rtu->confirmation_to_ignore = FALSE;
+    ctx_rtu->recv_mode = MODBUS_RTU_RECV_BYTE;
+    ctx_rtu->stale_mode = MODBUS_RTU_STALE_CLEAN;
+    ctx_rtu->clean = FALSE;
+    ctx_rtu->stale_bytes = 0;
+    ctx_rtu->adaptive = FALSE;
+    memset(ctx_rtu->slave_stats, 0, sizeof(ctx_rtu->slave_stats));
+    ctx_rtu->current = NULL;
+    ctx_rtu->sent_slave = -1;
 
     if(baud > 19200)
         ctx_rtu->frameTiming = 1750; //precision: us (10^-6 s)
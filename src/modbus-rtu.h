@@ -21,6 +21,7 @@
 
 #include "modbus.h"
 #include <stdbool.h>
+#include <stddef.h>
 
 MODBUS_BEGIN_DECLS
 
@@ -44,6 +45,58 @@ MODBUS_API int modbus_rtu_get_serial_mode(modbus_t *ctx);
 
 MODBUS_API int modbus_rtu_set_rts(modbus_t *ctx, int mode);
 MODBUS_API int modbus_rtu_get_rts(modbus_t *ctx);
+MODBUS_API int modbus_rtu_set_rts_delay(modbus_t *ctx, int us);
+MODBUS_API int modbus_rtu_get_rts_delay(modbus_t *ctx);
+
+#define MODBUS_RTU_RECV_BYTE  0
+#define MODBUS_RTU_RECV_BULK  1
+
+MODBUS_API int modbus_rtu_set_recv_mode(modbus_t *ctx, int mode);
+MODBUS_API int modbus_rtu_get_recv_mode(modbus_t *ctx);
+
+#define MODBUS_RTU_STALE_CLEAN  0
+#define MODBUS_RTU_STALE_DRAIN  1
+#define MODBUS_RTU_STALE_FLUSH  2
+
+MODBUS_API int modbus_rtu_set_stale_mode(modbus_t *ctx, int mode);
+MODBUS_API int modbus_rtu_get_stale_mode(modbus_t *ctx);
+MODBUS_API int modbus_rtu_get_stale_bytes(modbus_t *ctx, uint64_t *nb_bytes);
+
+/* Bounds of the timing tuned for each slave, see
+   modbus_rtu_set_adaptive_timing() */
+typedef struct {
+    /* Silence ending a frame (t3.5) */
+    struct timeval min_frame_gap;
+    struct timeval max_frame_gap;
+    struct timeval min_response_timeout;
+    struct timeval max_response_timeout;
+} modbus_rtu_timing_bounds_t;
+
+/* Measures of a slave, the times are in microseconds */
+typedef struct {
+    uint32_t nb_responses;
+    uint32_t nb_timeouts;
+    /* Frames received with an invalid CRC */
+    uint32_t nb_bad_frames;
+    /* Delay between the request sent and the first byte of the response, over
+       the last responses (except latency_max) */
+    uint32_t latency_p50;
+    uint32_t latency_p99;
+    uint32_t latency_max;
+    /* Longest silence inside a frame */
+    uint32_t gap_p99;
+    uint32_t gap_max;
+    /* Timing applied to the requests of the slave */
+    uint32_t frame_gap;
+    uint32_t response_timeout;
+} modbus_rtu_slave_stats_t;
+
+MODBUS_API int modbus_rtu_set_adaptive_timing(modbus_t *ctx,
+                                              const modbus_rtu_timing_bounds_t *bounds);
+MODBUS_API int modbus_rtu_get_slave_stats(modbus_t *ctx, int slave,
+                                          modbus_rtu_slave_stats_t *stats);
+
+MODBUS_API uint16_t modbus_crc16(const uint8_t *buffer, size_t buffer_length);
 
 MODBUS_END_DECLS
 
@@ -0,0 +1,560 @@
+/*
+ * Copyright © 2001-2011 Stéphane Raimbault <stephane.raimbault@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <config.h>
+
+#if !defined(_WIN32)
+# include <poll.h>
+#endif
+
+#include "modbus-private.h"
+#include "modbus-rtu-private.h"
+#include "modbus-scheduler.h"
+
+/* Default silence after a broadcast, for the slaves to process it */
+#define _SCHEDULER_TURNAROUND_US 100000
+/* Default probe-later policy: consecutive timeouts and delays before the
+   requests to the slave are sent again */
+#define _SCHEDULER_PROBE_NB_TIMEOUTS 3
+#define _SCHEDULER_PROBE_MIN_DELAY_US 1000000
+#define _SCHEDULER_PROBE_MAX_DELAY_US 60000000
+
+typedef struct {
+    modbus_request_t request;
+    int slave;
+    int priority;
+    /* Monotonic time (us) of the deadline, INT64_MAX without deadline */
+    int64_t deadline_us;
+    /* Submission order between the requests of the same deadline */
+    uint32_t seq;
+    modbus_callback_t cb;
+    void *user;
+} _sched_request_t;
+
+typedef struct {
+    int nb_timeouts;
+    /* Current delay before probing the slave, 0 while it answers */
+    int64_t delay_us;
+    int64_t probe_us;
+} _sched_slave_t;
+
+typedef struct {
+    modbus_scheduler_t *sched;
+    modbus_t *ctx;
+    /* Requests waiting for the line (binary heap, see sched_before()) */
+    _sched_request_t *queue;
+    int nb_queued;
+    int max_queued;
+    uint32_t next_seq;
+    /* Request in flight, submitted to the context */
+    int busy;
+    _sched_request_t current;
+    /* Silence after a broadcast (t3.5 after the other transactions) */
+    int64_t turnaround_us;
+    /* Monotonic time (us) from which the line is free */
+    int64_t ready_us;
+    _sched_slave_t slaves[_MODBUS_RTU_MAX_SLAVE + 1];
+} _sched_bus_t;
+
+struct _modbus_scheduler {
+    int nb_buses;
+    int max_buses;
+    _sched_bus_t **buses;
+    /* Descriptors watched and their bus, one per bus */
+#if !defined(_WIN32)
+    struct pollfd *fds;
+#endif
+    int *fd_bus;
+    /* Probe-later policy, disabled when probe_nb_timeouts is 0 */
+    int probe_nb_timeouts;
+    int64_t probe_min_us;
+    int64_t probe_max_us;
+    /* Callbacks called by the current modbus_scheduler_process() */
+    int nb_completed;
+};
+
+/* Order of dispatch: by priority class, earliest deadline first in a class
+   then in submission order */
+static int sched_before(const _sched_request_t *a, const _sched_request_t *b)
+{
+    if (a->priority != b->priority)
+        return a->priority < b->priority;
+    if (a->deadline_us != b->deadline_us)
+        return a->deadline_us < b->deadline_us;
+    /* Wraparound safe */
+    return (int32_t)(a->seq - b->seq) < 0;
+}
+
+static void queue_push(_sched_bus_t *bus, const _sched_request_t *r)
+{
+    int i = bus->nb_queued++;
+
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+
+        if (!sched_before(r, &bus->queue[parent]))
+            break;
+        bus->queue[i] = bus->queue[parent];
+        i = parent;
+    }
+    bus->queue[i] = *r;
+}
+
+static void queue_pop(_sched_bus_t *bus, _sched_request_t *r)
+{
+    _sched_request_t last;
+    int i = 0;
+
+    *r = bus->queue[0];
+    last = bus->queue[--bus->nb_queued];
+    for (;;) {
+        int child = 2 * i + 1;
+
+        if (child >= bus->nb_queued)
+            break;
+        if (child + 1 < bus->nb_queued &&
+            sched_before(&bus->queue[child + 1], &bus->queue[child]))
+            child++;
+        if (!sched_before(&bus->queue[child], &last))
+            break;
+        bus->queue[i] = bus->queue[child];
+        i = child;
+    }
+    bus->queue[i] = last;
+}
+
+/* Counts the consecutive timeouts of the slave and delays its next requests
+   once the limit of the policy is reached, any response resets it */
+static void slave_update(modbus_scheduler_t *sched, _sched_slave_t *slave,
+                         int timed_out)
+{
+    if (!timed_out) {
+        slave->nb_timeouts = 0;
+        slave->delay_us = 0;
+        return;
+    }
+
+    slave->nb_timeouts++;
+    if (sched->probe_nb_timeouts == 0 ||
+        slave->nb_timeouts < sched->probe_nb_timeouts)
+        return;
+
+    /* The probe failed too */
+    if (slave->delay_us == 0)
+        slave->delay_us = sched->probe_min_us;
+    else if (slave->delay_us < sched->probe_max_us / 2)
+        slave->delay_us *= 2;
+    else
+        slave->delay_us = sched->probe_max_us;
+    slave->probe_us = _modbus_time_us() + slave->delay_us;
+}
+
+/* Completion of the request in flight of a bus (modbus_callback_t) */
+static void bus_complete(modbus_t *ctx, int rc, int errnum, void *user)
+{
+    _sched_bus_t *bus = (_sched_bus_t *) user;
+    modbus_rtu_t *ctx_rtu = ctx->backend_data;
+    _sched_request_t r = bus->current;
+
+    bus->busy = FALSE;
+    if (r.slave != MODBUS_BROADCAST_ADDRESS) {
+        slave_update(bus->sched, &bus->slaves[r.slave],
+                     rc == -1 && errnum == ETIMEDOUT);
+    }
+    bus->ready_us = _modbus_time_us() +
+        (r.slave == MODBUS_BROADCAST_ADDRESS ?
+         bus->turnaround_us : (int64_t) ctx_rtu->frameTiming);
+    bus->sched->nb_completed++;
+
+    r.cb(ctx, rc, errnum, r.user);
+}
+
+/* Completes a request without sending it */
+static void bus_drop(_sched_bus_t *bus, _sched_request_t *r, int errnum)
+{
+    bus->sched->nb_completed++;
+    r->cb(bus->ctx, -1, errnum, r->user);
+}
+
+/* Submits the next queued request to the context when the line is free, the
+   requests past their deadline or to a slave waiting to be probed are
+   completed without taking the line */
+static void bus_start(_sched_bus_t *bus, int64_t now)
+{
+    while (!bus->busy && bus->nb_queued > 0 && now >= bus->ready_us) {
+        _sched_slave_t *slave;
+
+        queue_pop(bus, &bus->current);
+        if (now > bus->current.deadline_us) {
+            bus_drop(bus, &bus->current, ETIMEDOUT);
+            continue;
+        }
+        slave = &bus->slaves[bus->current.slave];
+        if (slave->delay_us != 0 && now < slave->probe_us) {
+            bus_drop(bus, &bus->current, EAGAIN);
+            continue;
+        }
+        bus->busy = TRUE;
+
+        if (modbus_set_slave(bus->ctx, bus->current.slave) == -1 ||
+            modbus_submit_request(bus->ctx, &bus->current.request,
+                                  bus_complete, bus) == -1) {
+            int errnum = errno;
+
+            bus->busy = FALSE;
+            bus_drop(bus, &bus->current, errnum);
+        }
+    }
+}
+
+modbus_scheduler_t* modbus_scheduler_new(void)
+{
+    modbus_scheduler_t *sched;
+
+    sched = (modbus_scheduler_t *) calloc(1, sizeof(modbus_scheduler_t));
+    if (sched == NULL) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    sched->probe_nb_timeouts = _SCHEDULER_PROBE_NB_TIMEOUTS;
+    sched->probe_min_us = _SCHEDULER_PROBE_MIN_DELAY_US;
+    sched->probe_max_us = _SCHEDULER_PROBE_MAX_DELAY_US;
+
+    return sched;
+}
+
+/* Adds the RTU context ctx to the lines driven by the scheduler and returns
+   its index */
+int modbus_scheduler_add_bus(modbus_scheduler_t *sched, modbus_t *ctx)
+{
+    _sched_bus_t *bus;
+    int i;
+
+    if (sched == NULL || ctx == NULL ||
+        ctx->backend->backend_type != _MODBUS_BACKEND_TYPE_RTU) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    for (i = 0; i < sched->nb_buses; i++) {
+        if (sched->buses[i]->ctx == ctx) {
+            errno = EINVAL;
+            return -1;
+        }
+    }
+
+    if (sched->nb_buses == sched->max_buses) {
+        int max_buses = sched->max_buses ? sched->max_buses * 2 : 8;
+        _sched_bus_t **buses;
+        int *fd_bus;
+
+        buses = realloc(sched->buses, max_buses * sizeof(_sched_bus_t *));
+        if (buses == NULL) {
+            errno = ENOMEM;
+            return -1;
+        }
+        sched->buses = buses;
+#if !defined(_WIN32)
+        {
+            struct pollfd *fds;
+
+            fds = realloc(sched->fds, max_buses * sizeof(struct pollfd));
+            if (fds == NULL) {
+                errno = ENOMEM;
+                return -1;
+            }
+            sched->fds = fds;
+        }
+#endif
+        fd_bus = realloc(sched->fd_bus, max_buses * sizeof(int));
+        if (fd_bus == NULL) {
+            errno = ENOMEM;
+            return -1;
+        }
+        sched->fd_bus = fd_bus;
+        sched->max_buses = max_buses;
+    }
+
+    /* Allocated one by one, the address is given to the callbacks */
+    bus = (_sched_bus_t *) calloc(1, sizeof(_sched_bus_t));
+    if (bus == NULL) {
+        errno = ENOMEM;
+        return -1;
+    }
+    bus->sched = sched;
+    bus->ctx = ctx;
+    bus->turnaround_us = _SCHEDULER_TURNAROUND_US;
+    sched->buses[sched->nb_buses] = bus;
+
+    return sched->nb_buses++;
+}
+
+int modbus_scheduler_set_turnaround(modbus_scheduler_t *sched, int bus,
+                                    const struct timeval *delay)
+{
+    if (sched == NULL || bus < 0 || bus >= sched->nb_buses || delay == NULL ||
+        delay->tv_sec < 0 || delay->tv_usec < 0 || delay->tv_usec > 999999) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    sched->buses[bus]->turnaround_us = (int64_t) delay->tv_sec * 1000000 +
+        delay->tv_usec;
+
+    return 0;
+}
+
+int modbus_scheduler_set_probe(modbus_scheduler_t *sched, int nb_timeouts,
+                               const struct timeval *min_delay,
+                               const struct timeval *max_delay)
+{
+    int64_t min_us;
+    int64_t max_us;
+
+    if (sched == NULL || nb_timeouts < 0 || min_delay == NULL ||
+        max_delay == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    min_us = (int64_t)min_delay->tv_sec * 1000000 + min_delay->tv_usec;
+    max_us = (int64_t)max_delay->tv_sec * 1000000 + max_delay->tv_usec;
+    if (min_us <= 0 || max_us < min_us) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    sched->probe_nb_timeouts = nb_timeouts;
+    sched->probe_min_us = min_us;
+    sched->probe_max_us = max_us;
+
+    return 0;
+}
+
+/* Queues the request r to the slave of the line bus in the priority class
+   priority, to be sent before the delay deadline (NULL without deadline). cb
+   is called by modbus_scheduler_process() on completion. */
+int modbus_scheduler_submit_priority(modbus_scheduler_t *sched, int bus,
+                                     int slave, const modbus_request_t *r,
+                                     int priority,
+                                     const struct timeval *deadline,
+                                     modbus_callback_t cb, void *user)
+{
+    _sched_bus_t *b;
+    _sched_request_t sr;
+
+    if (sched == NULL || bus < 0 || bus >= sched->nb_buses || r == NULL ||
+        cb == NULL || slave < 0 || slave > _MODBUS_RTU_MAX_SLAVE ||
+        priority < MODBUS_SCHEDULER_PRIORITY_HIGH ||
+        priority > MODBUS_SCHEDULER_PRIORITY_LOW ||
+        (deadline != NULL && (deadline->tv_sec < 0 || deadline->tv_usec < 0 ||
+                              deadline->tv_usec > 999999))) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    /* Only the writes can be broadcast */
+    if (slave == MODBUS_BROADCAST_ADDRESS &&
+        r->function != MODBUS_FC_WRITE_SINGLE_COIL &&
+        r->function != MODBUS_FC_WRITE_SINGLE_REGISTER &&
+        r->function != MODBUS_FC_WRITE_MULTIPLE_COILS &&
+        r->function != MODBUS_FC_WRITE_MULTIPLE_REGISTERS) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    b = sched->buses[bus];
+    if (b->nb_queued == b->max_queued) {
+        int max_queued = b->max_queued ? b->max_queued * 2 : 16;
+        _sched_request_t *queue;
+
+        queue = realloc(b->queue, max_queued * sizeof(_sched_request_t));
+        if (queue == NULL) {
+            errno = ENOMEM;
+            return -1;
+        }
+        b->queue = queue;
+        b->max_queued = max_queued;
+    }
+
+    sr.request = *r;
+    sr.slave = slave;
+    sr.priority = priority;
+    if (deadline != NULL) {
+        sr.deadline_us = _modbus_time_us() +
+            (int64_t)deadline->tv_sec * 1000000 + deadline->tv_usec;
+    } else {
+        sr.deadline_us = INT64_MAX;
+    }
+    sr.seq = b->next_seq++;
+    sr.cb = cb;
+    sr.user = user;
+    queue_push(b, &sr);
+
+    return 0;
+}
+
+/* Queues the request r to the slave of the line bus, in the normal priority
+   class and without deadline */
+int modbus_scheduler_submit(modbus_scheduler_t *sched, int bus, int slave,
+                            const modbus_request_t *r, modbus_callback_t cb,
+                            void *user)
+{
+    return modbus_scheduler_submit_priority(sched, bus, slave, r,
+                                            MODBUS_SCHEDULER_PRIORITY_NORMAL,
+                                            NULL, cb, user);
+}
+
+/* Returns the number of requests queued or in flight */
+int modbus_scheduler_get_nb_pending(modbus_scheduler_t *sched)
+{
+    int nb_pending = 0;
+    int i;
+
+    if (sched == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    for (i = 0; i < sched->nb_buses; i++)
+        nb_pending += sched->buses[i]->nb_queued + sched->buses[i]->busy;
+
+    return nb_pending;
+}
+
+/* Sends the requests of the free lines, waits up to timeout ms (-1 without
+   limit) for the responses or the end of a silence and processes them.
+
+   The function shall return the number of requests completed (their
+   callbacks have been called), 0 when there is nothing to do. */
+int modbus_scheduler_process(modbus_scheduler_t *sched, int timeout)
+{
+#if defined(_WIN32)
+    errno = ENOTSUP;
+    return -1;
+#else
+    int64_t now;
+    int64_t wait_us;
+    int nb_fds = 0;
+    int rc;
+    int i;
+
+    if (sched == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    sched->nb_completed = 0;
+    now = _modbus_time_us();
+    wait_us = (timeout < 0) ? -1 : (int64_t) timeout * 1000;
+
+    for (i = 0; i < sched->nb_buses; i++) {
+        _sched_bus_t *bus = sched->buses[i];
+        int64_t delay = -1;
+
+        bus_start(bus, now);
+        if (bus->busy) {
+            int delay_ms;
+
+            sched->fds[nb_fds].fd = modbus_get_pollfd(bus->ctx, &delay_ms);
+            sched->fds[nb_fds].events = POLLIN;
+            sched->fds[nb_fds].revents = 0;
+            sched->fd_bus[nb_fds++] = i;
+            if (delay_ms != -1)
+                delay = (int64_t) delay_ms * 1000;
+        } else if (bus->nb_queued > 0) {
+            delay = bus->ready_us - now;
+        }
+
+        if (delay != -1 && (wait_us == -1 || delay < wait_us))
+            wait_us = delay;
+    }
+
+    /* Requests failed to be submitted */
+    if (sched->nb_completed > 0)
+        wait_us = 0;
+    if (nb_fds == 0 && wait_us == -1)
+        return 0;
+
+#if HAVE_PPOLL
+    {
+        struct timespec ts;
+
+        ts.tv_sec = wait_us / 1000000;
+        ts.tv_nsec = (wait_us % 1000000) * 1000;
+        rc = ppoll(sched->fds, nb_fds, wait_us == -1 ? NULL : &ts, NULL);
+    }
+#else
+    rc = poll(sched->fds, nb_fds,
+              wait_us == -1 ? -1 : (int)((wait_us + 999) / 1000));
+#endif
+    if (rc == -1 && errno != EINTR)
+        return -1;
+
+    /* Responses received and requests timed out */
+    for (i = 0; i < nb_fds; i++) {
+        _sched_bus_t *bus = sched->buses[sched->fd_bus[i]];
+        int delay_ms;
+
+        if (sched->fds[i].revents == 0) {
+            modbus_get_pollfd(bus->ctx, &delay_ms);
+            if (delay_ms != 0)
+                continue;
+        }
+        /* The failures of the link complete the request with the error */
+        modbus_process_events(bus->ctx);
+    }
+
+    now = _modbus_time_us();
+    for (i = 0; i < sched->nb_buses; i++)
+        bus_start(sched->buses[i], now);
+
+    return sched->nb_completed;
+#endif
+}
+
+/* The requests queued or in flight are dropped without callback, the
+   contexts aren't freed */
+void modbus_scheduler_free(modbus_scheduler_t *sched)
+{
+    int i;
+
+    if (sched == NULL)
+        return;
+
+    for (i = 0; i < sched->nb_buses; i++) {
+        _sched_bus_t *bus = sched->buses[i];
+
+        if (bus->busy) {
+            /* The callback of the request in flight refers to the bus */
+            _modbus_async_free(bus->ctx);
+        }
+        free(bus->queue);
+        free(bus);
+    }
+    free(sched->buses);
+#if !defined(_WIN32)
+    free(sched->fds);
+#endif
+    free(sched->fd_bus);
+    free(sched);
+}
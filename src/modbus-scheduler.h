@@ -0,0 +1,61 @@
+/*
+ * Copyright © 2001-2011 Stéphane Raimbault <stephane.raimbault@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef _MODBUS_SCHEDULER_H_
+#define _MODBUS_SCHEDULER_H_
+
+#include "modbus.h"
+
+MODBUS_BEGIN_DECLS
+
+/* Serial lines (RTU contexts) driven by one thread: the requests of each line
+   are queued by priority and deadline and sent one at a time, separated by the
+   silence required by the serial line */
+typedef struct _modbus_scheduler modbus_scheduler_t;
+
+/* Priority classes of the requests, the requests of a higher class are always
+   sent first */
+#define MODBUS_SCHEDULER_PRIORITY_HIGH   0
+#define MODBUS_SCHEDULER_PRIORITY_NORMAL 1
+#define MODBUS_SCHEDULER_PRIORITY_LOW    2
+
+MODBUS_API modbus_scheduler_t* modbus_scheduler_new(void);
+MODBUS_API int modbus_scheduler_add_bus(modbus_scheduler_t *sched, modbus_t *ctx);
+MODBUS_API int modbus_scheduler_set_turnaround(modbus_scheduler_t *sched, int bus,
+                                               const struct timeval *delay);
+MODBUS_API int modbus_scheduler_set_probe(modbus_scheduler_t *sched,
+                                          int nb_timeouts,
+                                          const struct timeval *min_delay,
+                                          const struct timeval *max_delay);
+MODBUS_API int modbus_scheduler_submit(modbus_scheduler_t *sched, int bus,
+                                       int slave, const modbus_request_t *r,
+                                       modbus_callback_t cb, void *user);
+MODBUS_API int modbus_scheduler_submit_priority(modbus_scheduler_t *sched,
+                                                int bus, int slave,
+                                                const modbus_request_t *r,
+                                                int priority,
+                                                const struct timeval *deadline,
+                                                modbus_callback_t cb,
+                                                void *user);
+MODBUS_API int modbus_scheduler_get_nb_pending(modbus_scheduler_t *sched);
+MODBUS_API int modbus_scheduler_process(modbus_scheduler_t *sched, int timeout);
+MODBUS_API void modbus_scheduler_free(modbus_scheduler_t *sched);
+
+MODBUS_END_DECLS
+
+#endif /* _MODBUS_SCHEDULER_H_ */
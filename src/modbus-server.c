@@ -0,0 +1,802 @@
+/*
+ * Copyright © 2001-2011 Stéphane Raimbault <stephane.raimbault@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#ifndef _MSC_VER
+#include <unistd.h>
+#endif
+
+#include <config.h>
+
+#include "modbus-private.h"
+
+#include "modbus-tcp.h"
+#include "modbus-tcp-private.h"
+#include "modbus-server.h"
+
+#if HAVE_SYS_EPOLL_H && HAVE_SYS_EVENTFD_H
+# define _MODBUS_SERVER_EPOLL
+# include <fcntl.h>
+# include <sys/socket.h>
+# include <sys/epoll.h>
+# include <sys/eventfd.h>
+# include <netinet/in.h>
+# include <netinet/tcp.h>
+#endif
+
+#if defined(_MODBUS_SERVER_EPOLL) && HAVE_PTHREAD_H
+# define _MODBUS_SERVER_THREADS
+# include <pthread.h>
+#endif
+
+#if !defined(MSG_NOSIGNAL)
+#define MSG_NOSIGNAL 0
+#endif
+
+/* Size of the reception and emission buffers of a connection, several
+   pipelined requests (or responses) fit in each of them */
+#define _MODBUS_SERVER_BUFFER_LENGTH (4 * MAX_MESSAGE_LENGTH)
+
+/* Max number of events handled after each wait */
+#define _MODBUS_SERVER_MAX_EVENTS 256
+
+typedef struct _server_conn {
+    int s;
+    /* Events monitored for this connection (EPOLLIN or EPOLLOUT) */
+    uint32_t events;
+    /* Received bytes not yet processed (partial frames) */
+    int in_length;
+    /* Responses not yet sent, from out_offset to out_length */
+    int out_offset;
+    int out_length;
+    struct _server_conn *prev;
+    struct _server_conn *next;
+    uint8_t in[_MODBUS_SERVER_BUFFER_LENGTH];
+    uint8_t out[_MODBUS_SERVER_BUFFER_LENGTH];
+} _server_conn_t;
+
+/* Each worker serves its connections with its own event loop, listening
+   socket and context */
+typedef struct _server_worker {
+    modbus_server_t *server;
+    /* Clone of the context of the server (the context itself with one
+       thread) */
+    modbus_t *ctx;
+    /* Listening socket (-1 when the worker isn't running) */
+    int s;
+    int epfd;
+    /* The listening socket is ignored while no descriptor is available */
+    int accept_paused;
+    int nb_connections;
+    _server_conn_t *conns;
+    /* Result of the event loop */
+    int rc;
+    int saved_errno;
+#ifdef _MODBUS_SERVER_THREADS
+    pthread_t thread;
+#endif
+} _server_worker_t;
+
+struct _modbus_server {
+    modbus_t *ctx;
+    modbus_mapping_t *mb_mapping;
+    int nb_threads;
+    int running;
+    /* Event counter written by modbus_server_stop, it stays readable to
+       wake up all the workers */
+    int stop_fd;
+#ifdef _MODBUS_SERVER_THREADS
+    /* Requests reading the mapping are processed concurrently, the other
+       ones exclusively */
+    pthread_rwlock_t mapping_lock;
+#endif
+};
+
+#ifdef _MODBUS_SERVER_EPOLL
+
+static int worker_ctl(_server_worker_t *worker, int op, int fd,
+                      uint32_t events, void *ptr)
+{
+    struct epoll_event event;
+
+    memset(&event, 0, sizeof(event));
+    event.events = events;
+    event.data.ptr = ptr;
+
+    return epoll_ctl(worker->epfd, op, fd, &event);
+}
+
+static void conn_close(_server_worker_t *worker, _server_conn_t *conn)
+{
+    if (worker->ctx->debug) {
+        printf("Closing the connection on socket %d\n", conn->s);
+    }
+
+    epoll_ctl(worker->epfd, EPOLL_CTL_DEL, conn->s, NULL);
+    close(conn->s);
+
+    if (conn->prev != NULL)
+        conn->prev->next = conn->next;
+    else
+        worker->conns = conn->next;
+    if (conn->next != NULL)
+        conn->next->prev = conn->prev;
+    free(conn);
+    worker->nb_connections--;
+
+    /* A descriptor is available again */
+    if (worker->accept_paused) {
+        worker->accept_paused = 0;
+        worker_ctl(worker, EPOLL_CTL_MOD, worker->s, EPOLLIN, &worker->s);
+    }
+}
+
+static void worker_accept(_server_worker_t *worker)
+{
+    modbus_t *ctx = worker->ctx;
+
+    for (;;) {
+        _server_conn_t *conn;
+        int yes = 1;
+        int s;
+
+#ifdef HAVE_ACCEPT4
+        s = accept4(worker->s, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+#else
+        s = accept(worker->s, NULL, NULL);
+        if (s != -1) {
+            fcntl(s, F_SETFL, fcntl(s, F_GETFL) | O_NONBLOCK);
+            fcntl(s, F_SETFD, FD_CLOEXEC);
+        }
+#endif
+        if (s == -1) {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+
+            if (errno == EMFILE || errno == ENFILE ||
+                errno == ENOBUFS || errno == ENOMEM) {
+                /* The pending connections stay in the backlog until a
+                   connection is closed */
+                _error_print(ctx, "accept");
+                worker->accept_paused = 1;
+                worker_ctl(worker, EPOLL_CTL_MOD, worker->s, 0, &worker->s);
+            } else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                _error_print(ctx, "accept");
+            }
+            return;
+        }
+
+        /* Responses are sent as soon as they are built */
+        setsockopt(s, IPPROTO_TCP, TCP_NODELAY, (const void *)&yes, sizeof(int));
+
+        conn = malloc(sizeof(_server_conn_t));
+        if (conn == NULL) {
+            close(s);
+            continue;
+        }
+        conn->s = s;
+        conn->events = EPOLLIN;
+        conn->in_length = 0;
+        conn->out_offset = 0;
+        conn->out_length = 0;
+
+        if (worker_ctl(worker, EPOLL_CTL_ADD, s, conn->events, conn) == -1) {
+            _error_print(ctx, "epoll_ctl");
+            close(s);
+            free(conn);
+            continue;
+        }
+
+        conn->prev = NULL;
+        conn->next = worker->conns;
+        if (worker->conns != NULL)
+            worker->conns->prev = conn;
+        worker->conns = conn;
+        worker->nb_connections++;
+
+        if (ctx->debug) {
+            printf("The client connection is accepted on socket %d (%d connections)\n",
+                   s, worker->nb_connections);
+        }
+    }
+}
+
+/* The bytes of a request aren't read step by step as in _modbus_receive_msg
+   so the length given by the MBAP header must be checked against the
+   content of the request before building the response */
+static int check_request(modbus_t *ctx, uint8_t *req, int req_length)
+{
+    int function = req[_MODBUS_TCP_HEADER_LENGTH];
+    int length;
+
+    switch (function) {
+    case _FC_READ_COILS:
+    case _FC_READ_DISCRETE_INPUTS:
+    case _FC_READ_HOLDING_REGISTERS:
+    case _FC_READ_INPUT_REGISTERS:
+    case _FC_WRITE_SINGLE_COIL:
+    case _FC_WRITE_SINGLE_REGISTER:
+    case _FC_WRITE_MULTIPLE_COILS:
+    case _FC_WRITE_MULTIPLE_REGISTERS:
+    case _FC_REPORT_SLAVE_ID:
+    case _FC_MASK_WRITE_REGISTER:
+    case _FC_WRITE_AND_READ_REGISTERS:
+        length = _MODBUS_TCP_HEADER_LENGTH + 1 +
+            compute_meta_length_after_function(function, MSG_INDICATION);
+        if (req_length >= length) {
+            length += compute_data_length_after_meta(ctx, req, MSG_INDICATION);
+        }
+        if (req_length != length) {
+            errno = EMBBADDATA;
+            _error_print(ctx, "invalid request length");
+            return -1;
+        }
+        break;
+    default:
+        /* Answered by an exception */
+        break;
+    }
+
+    return 0;
+}
+
+/* Builds the response under the lock of the mapping */
+static int server_build_reply(modbus_server_t *server, modbus_t *ctx,
+                              const uint8_t *req, int req_length, uint8_t *rsp)
+{
+    int rc;
+#ifdef _MODBUS_SERVER_THREADS
+    int function = req[_MODBUS_TCP_HEADER_LENGTH];
+
+    if (_modbus_mapping_is_concurrent(server->mb_mapping)) {
+        /* A concurrent mapping synchronizes its readers and writers */
+        return modbus_build_reply(ctx, req, req_length, server->mb_mapping,
+                                  rsp, MAX_MESSAGE_LENGTH);
+    }
+
+    if (function == _FC_READ_COILS ||
+        function == _FC_READ_DISCRETE_INPUTS ||
+        function == _FC_READ_HOLDING_REGISTERS ||
+        function == _FC_READ_INPUT_REGISTERS) {
+        pthread_rwlock_rdlock(&server->mapping_lock);
+    } else {
+        pthread_rwlock_wrlock(&server->mapping_lock);
+    }
+#endif
+
+    rc = modbus_build_reply(ctx, req, req_length, server->mb_mapping,
+                            rsp, MAX_MESSAGE_LENGTH);
+
+#ifdef _MODBUS_SERVER_THREADS
+    pthread_rwlock_unlock(&server->mapping_lock);
+#endif
+
+    return rc;
+}
+
+/* Builds the responses of the complete requests received on the connection
+   while there is enough room to store them */
+static int conn_process(_server_worker_t *worker, _server_conn_t *conn)
+{
+    modbus_t *ctx = worker->ctx;
+    int offset = 0;
+
+    while (conn->in_length - offset >= _MODBUS_TCP_HEADER_LENGTH) {
+        uint8_t *req = conn->in + offset;
+        int req_length;
+        int rc;
+
+        /* MBAP header: transaction ID (2), protocol ID (2), length (2)
+           and unit ID (1). The length counts the unit ID and the PDU. */
+        if (req[2] != 0 || req[3] != 0) {
+            errno = EMBBADDATA;
+            _error_print(ctx, "protocol identifier");
+            return -1;
+        }
+
+        req_length = 6 + ((req[4] << 8) | req[5]);
+        if (req_length <= _MODBUS_TCP_HEADER_LENGTH ||
+            req_length > MODBUS_TCP_MAX_ADU_LENGTH) {
+            errno = EMBBADDATA;
+            _error_print(ctx, "MBAP length");
+            return -1;
+        }
+
+        if (conn->in_length - offset < req_length) {
+            /* Partial request */
+            break;
+        }
+
+        if (_MODBUS_SERVER_BUFFER_LENGTH - conn->out_length < MAX_MESSAGE_LENGTH) {
+            /* Waits for the emission of the previous responses */
+            break;
+        }
+
+        if (check_request(ctx, req, req_length) == -1)
+            return -1;
+
+        if (ctx->debug) {
+            int i;
+            for (i = 0; i < req_length; i++)
+                printf("<%.2X>", req[i]);
+            printf("\n");
+        }
+
+        if (ctx->traceCallback) {
+            ctx->traceCallback(req, req_length, 1, ctx->traceState);
+        }
+
+        rc = server_build_reply(worker->server, ctx, req, req_length,
+                                conn->out + conn->out_length);
+        if (rc > 0) {
+            uint8_t *rsp = conn->out + conn->out_length;
+
+            if (ctx->traceCallback) {
+                ctx->traceCallback(rsp, rc, 0, ctx->traceState);
+            }
+
+            if (ctx->debug) {
+                int i;
+                for (i = 0; i < rc; i++)
+                    printf("[%.2X]", rsp[i]);
+                printf("\n");
+            }
+
+            conn->out_length += rc;
+        }
+
+        offset += req_length;
+    }
+
+    if (offset > 0) {
+        conn->in_length -= offset;
+        memmove(conn->in, conn->in + offset, conn->in_length);
+    }
+
+    return 0;
+}
+
+/* Sends the pending responses, returns -1 if the connection is broken */
+static int conn_flush(_server_worker_t *worker, _server_conn_t *conn)
+{
+    while (conn->out_offset < conn->out_length) {
+        ssize_t rc = send(conn->s, conn->out + conn->out_offset,
+                          conn->out_length - conn->out_offset, MSG_NOSIGNAL);
+        if (rc == -1) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return 0;
+            _error_print(worker->ctx, "send");
+            return -1;
+        }
+        conn->out_offset += rc;
+    }
+
+    conn->out_offset = 0;
+    conn->out_length = 0;
+
+    return 0;
+}
+
+static void conn_handle(_server_worker_t *worker, _server_conn_t *conn,
+                        uint32_t events)
+{
+    uint32_t new_events;
+
+    if ((events & (EPOLLERR | EPOLLHUP)) && !(events & EPOLLIN)) {
+        conn_close(worker, conn);
+        return;
+    }
+
+    if ((events & EPOLLIN) && conn->in_length < _MODBUS_SERVER_BUFFER_LENGTH) {
+        ssize_t rc = recv(conn->s, conn->in + conn->in_length,
+                          _MODBUS_SERVER_BUFFER_LENGTH - conn->in_length, 0);
+        if (rc == 0 ||
+            (rc == -1 && errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK)) {
+            conn_close(worker, conn);
+            return;
+        }
+        if (rc > 0)
+            conn->in_length += rc;
+    }
+
+    /* Sends the responses and builds the next ones until the pending
+       requests are processed or the socket is full */
+    for (;;) {
+        if (conn_flush(worker, conn) == -1 ||
+            conn_process(worker, conn) == -1) {
+            conn_close(worker, conn);
+            return;
+        }
+
+        if (conn->out_length == 0)
+            break;
+
+        if (conn_flush(worker, conn) == -1) {
+            conn_close(worker, conn);
+            return;
+        }
+
+        if (conn->out_length != 0)
+            break;
+    }
+
+    /* The requests are no longer read while the responses can't be sent */
+    new_events = conn->out_length != 0 ? EPOLLOUT : EPOLLIN;
+    if (new_events != conn->events) {
+        conn->events = new_events;
+        if (worker_ctl(worker, EPOLL_CTL_MOD, conn->s, new_events, conn) == -1) {
+            conn_close(worker, conn);
+        }
+    }
+}
+
+static void worker_close(_server_worker_t *worker)
+{
+    while (worker->conns != NULL) {
+        conn_close(worker, worker->conns);
+    }
+
+    if (worker->epfd != -1)
+        close(worker->epfd);
+    worker->epfd = -1;
+    if (worker->s != -1)
+        close(worker->s);
+    worker->s = -1;
+    worker->accept_paused = 0;
+}
+
+/* Creates the listening socket and the event loop of the worker */
+static int worker_open(_server_worker_t *worker, int flags)
+{
+    modbus_server_t *server = worker->server;
+
+    worker->s = _modbus_tcp_listen(worker->ctx, SOMAXCONN, flags);
+    if (worker->s == -1) {
+        return -1;
+    }
+
+    worker->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (worker->epfd == -1 ||
+        fcntl(worker->s, F_SETFL, fcntl(worker->s, F_GETFL) | O_NONBLOCK) == -1 ||
+        worker_ctl(worker, EPOLL_CTL_ADD, worker->s, EPOLLIN, &worker->s) == -1 ||
+        worker_ctl(worker, EPOLL_CTL_ADD, server->stop_fd, EPOLLIN,
+                   &server->stop_fd) == -1) {
+        int saved_errno = errno;
+        worker_close(worker);
+        errno = saved_errno;
+        return -1;
+    }
+
+    return 0;
+}
+
+static void worker_run(_server_worker_t *worker)
+{
+    struct epoll_event events[_MODBUS_SERVER_MAX_EVENTS];
+    modbus_server_t *server = worker->server;
+    int stop = 0;
+
+    worker->rc = 0;
+    while (!stop) {
+        int nfds;
+        int i;
+
+        nfds = epoll_wait(worker->epfd, events, _MODBUS_SERVER_MAX_EVENTS, -1);
+        if (nfds == -1) {
+            if (errno == EINTR)
+                continue;
+            _error_print(worker->ctx, "epoll_wait");
+            worker->rc = -1;
+            worker->saved_errno = errno;
+            /* The other workers stop too */
+            modbus_server_stop(server);
+            break;
+        }
+
+        for (i = 0; i < nfds; i++) {
+            void *ptr = events[i].data.ptr;
+
+            if (ptr == &worker->s) {
+                worker_accept(worker);
+            } else if (ptr == &server->stop_fd) {
+                /* The counter is reset once all the workers are stopped */
+                stop = 1;
+            } else {
+                conn_handle(worker, ptr, events[i].events);
+            }
+        }
+    }
+
+    worker_close(worker);
+}
+
+#ifdef _MODBUS_SERVER_THREADS
+static void *worker_thread(void *arg)
+{
+    worker_run(arg);
+
+    return NULL;
+}
+#endif
+
+#endif
+
+modbus_server_t* modbus_server_new(modbus_t *ctx, modbus_mapping_t *mb_mapping)
+{
+#ifdef _MODBUS_SERVER_EPOLL
+    modbus_server_t *server;
+
+    if (ctx == NULL || mb_mapping == NULL ||
+        ctx->backend->backend_type != _MODBUS_BACKEND_TYPE_TCP) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    server = malloc(sizeof(modbus_server_t));
+    if (server == NULL) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    server->ctx = ctx;
+    server->mb_mapping = mb_mapping;
+    server->nb_threads = 1;
+    server->running = 0;
+
+    server->stop_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (server->stop_fd == -1) {
+        free(server);
+        return NULL;
+    }
+
+#ifdef _MODBUS_SERVER_THREADS
+    if (pthread_rwlock_init(&server->mapping_lock, NULL) != 0) {
+        close(server->stop_fd);
+        free(server);
+        errno = ENOMEM;
+        return NULL;
+    }
+#endif
+
+    return server;
+#else
+    errno = ENOTSUP;
+    return NULL;
+#endif
+}
+
+/* Sets the number of threads serving the connections, each thread listens
+   on the address of the server with its own socket (SO_REUSEPORT) so the
+   kernel spreads the connections across the threads */
+int modbus_server_set_nb_threads(modbus_server_t *server, int nb_threads)
+{
+    if (server == NULL || server->running || nb_threads < 1) {
+        errno = EINVAL;
+        return -1;
+    }
+
+#if defined(_MODBUS_SERVER_THREADS) && defined(SO_REUSEPORT)
+    server->nb_threads = nb_threads;
+    return 0;
+#else
+    if (nb_threads != 1) {
+        errno = ENOTSUP;
+        return -1;
+    }
+    return 0;
+#endif
+}
+
+int modbus_server_get_nb_threads(modbus_server_t *server)
+{
+    if (server == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    return server->nb_threads;
+}
+
+/* Serves the clients until modbus_server_stop is called */
+int modbus_server_run(modbus_server_t *server)
+{
+#ifdef _MODBUS_SERVER_EPOLL
+    _server_worker_t *workers;
+    uint64_t value;
+    int nb_workers;
+    int flags;
+    int rc = 0;
+    int i;
+
+    if (server == NULL || server->running) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    nb_workers = server->nb_threads;
+    workers = calloc(nb_workers, sizeof(_server_worker_t));
+    if (workers == NULL) {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    for (i = 0; i < nb_workers; i++) {
+        workers[i].server = server;
+        workers[i].s = -1;
+        workers[i].epfd = -1;
+    }
+
+    /* The listening sockets are all created before the first connection is
+       accepted so the errors are reported to the caller */
+    flags = (nb_workers > 1) ? _MODBUS_TCP_LISTEN_REUSEPORT : 0;
+    for (i = 0; i < nb_workers; i++) {
+        _server_worker_t *worker = &workers[i];
+
+        worker->ctx = (i == 0) ? server->ctx : _modbus_tcp_clone(server->ctx);
+        if (worker->ctx == NULL || worker_open(worker, flags) == -1) {
+            rc = -1;
+            break;
+        }
+    }
+
+    if (rc == 0) {
+        int nb_started;
+
+        server->running = 1;
+
+        nb_started = 1;
+#ifdef _MODBUS_SERVER_THREADS
+        for (i = 1; i < nb_workers; i++) {
+            if (pthread_create(&workers[i].thread, NULL, worker_thread,
+                               &workers[i]) != 0) {
+                /* The started workers stop at once, the other ones are
+                   closed below */
+                modbus_server_stop(server);
+                rc = -1;
+                break;
+            }
+            nb_started++;
+        }
+#endif
+
+        worker_run(&workers[0]);
+
+#ifdef _MODBUS_SERVER_THREADS
+        for (i = 1; i < nb_started; i++) {
+            pthread_join(workers[i].thread, NULL);
+        }
+#endif
+
+        if (rc == -1) {
+            /* Thread creation failure */
+            errno = EAGAIN;
+        } else {
+            for (i = 0; i < nb_started; i++) {
+                if (workers[i].rc == -1) {
+                    rc = -1;
+                    errno = workers[i].saved_errno;
+                    break;
+                }
+            }
+        }
+
+        server->running = 0;
+    }
+
+    {
+        int saved_errno = errno;
+
+        for (i = 0; i < nb_workers; i++) {
+            worker_close(&workers[i]);
+            if (i > 0 && workers[i].ctx != NULL)
+                modbus_free(workers[i].ctx);
+        }
+        free(workers);
+
+        /* Resets the stop request */
+        if (read(server->stop_fd, &value, sizeof(value)) == -1) {
+            /* Not requested */
+        }
+
+        errno = saved_errno;
+    }
+
+    return rc;
+#else
+    errno = ENOTSUP;
+    return -1;
+#endif
+}
+
+/* Can be called from another thread or a signal handler */
+int modbus_server_stop(modbus_server_t *server)
+{
+#ifdef _MODBUS_SERVER_EPOLL
+    uint64_t value = 1;
+
+    if (server == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (write(server->stop_fd, &value, sizeof(value)) != sizeof(value)) {
+        return -1;
+    }
+
+    return 0;
+#else
+    errno = ENOTSUP;
+    return -1;
+#endif
+}
+
+/* Gives an exclusive access to the mapping of a running server, the
+   requests are not processed until modbus_server_unlock_mapping is
+   called */
+int modbus_server_lock_mapping(modbus_server_t *server)
+{
+    if (server == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+#ifdef _MODBUS_SERVER_THREADS
+    if (pthread_rwlock_wrlock(&server->mapping_lock) != 0) {
+        errno = EINVAL;
+        return -1;
+    }
+#endif
+
+    return 0;
+}
+
+int modbus_server_unlock_mapping(modbus_server_t *server)
+{
+    if (server == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+#ifdef _MODBUS_SERVER_THREADS
+    if (pthread_rwlock_unlock(&server->mapping_lock) != 0) {
+        errno = EINVAL;
+        return -1;
+    }
+#endif
+
+    return 0;
+}
+
+void modbus_server_free(modbus_server_t *server)
+{
+    if (server == NULL)
+        return;
+
+#ifdef _MODBUS_SERVER_EPOLL
+    close(server->stop_fd);
+#endif
+#ifdef _MODBUS_SERVER_THREADS
+    pthread_rwlock_destroy(&server->mapping_lock);
+#endif
+    free(server);
+}
@@ -0,0 +1,42 @@
+/*
+ * Copyright © 2001-2011 Stéphane Raimbault <stephane.raimbault@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef _MODBUS_SERVER_H_
+#define _MODBUS_SERVER_H_
+
+#include "modbus.h"
+
+MODBUS_BEGIN_DECLS
+
+/* Event driven Modbus/TCP server serving many connections from one or
+   several threads */
+typedef struct _modbus_server modbus_server_t;
+
+MODBUS_API modbus_server_t* modbus_server_new(modbus_t *ctx,
+                                              modbus_mapping_t *mb_mapping);
+MODBUS_API int modbus_server_set_nb_threads(modbus_server_t *server, int nb_threads);
+MODBUS_API int modbus_server_get_nb_threads(modbus_server_t *server);
+MODBUS_API int modbus_server_run(modbus_server_t *server);
+MODBUS_API int modbus_server_stop(modbus_server_t *server);
+MODBUS_API int modbus_server_lock_mapping(modbus_server_t *server);
+MODBUS_API int modbus_server_unlock_mapping(modbus_server_t *server);
+MODBUS_API void modbus_server_free(modbus_server_t *server);
+
+MODBUS_END_DECLS
+
+#endif /* _MODBUS_SERVER_H_ */
@@ -25,14 +25,45 @@
 
 #define _MODBUS_TCP_CHECKSUM_LENGTH    0
 
-/* In both structures, the transaction ID must be placed on first position
-   to have a quick access not dependant of the TCP backend */
+/* Size of the receive buffer of a connection, a single recv() can read
+   several pipelined ADUs in read-ahead mode */
+#define _MODBUS_TCP_RBUF_LENGTH (8 * MODBUS_TCP_MAX_ADU_LENGTH)
+
+/* Bytes read from the socket s and not yet consumed (from start to end) */
+typedef struct _modbus_tcp_rbuf {
+    /* Set by modbus_tcp_set_read_ahead(), otherwise only the bytes asked
+       are read from the socket */
+    int read_ahead;
+    int s;
+    int start;
+    int end;
+    uint8_t data[_MODBUS_TCP_RBUF_LENGTH];
+} _modbus_tcp_rbuf_t;
+
+/* Size of the queue of the messages sent in batching mode */
+#define _MODBUS_TCP_WBUF_LENGTH (8 * MODBUS_TCP_MAX_ADU_LENGTH)
+
+/* Messages queued for the socket s in batching mode */
+typedef struct _modbus_tcp_wbuf {
+    int enabled;
+    int s;
+    int length;
+    uint8_t data[_MODBUS_TCP_WBUF_LENGTH];
+} _modbus_tcp_wbuf_t;
+
+/* In both structures, the transaction ID and the buffers must be placed on
+   first positions to have a quick access not dependant of the TCP
+   backend */
 typedef struct _modbus_tcp {
     /* Extract from MODBUS Messaging on TCP/IP Implementation Guide V1.0b
        (page 23/46):
        The transaction identifier is used to associate the future response
        with the request. This identifier is unique on each TCP connection. */
     uint16_t t_id;
+    /* Receive buffer */
+    _modbus_tcp_rbuf_t rbuf;
+    /* Send queue */
+    _modbus_tcp_wbuf_t wbuf;
     /* TCP port */
     int port;
     /* IP address */
@@ -45,6 +76,10 @@ typedef struct _modbus_tcp {
 typedef struct _modbus_tcp_pi {
     /* Transaction ID */
     uint16_t t_id;
+    /* Receive buffer */
+    _modbus_tcp_rbuf_t rbuf;
+    /* Send queue */
+    _modbus_tcp_wbuf_t wbuf;
     /* TCP port */
     int port;
     /* Node */
@@ -53,4 +88,10 @@ typedef struct _modbus_tcp_pi {
     char service[_MODBUS_TCP_PI_SERVICE_LENGTH];
 } modbus_tcp_pi_t;
 
+/* Flags of _modbus_tcp_listen */
+#define _MODBUS_TCP_LISTEN_REUSEPORT  (1 << 0)
+
+int _modbus_tcp_listen(modbus_t *ctx, int nb_connection, int flags);
+modbus_t* _modbus_tcp_clone(modbus_t *ctx);
+
 #endif /* _MODBUS_TCP_PRIVATE_H_ */
@@ -58,6 +58,14 @@
 #define MSG_NOSIGNAL 0
 #endif
 
+#if HAVE_LINUX_IO_URING_H && HAVE_SYS_MMAN_H && HAVE_SYS_SYSCALL_H
+# define _MODBUS_TCP_URING
+# include <fcntl.h>
+# include <sys/mman.h>
+# include <sys/syscall.h>
+# include <linux/io_uring.h>
+#endif
+
 #include "modbus-private.h"
 
 #include "modbus-tcp.h"
@@ -171,8 +179,54 @@ static int _modbus_tcp_send_msg_pre(uint8_t *req, int req_length)
     return req_length;
 }
 
+static _modbus_tcp_wbuf_t *_modbus_tcp_get_wbuf(modbus_t *ctx)
+{
+    return &((modbus_tcp_t *)ctx->backend_data)->wbuf;
+}
+
+/* Sends the queued messages with a single send() (several ones only if the
+   socket buffer is full) */
+static int _modbus_tcp_flush_wbuf(modbus_t *ctx)
+{
+    _modbus_tcp_wbuf_t *wbuf = _modbus_tcp_get_wbuf(ctx);
+    int offset = 0;
+
+    while (offset < wbuf->length) {
+        ssize_t rc = send(wbuf->s, (const char*)wbuf->data + offset,
+                          wbuf->length - offset, MSG_NOSIGNAL);
+        if (rc == -1) {
+            if (errno == EINTR)
+                continue;
+            wbuf->length = 0;
+            return -1;
+        }
+        offset += rc;
+    }
+    wbuf->length = 0;
+
+    return 0;
+}
+
 static ssize_t _modbus_tcp_send(modbus_t *ctx, const uint8_t *req, int req_length)
 {
+    _modbus_tcp_wbuf_t *wbuf = _modbus_tcp_get_wbuf(ctx);
+
+    /* The message is sent with the next ones when the context waits for
+       incoming data, except for the asynchronous requests since the
+       application waits for the socket by its own means */
+    if (wbuf->enabled && ctx->async == NULL) {
+        if (wbuf->length > 0 &&
+            (wbuf->s != ctx->s ||
+             wbuf->length + req_length > _MODBUS_TCP_WBUF_LENGTH)) {
+            if (_modbus_tcp_flush_wbuf(ctx) == -1 && wbuf->s == ctx->s)
+                return -1;
+        }
+        memcpy(wbuf->data + wbuf->length, req, req_length);
+        wbuf->s = ctx->s;
+        wbuf->length += req_length;
+        return req_length;
+    }
+
     /* MSG_NOSIGNAL
        Requests not to send SIGPIPE on errors on stream oriented
        sockets when the other end breaks the connection.  The EPIPE
@@ -184,8 +238,86 @@ static int _modbus_tcp_receive(modbus_t *ctx, uint8_t *req, int* pIsActive) {
     return _modbus_receive_msg(ctx, req, MSG_INDICATION, pIsActive);
 }
 
+/* The receive buffer is placed at the same position in both TCP backends */
+static _modbus_tcp_rbuf_t *_modbus_tcp_get_rbuf(modbus_t *ctx)
+{
+    return &((modbus_tcp_t *)ctx->backend_data)->rbuf;
+}
+
+/* Forgets the bytes received and the messages queued on the previous
+   connection */
+static void _modbus_tcp_reset_buffers(modbus_t *ctx)
+{
+    _modbus_tcp_rbuf_t *rbuf = _modbus_tcp_get_rbuf(ctx);
+    _modbus_tcp_wbuf_t *wbuf = _modbus_tcp_get_wbuf(ctx);
+
+    rbuf->s = -1;
+    rbuf->start = 0;
+    rbuf->end = 0;
+
+    wbuf->length = 0;
+}
+
+/* The buffered bytes belong to the socket they have been read from, they're
+   dropped when the socket of the context changes */
+static _modbus_tcp_rbuf_t *_modbus_tcp_sync_rbuf(modbus_t *ctx)
+{
+    _modbus_tcp_rbuf_t *rbuf = _modbus_tcp_get_rbuf(ctx);
+
+    if (rbuf->s != ctx->s) {
+        rbuf->s = ctx->s;
+        rbuf->start = 0;
+        rbuf->end = 0;
+    }
+
+    return rbuf;
+}
+
+/* Returns the number of buffered bytes of the socket of the context */
+static int _modbus_tcp_rbuf_length(modbus_t *ctx)
+{
+    _modbus_tcp_rbuf_t *rbuf = _modbus_tcp_sync_rbuf(ctx);
+
+    return rbuf->end - rbuf->start;
+}
+
+/* Consumes up to rsp_length buffered bytes */
+static int _modbus_tcp_rbuf_read(_modbus_tcp_rbuf_t *rbuf, uint8_t *rsp,
+                                 int rsp_length)
+{
+    int length = rbuf->end - rbuf->start;
+
+    if (length > rsp_length)
+        length = rsp_length;
+    memcpy(rsp, rbuf->data + rbuf->start, length);
+    rbuf->start += length;
+
+    return length;
+}
+
+/* In read-ahead mode, the steps of _modbus_receive_msg are served from the
+   receive buffer, the socket is read only when the buffer is empty and then as
+   much as possible so a single recv() brings the whole ADU, or several ones
+   when the requests are pipelined. Otherwise the bytes stay in the socket
+   until they're asked, so the waits of the application on the socket see
+   each pending message. */
 static ssize_t _modbus_tcp_recv(modbus_t *ctx, uint8_t *rsp, int rsp_length) {
-    return recv(ctx->s, (char *)rsp, rsp_length, 0);
+    _modbus_tcp_rbuf_t *rbuf = _modbus_tcp_sync_rbuf(ctx);
+
+    if (rbuf->start == rbuf->end) {
+        if (!rbuf->read_ahead)
+            return recv(ctx->s, (char *)rsp, rsp_length, 0);
+
+        ssize_t rc = recv(ctx->s, (char *)rbuf->data, _MODBUS_TCP_RBUF_LENGTH, 0);
+        if (rc <= 0) {
+            rbuf->start = rbuf->end = 0;
+            return rc;
+        }
+        rbuf->start = 0;
+        rbuf->end = rc;
+    }
+
+    return _modbus_tcp_rbuf_read(rbuf, rsp, rsp_length);
 }
 
 static int _modbus_tcp_check_integrity(modbus_t *ctx, uint8_t *msg, const int msg_length)
@@ -268,26 +400,21 @@ static int _connect(int sockfd, const struct sockaddr *addr, socklen_t addrlen,
 #else
     if (rc == -1 && errno == EINPROGRESS) {
 #endif
-        fd_set wset;
         int optval;
         socklen_t optlen = sizeof(optval);
 
-        /* Wait to be available in writing */
-        FD_ZERO(&wset);
-        FD_SET(sockfd, &wset);
-
-	struct timeval org;
-        org.tv_sec = tv->tv_sec;
-        org.tv_usec = tv->tv_usec;
-        
-        rc = select(sockfd + 1, NULL, &wset, NULL, tv);
-        
-        tv->tv_sec = org.tv_sec;
-        tv->tv_usec = org.tv_usec;
-
+        if (tv == NULL) {
+            /* Completed by _modbus_tcp_connect_finish() */
+            errno = EINPROGRESS;
+            return -1;
+        }
 
-        if (rc <= 0) {
-            /* Timeout or fail */
+        /* Wait to be available in writing */
+        rc = _modbus_wait(sockfd, _MODBUS_WAIT_WRITE, tv, NULL, -1);
+        if (rc == 0) {
+            errno = ETIMEDOUT;
+            return -1;
+        } else if (rc == -1) {
             return -1;
         }
 
@@ -303,8 +430,10 @@ static int _connect(int sockfd, const struct sockaddr *addr, socklen_t addrlen,
     return rc;
 }
 
-/* Establishes a modbus TCP connection with a Modbus server. */
-static int _modbus_tcp_connect(modbus_t *ctx)
+/* Establishes a modbus TCP connection with a Modbus server. Without timeout
+   tv, the connection isn't waited for: -1 is returned with errno set to
+   EINPROGRESS and the socket is kept. */
+static int _modbus_tcp_open(modbus_t *ctx, struct timeval *tv)
 {
     int rc;
     /* Specialized version of sockaddr for Internet socket address (same size) */
@@ -326,6 +455,8 @@ static int _modbus_tcp_connect(modbus_t *ctx)
     flags |= SOCK_NONBLOCK;
 #endif
 
+    _modbus_tcp_reset_buffers(ctx);
+
     ctx->s = socket(PF_INET, flags, 0);
     if (ctx->s == -1) {
         return -1;
@@ -345,8 +476,10 @@ static int _modbus_tcp_connect(modbus_t *ctx)
     addr.sin_family = AF_INET;
     addr.sin_port = htons(ctx_tcp->port);
     addr.sin_addr.s_addr = inet_addr(ctx_tcp->ip);
-    rc = _connect(ctx->s, (struct sockaddr *)&addr, sizeof(addr), &ctx->response_timeout);
+    rc = _connect(ctx->s, (struct sockaddr *)&addr, sizeof(addr), tv);
     if (rc == -1) {
+        if (tv == NULL && errno == EINPROGRESS)
+            return -1;
         close(ctx->s);
         ctx->s = -1;
         return -1;
@@ -355,10 +488,18 @@ static int _modbus_tcp_connect(modbus_t *ctx)
     return 0;
 }
 
-/* Establishes a modbus TCP PI connection with a Modbus server. */
-static int _modbus_tcp_pi_connect(modbus_t *ctx)
+static int _modbus_tcp_connect(modbus_t *ctx)
+{
+    return _modbus_tcp_open(ctx, &ctx->response_timeout);
+}
+
+/* Establishes a modbus TCP PI connection with a Modbus server. Without
+   timeout tv, the connection to the first address accepting it isn't waited
+   for (see _modbus_tcp_open). */
+static int _modbus_tcp_pi_open(modbus_t *ctx, struct timeval *tv)
 {
     int rc;
+    int saved_errno = ECONNREFUSED;
     struct addrinfo *ai_list;
     struct addrinfo *ai_ptr;
     struct addrinfo ai_hints;
@@ -370,6 +511,8 @@ static int _modbus_tcp_pi_connect(modbus_t *ctx)
     }
 #endif
 
+    _modbus_tcp_reset_buffers(ctx);
+
     memset(&ai_hints, 0, sizeof(ai_hints));
 #ifdef AI_ADDRCONFIG
     ai_hints.ai_flags |= AI_ADDRCONFIG;
@@ -414,8 +557,13 @@ static int _modbus_tcp_pi_connect(modbus_t *ctx)
             printf("Connecting to [%s]:%s\n", ctx_tcp_pi->node, ctx_tcp_pi->service);
         }
 
-        rc = _connect(s, ai_ptr->ai_addr, ai_ptr->ai_addrlen, &ctx->response_timeout);
+        rc = _connect(s, ai_ptr->ai_addr, ai_ptr->ai_addrlen, tv);
         if (rc == -1) {
+            saved_errno = errno;
+            if (tv == NULL && errno == EINPROGRESS) {
+                ctx->s = s;
+                break;
+            }
             close(s);
             continue;
         }
@@ -426,16 +574,82 @@ static int _modbus_tcp_pi_connect(modbus_t *ctx)
 
     freeaddrinfo(ai_list);
 
-    if (ctx->s < 0) {
+    if (ctx->s < 0 || rc == -1) {
+        errno = saved_errno;
         return -1;
     }
 
     return 0;
 }
 
+static int _modbus_tcp_pi_connect(modbus_t *ctx)
+{
+    return _modbus_tcp_pi_open(ctx, &ctx->response_timeout);
+}
+
+/* Completes a connection started without timeout, -1 is returned with errno
+   set to EINPROGRESS while the connection is pending */
+static int _modbus_tcp_connect_finish(modbus_t *ctx)
+{
+    struct timeval tv;
+    int optval;
+    socklen_t optlen = sizeof(optval);
+    int rc;
+
+    tv.tv_sec = 0;
+    tv.tv_usec = 0;
+    rc = _modbus_wait(ctx->s, _MODBUS_WAIT_WRITE, &tv, NULL, -1);
+    if (rc == 0) {
+        errno = EINPROGRESS;
+        return -1;
+    }
+
+    if (rc == 1) {
+        rc = getsockopt(ctx->s, SOL_SOCKET, SO_ERROR, (void *)&optval, &optlen);
+        if (rc == 0 && optval != 0) {
+            errno = optval;
+            rc = -1;
+        }
+    }
+
+    if (rc == -1) {
+        int saved_errno = errno;
+
+        close(ctx->s);
+        ctx->s = -1;
+        errno = saved_errno;
+        return -1;
+    }
+
+    return 0;
+}
+
+static int _modbus_tcp_connect_async(modbus_t *ctx)
+{
+    if (ctx->s == -1)
+        return _modbus_tcp_open(ctx, NULL);
+
+    return _modbus_tcp_connect_finish(ctx);
+}
+
+static int _modbus_tcp_pi_connect_async(modbus_t *ctx)
+{
+    if (ctx->s == -1)
+        return _modbus_tcp_pi_open(ctx, NULL);
+
+    return _modbus_tcp_connect_finish(ctx);
+}
+
 /* Closes the network connection and socket in TCP mode */
 static void _modbus_tcp_close(modbus_t *ctx)
 {
+    _modbus_tcp_wbuf_t *wbuf = _modbus_tcp_get_wbuf(ctx);
+
+    /* The queued messages are sent before closing */
+    if (wbuf->length > 0 && wbuf->s == ctx->s)
+        _modbus_tcp_flush_wbuf(ctx);
+    _modbus_tcp_reset_buffers(ctx);
+
     if (ctx->s != -1) {
         shutdown(ctx->s, SHUT_RDWR);
         close(ctx->s);
@@ -446,7 +660,10 @@ static void _modbus_tcp_close(modbus_t *ctx)
 static int _modbus_tcp_flush(modbus_t *ctx)
 {
     int rc;
-    int rc_sum = 0;
+    int rc_sum = _modbus_tcp_rbuf_length(ctx);
+    _modbus_tcp_rbuf_t *rbuf = _modbus_tcp_get_rbuf(ctx);
+
+    rbuf->start = rbuf->end = 0;
 
     do {
         /* Extract the garbage from the socket */
@@ -480,19 +697,37 @@ static int _modbus_tcp_flush(modbus_t *ctx)
     return rc_sum;
 }
 
-/* Listens for any request from one or many modbus masters in TCP */
-int modbus_tcp_listen(modbus_t *ctx, int nb_connection)
+/* Enables the options of the listening socket requested by flags */
+static int _modbus_tcp_set_listen_options(int s, int flags)
 {
-    int new_s;
-    int yes;
-    struct sockaddr_in addr;
-    modbus_tcp_t *ctx_tcp;
+    int yes = 1;
 
-    if (ctx == NULL) {
-        errno = EINVAL;
+    if (setsockopt(s, SOL_SOCKET, SO_REUSEADDR,
+                   (char *) &yes, sizeof(yes)) == -1) {
+        return -1;
+    }
+
+    if (flags & _MODBUS_TCP_LISTEN_REUSEPORT) {
+#ifdef SO_REUSEPORT
+        if (setsockopt(s, SOL_SOCKET, SO_REUSEPORT,
+                       (char *) &yes, sizeof(yes)) == -1) {
+            return -1;
+        }
+#else
+        errno = ENOTSUP;
         return -1;
+#endif
     }
 
+    return 0;
+}
+
+static int _modbus_tcp_listen_ipv4(modbus_t *ctx, int nb_connection, int flags)
+{
+    int new_s;
+    struct sockaddr_in addr;
+    modbus_tcp_t *ctx_tcp;
+
     ctx_tcp = ctx->backend_data;
 
 #ifdef OS_WIN32
@@ -506,10 +741,10 @@ int modbus_tcp_listen(modbus_t *ctx, int nb_connection)
         return -1;
     }
 
-    yes = 1;
-    if (setsockopt(new_s, SOL_SOCKET, SO_REUSEADDR,
-                   (char *) &yes, sizeof(yes)) == -1) {
+    if (_modbus_tcp_set_listen_options(new_s, flags) == -1) {
+        int saved_errno = errno;
         close(new_s);
+        errno = saved_errno;
         return -1;
     }
 
@@ -531,7 +766,18 @@ int modbus_tcp_listen(modbus_t *ctx, int nb_connection)
     return new_s;
 }
 
-int modbus_tcp_pi_listen(modbus_t *ctx, int nb_connection)
+/* Listens for any request from one or many modbus masters in TCP */
+int modbus_tcp_listen(modbus_t *ctx, int nb_connection)
+{
+    if (ctx == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    return _modbus_tcp_listen_ipv4(ctx, nb_connection, 0);
+}
+
+static int _modbus_tcp_listen_pi(modbus_t *ctx, int nb_connection, int flags)
 {
     int rc;
     struct addrinfo *ai_list;
@@ -542,11 +788,6 @@ int modbus_tcp_pi_listen(modbus_t *ctx, int nb_connection)
     int new_s;
     modbus_tcp_pi_t *ctx_tcp_pi;
 
-    if (ctx == NULL) {
-        errno = EINVAL;
-        return -1;
-    }
-
     ctx_tcp_pi = ctx->backend_data;
 
     if (ctx_tcp_pi->node[0] == 0)
@@ -592,9 +833,7 @@ int modbus_tcp_pi_listen(modbus_t *ctx, int nb_connection)
             }
             continue;
         } else {
-            int yes = 1;
-            rc = setsockopt(s, SOL_SOCKET, SO_REUSEADDR,
-                            (void *) &yes, sizeof (yes));
+            rc = _modbus_tcp_set_listen_options(s, flags);
             if (rc != 0) {
                 close(s);
                 if (ctx->debug) {
@@ -634,6 +873,16 @@ int modbus_tcp_pi_listen(modbus_t *ctx, int nb_connection)
     return new_s;
 }
 
+int modbus_tcp_pi_listen(modbus_t *ctx, int nb_connection)
+{
+    if (ctx == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    return _modbus_tcp_listen_pi(ctx, nb_connection, 0);
+}
+
 /* On success, the function return a non-negative integer that is a descriptor
 for the accepted socket. On error, socket is set to -1, -1 is returned and errno
 is set appropriately. */
@@ -641,6 +890,7 @@ int modbus_tcp_accept(modbus_t *ctx, int *s)
 {
     struct sockaddr_in addr;
     socklen_t addrlen;
+    int option;
 
     if (ctx == NULL) {
         errno = EINVAL;
@@ -661,6 +911,13 @@ int modbus_tcp_accept(modbus_t *ctx, int *s)
                inet_ntoa(addr.sin_addr));
     }
 
+    /* Responses are sent as soon as they are built */
+    option = 1;
+    setsockopt(a, IPPROTO_TCP, TCP_NODELAY, (const void *)&option, sizeof(int));
+
+    /* The responses queued for the previous connection are sent */
+    _modbus_tcp_flush_wbuf(ctx);
+    _modbus_tcp_reset_buffers(ctx);
     ctx->s = a;
     return a;
 }
@@ -669,17 +926,26 @@ int modbus_tcp_pi_accept(modbus_t *ctx, int *s)
 {
     struct sockaddr_storage addr;
     socklen_t addrlen;
+    int option;
 
     if (ctx == NULL) {
         errno = EINVAL;
         return -1;
     }
 
+    _modbus_tcp_flush_wbuf(ctx);
+    _modbus_tcp_reset_buffers(ctx);
+
     addrlen = sizeof(addr);
     ctx->s = accept(*s, (void *)&addr, &addrlen);
     if (ctx->s == -1) {
         close(*s);
         *s = -1;
+    } else {
+        /* Responses are sent as soon as they are built */
+        option = 1;
+        setsockopt(ctx->s, IPPROTO_TCP, TCP_NODELAY,
+                   (const void *)&option, sizeof(int));
     }
 
     if (ctx->debug) {
@@ -689,46 +955,97 @@ int modbus_tcp_pi_accept(modbus_t *ctx, int *s)
     return ctx->s;
 }
 
-static int _modbus_tcp_select(modbus_t *ctx, fd_set *rset, struct timeval *tv, int length_to_read, int* pIsActive)
+int modbus_tcp_set_reply_batching(modbus_t *ctx, int enable)
 {
-    int s_rc;
-    struct timeval* pTV = tv;
-    struct timeval timeVal;
-    timeVal.tv_sec = 1;
-    timeVal.tv_usec = 0;
-    if (!pTV && pIsActive)
-        pTV = &timeVal;
-
-    s_rc = select(ctx->s+1, rset, NULL, NULL, pTV);
-    while ((s_rc == -1) // Repeat as long as an error occured
-        || (pIsActive && *pIsActive && s_rc == 0 && pTV == &timeVal)) // OR: While pIsActive is a valid pointer and points to a true-value and the 1sec timeout occured
-    {
-        if (s_rc == -1)
-        {
-            if (errno == EINTR) {
-                if (ctx->debug) {
-                    fprintf(stderr, "A non blocked signal was caught\n");
-                }
-                /* Necessary after an error */
-                FD_ZERO(rset);
-                FD_SET(ctx->s, rset);
-            } else {
-                return -1;
-            }
+    _modbus_tcp_wbuf_t *wbuf;
+
+    if (ctx == NULL ||
+        ctx->backend->backend_type != _MODBUS_BACKEND_TYPE_TCP) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    wbuf = _modbus_tcp_get_wbuf(ctx);
+    if (!enable && wbuf->length > 0) {
+        if (_modbus_tcp_flush_wbuf(ctx) == -1) {
+            wbuf->enabled = FALSE;
+            return -1;
         }
+    }
+    wbuf->enabled = enable ? TRUE : FALSE;
+
+    return 0;
+}
+
+int modbus_tcp_set_read_ahead(modbus_t *ctx, int enable)
+{
+    if (ctx == NULL ||
+        ctx->backend->backend_type != _MODBUS_BACKEND_TYPE_TCP) {
+        errno = EINVAL;
+        return -1;
+    }
 
-        if (s_rc == -1
-            || (pIsActive && *pIsActive && s_rc == 0 && pTV == &timeVal))
-        {
-            timeVal.tv_sec = 1;
-            timeVal.tv_usec = 0;
-            /* Necessary after a timeout */
-            FD_ZERO(rset);
-            FD_SET(ctx->s, rset);
-            s_rc = select(ctx->s+1, rset, NULL, NULL, pTV);
+    /* The bytes already buffered are still consumed first */
+    _modbus_tcp_get_rbuf(ctx)->read_ahead = enable ? TRUE : FALSE;
+
+    return 0;
+}
+
+/* The bytes buffered for the previous socket are dropped, the application
+   may have closed it and got the same descriptor for a new connection */
+static void _modbus_tcp_set_socket(modbus_t *ctx, int s)
+{
+    _modbus_tcp_rbuf_t *rbuf = _modbus_tcp_get_rbuf(ctx);
+
+    ctx->s = s;
+    rbuf->s = s;
+    rbuf->start = 0;
+    rbuf->end = 0;
+}
+
+/* Returns the number of bytes received on the socket and not read yet */
+static int _modbus_tcp_nb_pending(int s)
+{
+#ifdef OS_WIN32
+    u_long nb_bytes = 0;
+
+    if (ioctlsocket(s, FIONREAD, &nb_bytes) != 0)
+        return 0;
+    return (int)nb_bytes;
+#else
+    int nb_bytes = 0;
+
+    if (ioctl(s, FIONREAD, &nb_bytes) == -1)
+        return 0;
+    return nb_bytes;
+#endif
+}
+
+static int _modbus_tcp_wait(modbus_t *ctx, struct timeval *tv, int length_to_read, int* pIsActive)
+{
+    _modbus_tcp_wbuf_t *wbuf = _modbus_tcp_get_wbuf(ctx);
+    int s_rc;
+
+    if (_modbus_tcp_rbuf_length(ctx) > 0) {
+        /* The next bytes are already buffered */
+        return 1;
+    }
+
+    if (wbuf->length > 0) {
+        /* The next request is already received (pipelined), its response
+           will be queued with the others */
+        if (wbuf->s == ctx->s && _modbus_tcp_nb_pending(ctx->s) > 0)
+            return 1;
+
+        /* No more pending request to answer, the queued messages are sent
+           before waiting */
+        if (_modbus_tcp_flush_wbuf(ctx) == -1 && wbuf->s == ctx->s) {
+            return -1;
         }
     }
 
+    s_rc = _modbus_wait(ctx->s, _MODBUS_WAIT_READ, tv, pIsActive,
+                        _modbus_cancel_fd(ctx));
     if (s_rc == 0) {
         errno = ETIMEDOUT;
         return -1;
@@ -742,6 +1059,481 @@ static void _modbus_tcp_free(modbus_t *ctx) {
     free(ctx);
 }
 
+#ifdef _MODBUS_TCP_URING
+/* io_uring backend (Linux)
+
+   The requests and responses go through an io_uring set up with the raw
+   system calls. The messages sent are queued in a send buffer and, when the
+   context waits for incoming data, the send, the read into the (registered)
+   receive buffer and the timeout are submitted linked together so a
+   request/response pair costs a single io_uring_enter() call. */
+
+#define _MODBUS_URING_ENTRIES 8
+
+/* Tags of the submissions (user_data) */
+#define _MODBUS_URING_SEND    1
+#define _MODBUS_URING_RECV    2
+#define _MODBUS_URING_TIMEOUT 3
+
+typedef struct _modbus_uring {
+    int fd;
+    /* Enabled by the first transfer */
+    int disabled;
+    /* The receive buffer is registered as fixed buffer 0 */
+    int fixed;
+    /* Submission queue */
+    void *sq_ptr;
+    size_t sq_size;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    struct io_uring_sqe *sqes;
+    size_t sqes_size;
+    /* Completion queue */
+    void *cq_ptr;
+    size_t cq_size;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_cqe *cqes;
+    /* Result of the last read when it didn't bring any byte */
+    int recv_res;
+    struct __kernel_timespec ts;
+    /* Messages to send to the socket sbuf_s */
+    int sbuf_s;
+    int sbuf_length;
+    uint8_t sbuf[_MODBUS_TCP_WBUF_LENGTH];
+} _modbus_uring_t;
+
+/* The TCP data must be placed first to be shared with the TCP backend */
+typedef struct _modbus_tcp_uring {
+    modbus_tcp_t tcp;
+    _modbus_uring_t uring;
+} modbus_tcp_uring_t;
+
+static _modbus_uring_t *_modbus_tcp_get_uring(modbus_t *ctx)
+{
+    return &((modbus_tcp_uring_t *)ctx->backend_data)->uring;
+}
+
+static int _modbus_uring_setup(_modbus_uring_t *uring, _modbus_tcp_rbuf_t *rbuf)
+{
+    struct io_uring_params p;
+    struct iovec iov;
+
+    /* The completions are processed in io_uring_enter() by the thread using
+       the context (Linux 6.1), enabled by the first transfer so that the
+       context can be created by another thread */
+    memset(&p, 0, sizeof(p));
+    p.flags = IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN |
+        IORING_SETUP_R_DISABLED;
+    uring->fd = syscall(__NR_io_uring_setup, _MODBUS_URING_ENTRIES, &p);
+    if (uring->fd == -1 && errno == EINVAL) {
+        memset(&p, 0, sizeof(p));
+        uring->fd = syscall(__NR_io_uring_setup, _MODBUS_URING_ENTRIES, &p);
+    }
+    if (uring->fd == -1)
+        return -1;
+    uring->disabled = (p.flags & IORING_SETUP_R_DISABLED) != 0;
+
+    uring->sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    uring->cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (uring->cq_size > uring->sq_size)
+            uring->sq_size = uring->cq_size;
+        uring->cq_size = uring->sq_size;
+    }
+
+    uring->sq_ptr = mmap(NULL, uring->sq_size, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, uring->fd,
+                         IORING_OFF_SQ_RING);
+    if (uring->sq_ptr == MAP_FAILED) {
+        close(uring->fd);
+        return -1;
+    }
+
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        uring->cq_ptr = uring->sq_ptr;
+    } else {
+        uring->cq_ptr = mmap(NULL, uring->cq_size, PROT_READ | PROT_WRITE,
+                             MAP_SHARED | MAP_POPULATE, uring->fd,
+                             IORING_OFF_CQ_RING);
+        if (uring->cq_ptr == MAP_FAILED) {
+            munmap(uring->sq_ptr, uring->sq_size);
+            close(uring->fd);
+            return -1;
+        }
+    }
+
+    uring->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    uring->sqes = mmap(NULL, uring->sqes_size, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, uring->fd, IORING_OFF_SQES);
+    if (uring->sqes == MAP_FAILED) {
+        if (uring->cq_ptr != uring->sq_ptr)
+            munmap(uring->cq_ptr, uring->cq_size);
+        munmap(uring->sq_ptr, uring->sq_size);
+        close(uring->fd);
+        return -1;
+    }
+
+    uring->sq_tail = (unsigned *)((char *)uring->sq_ptr + p.sq_off.tail);
+    uring->sq_mask = (unsigned *)((char *)uring->sq_ptr + p.sq_off.ring_mask);
+    uring->sq_array = (unsigned *)((char *)uring->sq_ptr + p.sq_off.array);
+    uring->cq_head = (unsigned *)((char *)uring->cq_ptr + p.cq_off.head);
+    uring->cq_tail = (unsigned *)((char *)uring->cq_ptr + p.cq_off.tail);
+    uring->cq_mask = (unsigned *)((char *)uring->cq_ptr + p.cq_off.ring_mask);
+    uring->cqes = (struct io_uring_cqe *)((char *)uring->cq_ptr + p.cq_off.cqes);
+
+    /* The reads are done in place in the receive buffer when it can be
+       registered (limited by RLIMIT_MEMLOCK) */
+    iov.iov_base = rbuf->data;
+    iov.iov_len = _MODBUS_TCP_RBUF_LENGTH;
+    uring->fixed = syscall(__NR_io_uring_register, uring->fd,
+                           IORING_REGISTER_BUFFERS, &iov, 1) == 0;
+
+    uring->recv_res = 0;
+    uring->sbuf_s = -1;
+    uring->sbuf_length = 0;
+
+    return 0;
+}
+
+static void _modbus_uring_free(_modbus_uring_t *uring)
+{
+    munmap(uring->sqes, uring->sqes_size);
+    if (uring->cq_ptr != uring->sq_ptr)
+        munmap(uring->cq_ptr, uring->cq_size);
+    munmap(uring->sq_ptr, uring->sq_size);
+    close(uring->fd);
+}
+
+/* Returns a cleared submission queue entry, the queue is never full since
+   at most 3 entries are submitted at once */
+static struct io_uring_sqe *_modbus_uring_get_sqe(_modbus_uring_t *uring,
+                                                  unsigned *tail)
+{
+    unsigned index = *tail & *uring->sq_mask;
+    struct io_uring_sqe *sqe = &uring->sqes[index];
+
+    memset(sqe, 0, sizeof(*sqe));
+    uring->sq_array[index] = index;
+    (*tail)++;
+
+    return sqe;
+}
+
+/* Sends the queued messages then, if rbuf isn't NULL, reads up to length
+   bytes of the socket into the receive buffer within the timeout tv (none if
+   NULL). Returns 1 when the read has completed, 0 on timeout or -1 if the send
+   has failed. */
+static int _modbus_uring_transfer(modbus_t *ctx, _modbus_tcp_rbuf_t *rbuf,
+                                  int length, const struct timeval *tv)
+{
+    _modbus_uring_t *uring = _modbus_tcp_get_uring(ctx);
+    struct io_uring_sqe *sqe;
+    unsigned tail = *uring->sq_tail;
+    int nb_sqes = 0;
+    int nb_cqes = 0;
+    int to_submit;
+    int send_errno = 0;
+    int recv_res = -ECANCELED;
+
+    if (uring->sbuf_length > 0) {
+        sqe = _modbus_uring_get_sqe(uring, &tail);
+        sqe->opcode = IORING_OP_SEND;
+        sqe->fd = uring->sbuf_s;
+        sqe->addr = (unsigned long)uring->sbuf;
+        sqe->len = uring->sbuf_length;
+        sqe->msg_flags = MSG_NOSIGNAL;
+        sqe->user_data = _MODBUS_URING_SEND;
+        if (rbuf != NULL)
+            sqe->flags = IOSQE_IO_LINK;
+        nb_sqes++;
+    }
+
+    if (rbuf != NULL) {
+        sqe = _modbus_uring_get_sqe(uring, &tail);
+        if (uring->fixed) {
+            sqe->opcode = IORING_OP_READ_FIXED;
+            sqe->buf_index = 0;
+        } else {
+            sqe->opcode = IORING_OP_RECV;
+        }
+        sqe->fd = ctx->s;
+        sqe->off = (unsigned long long)-1;
+        sqe->addr = (unsigned long)rbuf->data;
+        sqe->len = length;
+        sqe->user_data = _MODBUS_URING_RECV;
+        nb_sqes++;
+
+        if (tv != NULL) {
+            sqe->flags = IOSQE_IO_LINK;
+            uring->ts.tv_sec = tv->tv_sec;
+            uring->ts.tv_nsec = tv->tv_usec * 1000;
+            sqe = _modbus_uring_get_sqe(uring, &tail);
+            sqe->opcode = IORING_OP_LINK_TIMEOUT;
+            sqe->fd = -1;
+            sqe->addr = (unsigned long)&uring->ts;
+            sqe->len = 1;
+            sqe->user_data = _MODBUS_URING_TIMEOUT;
+            nb_sqes++;
+        }
+    }
+
+    if (nb_sqes == 0)
+        return 1;
+
+    if (uring->disabled) {
+        if (syscall(__NR_io_uring_register, uring->fd,
+                    IORING_REGISTER_ENABLE_RINGS, NULL, 0) == -1) {
+            return -1;
+        }
+        uring->disabled = FALSE;
+    }
+
+    __atomic_store_n(uring->sq_tail, tail, __ATOMIC_RELEASE);
+    to_submit = nb_sqes;
+
+    /* Each submission completes, even when cancelled by the failure of the
+       previous one of the chain or by the timeout */
+    while (nb_cqes < nb_sqes) {
+        unsigned head = *uring->cq_head;
+
+        if (head == __atomic_load_n(uring->cq_tail, __ATOMIC_ACQUIRE)) {
+            int rc = syscall(__NR_io_uring_enter, uring->fd, to_submit,
+                             nb_sqes - nb_cqes, IORING_ENTER_GETEVENTS,
+                             NULL, 0);
+            if (rc == -1) {
+                if (errno != EINTR)
+                    return -1;
+            } else {
+                to_submit = 0;
+            }
+            continue;
+        }
+
+        while (head != __atomic_load_n(uring->cq_tail, __ATOMIC_ACQUIRE)) {
+            struct io_uring_cqe *cqe = &uring->cqes[head & *uring->cq_mask];
+
+            if (cqe->user_data == _MODBUS_URING_SEND) {
+                if (cqe->res < 0) {
+                    send_errno = -cqe->res;
+                } else if (cqe->res != uring->sbuf_length) {
+                    send_errno = EMBBADDATA;
+                }
+            } else if (cqe->user_data == _MODBUS_URING_RECV) {
+                recv_res = cqe->res;
+            }
+            head++;
+            nb_cqes++;
+        }
+        __atomic_store_n(uring->cq_head, head, __ATOMIC_RELEASE);
+    }
+
+    uring->sbuf_length = 0;
+
+    if (send_errno != 0) {
+        errno = send_errno;
+        return -1;
+    }
+
+    if (rbuf == NULL)
+        return 1;
+
+    if (recv_res == -ECANCELED)
+        return 0;
+
+    rbuf->s = ctx->s;
+    rbuf->start = 0;
+    if (recv_res > 0) {
+        rbuf->end = recv_res;
+    } else {
+        /* Reported by the next call of recv */
+        rbuf->end = 0;
+        uring->recv_res = recv_res;
+    }
+
+    return 1;
+}
+
+static ssize_t _modbus_tcp_uring_send(modbus_t *ctx, const uint8_t *req,
+                                      int req_length)
+{
+    _modbus_uring_t *uring = _modbus_tcp_get_uring(ctx);
+
+    /* The messages are sent when the context waits for incoming data (linked
+       to the read of the response) */
+    if (uring->sbuf_length > 0 &&
+        (uring->sbuf_s != ctx->s ||
+         uring->sbuf_length + req_length > _MODBUS_TCP_WBUF_LENGTH)) {
+        if (_modbus_uring_transfer(ctx, NULL, 0, NULL) == -1 &&
+            uring->sbuf_s == ctx->s) {
+            return -1;
+        }
+    }
+
+    memcpy(uring->sbuf + uring->sbuf_length, req, req_length);
+    uring->sbuf_s = ctx->s;
+    uring->sbuf_length += req_length;
+
+    if (ctx->async != NULL) {
+        /* The application waits for the responses of the asynchronous
+           requests by its own means */
+        if (_modbus_uring_transfer(ctx, NULL, 0, NULL) == -1)
+            return -1;
+    }
+
+    return req_length;
+}
+
+static ssize_t _modbus_tcp_uring_recv(modbus_t *ctx, uint8_t *rsp,
+                                      int rsp_length)
+{
+    _modbus_tcp_rbuf_t *rbuf = _modbus_tcp_sync_rbuf(ctx);
+    _modbus_uring_t *uring = _modbus_tcp_get_uring(ctx);
+
+    if (rbuf->start == rbuf->end) {
+        /* End of file or error of the last read */
+        int res = uring->recv_res;
+
+        uring->recv_res = 0;
+        if (res < 0) {
+            errno = -res;
+            return -1;
+        }
+        return 0;
+    }
+
+    return _modbus_tcp_rbuf_read(rbuf, rsp, rsp_length);
+}
+
+static int _modbus_tcp_uring_wait(modbus_t *ctx, struct timeval *tv,
+                                  int length_to_read, int *pIsActive)
+{
+    _modbus_tcp_rbuf_t *rbuf = _modbus_tcp_sync_rbuf(ctx);
+    _modbus_uring_t *uring = _modbus_tcp_get_uring(ctx);
+    struct timeval one_sec;
+    const struct timeval *p_tv = tv;
+    int length = _MODBUS_TCP_RBUF_LENGTH;
+    int rc;
+
+    if (rbuf->start != rbuf->end) {
+        /* The next bytes are already buffered */
+        return 1;
+    }
+
+    /* Without read-ahead, only the bytes of the current step are read */
+    if (!rbuf->read_ahead && length_to_read > 0 &&
+        length_to_read < _MODBUS_TCP_RBUF_LENGTH) {
+        length = length_to_read;
+    }
+
+    if (uring->sbuf_length > 0 && uring->sbuf_s != ctx->s) {
+        if (_modbus_uring_transfer(ctx, NULL, 0, NULL) == -1 &&
+            uring->sbuf_s == ctx->s) {
+            return -1;
+        }
+    }
+
+    if (ctx->cancel != NULL) {
+        /* The ring can't wait for the cancel handle so the queued messages
+           are sent then the socket is polled, the read completes at once */
+        if (uring->sbuf_length > 0 &&
+            _modbus_uring_transfer(ctx, NULL, 0, NULL) == -1) {
+            return -1;
+        }
+        rc = _modbus_wait(ctx->s, _MODBUS_WAIT_READ, tv, pIsActive,
+                          ctx->cancel->fd_read);
+        if (rc == 0) {
+            errno = ETIMEDOUT;
+            return -1;
+        } else if (rc == -1) {
+            return -1;
+        }
+        return _modbus_uring_transfer(ctx, rbuf, length, NULL);
+    }
+
+    /* As the TCP backend, checks pIsActive every second */
+    if (p_tv == NULL && pIsActive != NULL) {
+        one_sec.tv_sec = 1;
+        one_sec.tv_usec = 0;
+        p_tv = &one_sec;
+    }
+
+    do {
+        rc = _modbus_uring_transfer(ctx, rbuf, length, p_tv);
+    } while (rc == 0 && p_tv == &one_sec && *pIsActive);
+
+    if (rc == 0) {
+        errno = ETIMEDOUT;
+        return -1;
+    }
+
+    return rc;
+}
+
+/* The submissions wait for the socket instead of failing with EAGAIN */
+static void _modbus_uring_set_blocking(modbus_t *ctx)
+{
+    int flags;
+
+    flags = fcntl(ctx->s, F_GETFL);
+    if (flags != -1)
+        fcntl(ctx->s, F_SETFL, flags & ~O_NONBLOCK);
+}
+
+static int _modbus_tcp_uring_connect(modbus_t *ctx)
+{
+    _modbus_uring_t *uring = _modbus_tcp_get_uring(ctx);
+
+    uring->sbuf_length = 0;
+    uring->recv_res = 0;
+
+    if (_modbus_tcp_connect(ctx) == -1)
+        return -1;
+
+    _modbus_uring_set_blocking(ctx);
+
+    return 0;
+}
+
+static int _modbus_tcp_uring_connect_async(modbus_t *ctx)
+{
+    _modbus_uring_t *uring = _modbus_tcp_get_uring(ctx);
+
+    if (ctx->s == -1) {
+        uring->sbuf_length = 0;
+        uring->recv_res = 0;
+    }
+
+    if (_modbus_tcp_connect_async(ctx) == -1)
+        return -1;
+
+    _modbus_uring_set_blocking(ctx);
+
+    return 0;
+}
+
+static void _modbus_tcp_uring_close(modbus_t *ctx)
+{
+    _modbus_uring_t *uring = _modbus_tcp_get_uring(ctx);
+
+    /* The queued messages are sent before closing */
+    if (uring->sbuf_length > 0 && uring->sbuf_s == ctx->s)
+        _modbus_uring_transfer(ctx, NULL, 0, NULL);
+    uring->sbuf_length = 0;
+    uring->recv_res = 0;
+
+    _modbus_tcp_close(ctx);
+}
+
+static void _modbus_tcp_uring_free(modbus_t *ctx)
+{
+    _modbus_uring_free(_modbus_tcp_get_uring(ctx));
+    _modbus_tcp_free(ctx);
+}
+#endif /* _MODBUS_TCP_URING */
+
 const modbus_backend_t _modbus_tcp_backend = {
     _MODBUS_BACKEND_TYPE_TCP,
     _MODBUS_TCP_HEADER_LENGTH,
@@ -758,9 +1550,11 @@ const modbus_backend_t _modbus_tcp_backend = {
     _modbus_tcp_check_integrity,
     _modbus_tcp_pre_check_confirmation,
     _modbus_tcp_connect,
+    _modbus_tcp_connect_async,
     _modbus_tcp_close,
+    _modbus_tcp_set_socket,
     _modbus_tcp_flush,
-    _modbus_tcp_select,
+    _modbus_tcp_wait,
     _modbus_tcp_free
 };
 
@@ -781,12 +1575,92 @@ const modbus_backend_t _modbus_tcp_pi_backend = {
     _modbus_tcp_check_integrity,
     _modbus_tcp_pre_check_confirmation,
     _modbus_tcp_pi_connect,
+    _modbus_tcp_pi_connect_async,
     _modbus_tcp_close,
+    _modbus_tcp_set_socket,
     _modbus_tcp_flush,
-    _modbus_tcp_select,
+    _modbus_tcp_wait,
     _modbus_tcp_free
 };
 
+#ifdef _MODBUS_TCP_URING
+const modbus_backend_t _modbus_tcp_uring_backend = {
+    _MODBUS_BACKEND_TYPE_TCP,
+    _MODBUS_TCP_HEADER_LENGTH,
+    _MODBUS_TCP_CHECKSUM_LENGTH,
+    MODBUS_TCP_MAX_ADU_LENGTH,
+    _modbus_set_slave,
+    _modbus_tcp_build_request_basis,
+    _modbus_tcp_build_response_basis,
+    _modbus_tcp_prepare_response_tid,
+    _modbus_tcp_send_msg_pre,
+    _modbus_tcp_uring_send,
+    _modbus_tcp_receive,
+    _modbus_tcp_uring_recv,
+    _modbus_tcp_check_integrity,
+    _modbus_tcp_pre_check_confirmation,
+    _modbus_tcp_uring_connect,
+    _modbus_tcp_uring_connect_async,
+    _modbus_tcp_uring_close,
+    _modbus_tcp_set_socket,
+    _modbus_tcp_flush,
+    _modbus_tcp_uring_wait,
+    _modbus_tcp_uring_free
+};
+#endif
+
+/* Listens with the function matching the backend (IPv4 or protocol
+   independent) of the context */
+int _modbus_tcp_listen(modbus_t *ctx, int nb_connection, int flags)
+{
+    if (ctx->backend == &_modbus_tcp_pi_backend)
+        return _modbus_tcp_listen_pi(ctx, nb_connection, flags);
+
+    return _modbus_tcp_listen_ipv4(ctx, nb_connection, flags);
+}
+
+/* Duplicates the context without its connection */
+modbus_t* _modbus_tcp_clone(modbus_t *ctx)
+{
+    modbus_t *new_ctx;
+    size_t size;
+
+    if (ctx->backend == &_modbus_tcp_pi_backend)
+        size = sizeof(modbus_tcp_pi_t);
+    else
+        size = sizeof(modbus_tcp_t);
+
+    new_ctx = (modbus_t *) malloc(sizeof(modbus_t));
+    if (new_ctx == NULL) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    *new_ctx = *ctx;
+    new_ctx->s = -1;
+    new_ctx->async = NULL;
+    new_ctx->pool_endpoint = NULL;
+    new_ctx->nb_connect_failures = 0;
+    new_ctx->next_connect = 0;
+    new_ctx->connecting = FALSE;
+#ifdef _MODBUS_TCP_URING
+    /* The io_uring of the context isn't shared, the clone uses the socket
+       calls */
+    if (ctx->backend == &_modbus_tcp_uring_backend)
+        new_ctx->backend = &_modbus_tcp_backend;
+#endif
+
+    new_ctx->backend_data = malloc(size);
+    if (new_ctx->backend_data == NULL) {
+        free(new_ctx);
+        errno = ENOMEM;
+        return NULL;
+    }
+    memcpy(new_ctx->backend_data, ctx->backend_data, size);
+    _modbus_tcp_reset_buffers(new_ctx);
+
+    return new_ctx;
+}
+
 modbus_t* modbus_new_tcp(const char *ip, int port)
 {
     modbus_t *ctx;
@@ -836,10 +1710,50 @@ modbus_t* modbus_new_tcp(const char *ip, int port)
 
     ctx_tcp->port = port;
     ctx_tcp->t_id = 0;
+    ctx_tcp->rbuf.read_ahead = FALSE;
+    ctx_tcp->wbuf.enabled = FALSE;
+    _modbus_tcp_reset_buffers(ctx);
 
     return ctx;
 }
 
+/* Creates a TCP (IPv4) context using io_uring instead of the socket calls to
+   send and receive */
+modbus_t* modbus_new_tcp_uring(const char *ip, int port)
+{
+#ifdef _MODBUS_TCP_URING
+    modbus_t *ctx;
+    modbus_tcp_uring_t *ctx_tcp_uring;
+
+    ctx = modbus_new_tcp(ip, port);
+    if (ctx == NULL)
+        return NULL;
+
+    ctx_tcp_uring = realloc(ctx->backend_data, sizeof(modbus_tcp_uring_t));
+    if (ctx_tcp_uring == NULL) {
+        modbus_free(ctx);
+        errno = ENOMEM;
+        return NULL;
+    }
+    ctx->backend_data = ctx_tcp_uring;
+
+    if (_modbus_uring_setup(&ctx_tcp_uring->uring,
+                            &ctx_tcp_uring->tcp.rbuf) == -1) {
+        int saved_errno = errno;
+
+        modbus_free(ctx);
+        errno = saved_errno;
+        return NULL;
+    }
+    ctx->backend = &_modbus_tcp_uring_backend;
+
+    return ctx;
+#else
+    errno = ENOTSUP;
+    return NULL;
+#endif
+}
+
 
 modbus_t* modbus_new_tcp_pi(const char *node, const char *service)
 {
@@ -892,6 +1806,9 @@ modbus_t* modbus_new_tcp_pi(const char *node, const char *service)
     }
 
     ctx_tcp_pi->t_id = 0;
+    ctx_tcp_pi->rbuf.read_ahead = FALSE;
+    ctx_tcp_pi->wbuf.enabled = FALSE;
+    _modbus_tcp_reset_buffers(ctx);
 
     return ctx;
 }
@@ -55,10 +55,15 @@ MODBUS_API modbus_t* modbus_new_tcp(const char *ip_address, int port);
 MODBUS_API int modbus_tcp_listen(modbus_t *ctx, int nb_connection);
 MODBUS_API int modbus_tcp_accept(modbus_t *ctx, int *s);
 
+MODBUS_API modbus_t* modbus_new_tcp_uring(const char *ip_address, int port);
+
 MODBUS_API modbus_t* modbus_new_tcp_pi(const char *node, const char *service);
 MODBUS_API int modbus_tcp_pi_listen(modbus_t *ctx, int nb_connection);
 MODBUS_API int modbus_tcp_pi_accept(modbus_t *ctx, int *s);
 
+MODBUS_API int modbus_tcp_set_read_ahead(modbus_t *ctx, int enable);
+MODBUS_API int modbus_tcp_set_reply_batching(modbus_t *ctx, int enable);
+
 MODBUS_END_DECLS
 
 #endif /* _MODBUS_TCP_H_ */
@@ -29,6 +29,13 @@
 #ifndef _MSC_VER
 #include <unistd.h>
 #endif
+#ifndef _WIN32
+#include <fcntl.h>
+#include <poll.h>
+#endif
+#if HAVE_SYS_EVENTFD_H
+#include <sys/eventfd.h>
+#endif
 
 #include <config.h>
 
@@ -44,9 +51,6 @@ const unsigned int libmodbus_version_major = LIBMODBUS_VERSION_MAJOR;
 const unsigned int libmodbus_version_minor = LIBMODBUS_VERSION_MINOR;
 const unsigned int libmodbus_version_micro = LIBMODBUS_VERSION_MICRO;
 
-/* Max between RTU and TCP max adu length (so TCP) */
-#define MAX_MESSAGE_LENGTH 260
-
 /* 3 steps are used to parse the query */
 
 
@@ -106,8 +110,165 @@ void _sleep_response_timeout(modbus_t *ctx)
     Sleep((ctx->response_timeout.tv_sec * 1000) +
           (ctx->response_timeout.tv_usec / 1000));
 #else
-    /* usleep source code */
-    usleep(ctx->response_timeout.tv_usec + ctx->response_timeout.tv_sec*1000);
+    /* The delay is resumed after a signal */
+    struct timespec request, remaining;
+
+    request.tv_sec = ctx->response_timeout.tv_sec;
+    request.tv_nsec = ctx->response_timeout.tv_usec * 1000;
+    while (nanosleep(&request, &remaining) == -1 && errno == EINTR)
+        request = remaining;
+#endif
+}
+
+/* Time of the monotonic clock in milliseconds */
+int64_t _modbus_time_ms(void)
+{
+#ifdef _WIN32
+    return GetTickCount64();
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+#endif
+}
+
+/* Time of the monotonic clock in microseconds */
+int64_t _modbus_time_us(void)
+{
+#ifdef _WIN32
+    return GetTickCount64() * 1000;
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#endif
+}
+
+/* Waits until the descriptor s is ready for reading or writing (events).
+   The timeout tv is turned into a deadline on the monotonic clock so it
+   isn't extended by the signals interrupting the wait nor changed by the
+   adjustments of the system time. Without timeout, the wait ends when
+   *pIsActive becomes false (checked every second) if pIsActive isn't NULL.
+   When a cancel descriptor is given (not -1), the wait ends as soon as it's
+   readable so pIsActive doesn't need to be checked.
+
+   Unlike select(), poll() accepts any descriptor number and doesn't need to
+   rebuild the descriptor sets on each call.
+
+   Returns 1 when the descriptor is ready, 0 on timeout and -1 on error
+   (ECANCELED when cancelled). */
+int _modbus_wait(int s, int events, const struct timeval *tv, int *pIsActive,
+                 int cancel_fd)
+{
+#ifdef _WIN32
+    fd_set set;
+    struct timeval one_sec;
+    struct timeval t;
+    const struct timeval *p_tv;
+    int rc;
+
+    for (;;) {
+        if (tv == NULL && pIsActive != NULL) {
+            one_sec.tv_sec = 1;
+            one_sec.tv_usec = 0;
+            p_tv = &one_sec;
+        } else {
+            p_tv = tv;
+        }
+        if (p_tv != NULL)
+            t = *p_tv;
+
+        FD_ZERO(&set);
+        FD_SET(s, &set);
+        if (events & _MODBUS_WAIT_WRITE)
+            rc = select(s + 1, NULL, &set, NULL, p_tv ? &t : NULL);
+        else
+            rc = select(s + 1, &set, NULL, NULL, p_tv ? &t : NULL);
+        if (rc != 0 || p_tv != &one_sec || !*pIsActive)
+            return rc > 0 ? 1 : rc;
+    }
+#else
+    struct pollfd pfd[2];
+    struct timespec deadline;
+    struct timespec ts;
+    const struct timespec *p_ts;
+    int nfds = 1;
+    int rc;
+
+    pfd[0].fd = s;
+    pfd[0].events = (events & _MODBUS_WAIT_WRITE) ? POLLOUT : POLLIN;
+    if (cancel_fd != -1) {
+        pfd[1].fd = cancel_fd;
+        pfd[1].events = POLLIN;
+        pfd[1].revents = 0;
+        nfds = 2;
+        /* No need to check pIsActive periodically */
+        pIsActive = NULL;
+    }
+
+    if (tv != NULL) {
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        deadline.tv_sec += tv->tv_sec + tv->tv_usec / 1000000;
+        deadline.tv_nsec += (tv->tv_usec % 1000000) * 1000;
+        if (deadline.tv_nsec >= 1000000000) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000;
+        }
+    }
+
+    for (;;) {
+        if (tv != NULL) {
+            /* Time left before the deadline */
+            clock_gettime(CLOCK_MONOTONIC, &ts);
+            ts.tv_sec = deadline.tv_sec - ts.tv_sec;
+            ts.tv_nsec = deadline.tv_nsec - ts.tv_nsec;
+            if (ts.tv_nsec < 0) {
+                ts.tv_sec--;
+                ts.tv_nsec += 1000000000;
+            }
+            if (ts.tv_sec < 0) {
+                ts.tv_sec = 0;
+                ts.tv_nsec = 0;
+            }
+            p_ts = &ts;
+        } else if (pIsActive != NULL) {
+            ts.tv_sec = 1;
+            ts.tv_nsec = 0;
+            p_ts = &ts;
+        } else {
+            p_ts = NULL;
+        }
+
+#ifdef HAVE_PPOLL
+        rc = ppoll(pfd, nfds, p_ts, NULL);
+#else
+        /* Rounded up to not return before the deadline */
+        rc = poll(pfd, nfds, p_ts == NULL ? -1 :
+                  (int)(p_ts->tv_sec * 1000 + (p_ts->tv_nsec + 999999) / 1000000));
+#endif
+        if (rc > 0) {
+            if (nfds == 2 && pfd[1].revents != 0) {
+                errno = ECANCELED;
+                return -1;
+            }
+            if (pfd[0].revents & POLLNVAL) {
+                errno = EBADF;
+                return -1;
+            }
+            /* POLLERR and POLLHUP are reported by the next read or write */
+            return 1;
+        }
+
+        if (rc == -1) {
+            if (errno != EINTR)
+                return -1;
+            /* A non blocked signal was caught, waits for the time left */
+        } else if (tv != NULL || pIsActive == NULL || !*pIsActive) {
+            return 0;
+        }
+    }
 #endif
 }
 
@@ -163,6 +324,105 @@ static unsigned int compute_response_length_from_request(modbus_t *ctx, uint8_t
     return offset + length + ctx->backend->checksum_length;
 }
 
+static int64_t _timeval_to_ms(const struct timeval *tv)
+{
+    return (int64_t)tv->tv_sec * 1000 + tv->tv_usec / 1000;
+}
+
+/* Checks the reconnection policy before a connection attempt */
+static int _connect_allowed(modbus_t *ctx)
+{
+    const modbus_reconnect_policy_t *policy = &ctx->reconnect_policy;
+
+    if (!ctx->has_reconnect_policy)
+        return 0;
+
+    if (policy->max_attempts > 0 &&
+        ctx->nb_connect_failures >= policy->max_attempts) {
+        /* Given up */
+        errno = ENOTCONN;
+        return -1;
+    }
+
+    if (_modbus_time_ms() < ctx->next_connect) {
+        errno = EAGAIN;
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Records the result of a connection attempt, a failure delays the next
+   attempt according to the reconnection policy */
+static void _connect_done(modbus_t *ctx, int rc)
+{
+    const modbus_reconnect_policy_t *policy = &ctx->reconnect_policy;
+    int saved_errno = errno;
+    int64_t delay;
+    int64_t max_delay;
+    int i;
+
+    ctx->connecting = FALSE;
+    if (rc == 0) {
+        ctx->nb_connect_failures = 0;
+        ctx->next_connect = 0;
+        return;
+    }
+
+    ctx->nb_connect_failures++;
+    if (!ctx->has_reconnect_policy)
+        return;
+
+    delay = _timeval_to_ms(&policy->min_delay);
+    max_delay = _timeval_to_ms(&policy->max_delay);
+    for (i = 1; i < ctx->nb_connect_failures && delay < max_delay; i++)
+        delay *= 2;
+    if (delay > max_delay)
+        delay = max_delay;
+
+    if (policy->jitter > 0) {
+        /* The contexts failing together don't retry at the same time */
+        ctx->jitter_seed = ctx->jitter_seed * 1103515245 + 12345;
+        delay -= delay * policy->jitter / 100 *
+            ((ctx->jitter_seed >> 16) & 0x7FFF) / 0x7FFF;
+    }
+
+    ctx->next_connect = _modbus_time_ms() + delay;
+    errno = saved_errno;
+}
+
+/* Opens again the connection closed after a link error, within the response
+   timeout and only when the reconnection policy allows it */
+static int _reconnect(modbus_t *ctx)
+{
+    struct timeval tv;
+    int rc;
+
+    rc = modbus_connect_async(ctx);
+    if (rc == -1 && errno == EINPROGRESS) {
+        tv = ctx->response_timeout;
+        rc = _modbus_wait(ctx->s, _MODBUS_WAIT_WRITE, &tv, NULL,
+                          _modbus_cancel_fd(ctx));
+        if (rc == 1) {
+            rc = modbus_connect_async(ctx);
+        } else if (rc == 0) {
+            errno = ETIMEDOUT;
+            rc = -1;
+        }
+
+        if (rc == -1 && ctx->connecting) {
+            int saved_errno = errno;
+
+            modbus_close(ctx);
+            if (saved_errno != ECANCELED)
+                _connect_done(ctx, -1);
+            errno = saved_errno;
+        }
+    }
+
+    return rc;
+}
+
 /* Sends a request/response */
 static int send_msg(modbus_t *ctx, uint8_t *msg, int msg_length)
 {
@@ -181,33 +441,18 @@ static int send_msg(modbus_t *ctx, uint8_t *msg, int msg_length)
         printf("\n");
     }
 
-    /* Empty receive buffer to avoid reading already existing received data
-     * that does NOT belong to the current request's response. */
-    if (ctx->backend->backend_type == _MODBUS_BACKEND_TYPE_RTU)
-    {
-        uint8_t rsp[MAX_MESSAGE_LENGTH];
-        int totalReadBytes = 0;
-        int readBytes = 1;
-        while (readBytes > 0)
-        {
-#if defined(_WIN32)
-        int rsp_length = 0;
-            readBytes = win32_ser_read(&((modbus_rtu_t *)ctx->backend_data)->w_ser, rsp, rsp_length);
-#else
-            readBytes = read(ctx->s, rsp, MAX_MESSAGE_LENGTH);
-#endif
-            if(ctx->traceCallback && readBytes > 0)
-                ctx->traceCallback(rsp, readBytes, -1, ctx->traceState);
-
-            totalReadBytes += readBytes;
+    /* With a reconnection policy, the connection closed after a link error
+       is opened again before the next request */
+    if ((ctx->error_recovery & MODBUS_ERROR_RECOVERY_LINK) &&
+        ctx->has_reconnect_policy && (ctx->s == -1 || ctx->connecting)) {
+        if (_reconnect(ctx) == -1) {
+            _error_print(ctx, "reconnect");
+            return -1;
         }
-
-        if (ctx->debug && totalReadBytes > 0)
-            printf("Read %i unexpected bytes from receive buffer before sending a new message!\n", totalReadBytes);
     }
 
     /* In recovery mode, the write command will be issued until to be
-       successful! Disabled by default. */
+       successful (without reconnection policy)! Disabled by default. */
     do {
         rc = ctx->backend->send(ctx, msg, msg_length);
         if (rc == -1) {
@@ -215,7 +460,10 @@ static int send_msg(modbus_t *ctx, uint8_t *msg, int msg_length)
             if (ctx->error_recovery & MODBUS_ERROR_RECOVERY_LINK) {
                 int saved_errno = errno;
 
-                if ((errno == EBADF || errno == ECONNRESET || errno == EPIPE)) {
+                if (ctx->has_reconnect_policy) {
+                    if (errno == EBADF || errno == ECONNRESET || errno == EPIPE)
+                        modbus_close(ctx);
+                } else if ((errno == EBADF || errno == ECONNRESET || errno == EPIPE)) {
                     modbus_close(ctx);
                     _sleep_response_timeout(ctx);
                     modbus_connect(ctx);
@@ -227,7 +475,7 @@ static int send_msg(modbus_t *ctx, uint8_t *msg, int msg_length)
             }
         }
     } while ((ctx->error_recovery & MODBUS_ERROR_RECOVERY_LINK) &&
-             rc == -1);
+             !ctx->has_reconnect_policy && rc == -1);
 
     if (rc > 0 && rc != msg_length) {
         errno = EMBBADDATA;
@@ -352,6 +600,42 @@ int compute_data_length_after_meta(modbus_t *ctx, uint8_t *msg,
 }
 
 
+/* Moves the reception of msg to the next step once all the bytes of the
+   current step have been received and returns the number of bytes to read in
+   the new step (0 when the message is complete), or -1 if the message would
+   be too long. */
+static int next_step(modbus_t *ctx, uint8_t *msg, int msg_length,
+                     msg_type_t msg_type, _step_t *step)
+{
+    int length_to_read = 0;
+
+    switch (*step) {
+    case _STEP_FUNCTION:
+        /* Function code position */
+        length_to_read = compute_meta_length_after_function(
+            msg[ctx->backend->header_length],
+            msg_type);
+        if (length_to_read != 0) {
+            *step = _STEP_META;
+            break;
+        } /* else switches straight to the next step */
+    case _STEP_META:
+        length_to_read = compute_data_length_after_meta(
+            ctx, msg, msg_type);
+        if ((msg_length + length_to_read) > (int)ctx->backend->max_adu_length) {
+            errno = EMBBADDATA;
+            _error_print(ctx, "too many data");
+            return -1;
+        }
+        *step = _STEP_DATA;
+        break;
+    default:
+        break;
+    }
+
+    return length_to_read;
+}
+
 /* Waits a response from a modbus server or a request from a modbus client.
    This function blocks if there is no replies (3 timeouts).
 
@@ -368,7 +652,6 @@ int compute_data_length_after_meta(modbus_t *ctx, uint8_t *msg,
 int _modbus_receive_msg(modbus_t *ctx, uint8_t *msg, msg_type_t msg_type, int* pIsActive)
 {
     int rc;
-    fd_set rset;
     struct timeval tv;
     struct timeval *p_tv;
     int length_to_read;
@@ -401,21 +684,22 @@ int _modbus_receive_msg(modbus_t *ctx, uint8_t *msg, msg_type_t msg_type, int* p
     }
 
     while (length_to_read > 0 && (!pIsActive || *pIsActive)) {
-        FD_ZERO(&rset);
-        FD_SET(ctx->s, &rset);
-        rc = ctx->backend->select(ctx, &rset, p_tv, length_to_read, pIsActive);
+        rc = ctx->backend->wait(ctx, p_tv, length_to_read, pIsActive);
 
         if (rc == -1) {
-            _error_print(ctx, "select");
+            _error_print(ctx, "wait");
             if (ctx->error_recovery & MODBUS_ERROR_RECOVERY_LINK) {
                 int saved_errno = errno;
 
                 if (errno == ETIMEDOUT) {
-                    _sleep_response_timeout(ctx);
+                    /* No sleep with a reconnection policy */
+                    if (!ctx->has_reconnect_policy)
+                        _sleep_response_timeout(ctx);
                     modbus_flush(ctx);
                 } else if (errno == EBADF) {
                     modbus_close(ctx);
-                    modbus_connect(ctx);
+                    if (!ctx->has_reconnect_policy)
+                        modbus_connect(ctx);
                 }
                 errno = saved_errno;
             }
@@ -435,7 +719,8 @@ int _modbus_receive_msg(modbus_t *ctx, uint8_t *msg, msg_type_t msg_type, int* p
                  errno == EBADF)) {
                 int saved_errno = errno;
                 modbus_close(ctx);
-                modbus_connect(ctx);
+                if (!ctx->has_reconnect_policy)
+                    modbus_connect(ctx);
                 /* Could be removed by previous calls */
                 errno = saved_errno;
             }
@@ -455,29 +740,9 @@ int _modbus_receive_msg(modbus_t *ctx, uint8_t *msg, msg_type_t msg_type, int* p
         length_to_read -= rc;
 
         if (length_to_read == 0) {
-            switch (step) {
-            case _STEP_FUNCTION:
-                /* Function code position */
-                length_to_read = compute_meta_length_after_function(
-                    msg[ctx->backend->header_length],
-                    msg_type);
-                if (length_to_read != 0) {
-                    step = _STEP_META;
-                    break;
-                } /* else switches straight to the next step */
-            case _STEP_META:
-                length_to_read = compute_data_length_after_meta(
-                    ctx, msg, msg_type);
-                if ((msg_length + length_to_read) > (int)ctx->backend->max_adu_length) {
-                    errno = EMBBADDATA;
-                    _error_print(ctx, "too many data");
-                    return -1;
-                }
-                step = _STEP_DATA;
-                break;
-            default:
-                break;
-            }
+            length_to_read = next_step(ctx, msg, msg_length, msg_type, &step);
+            if (length_to_read == -1)
+                return -1;
         }
 
         if (length_to_read > 0 && ctx->byte_timeout.tv_sec != -1) {
@@ -660,32 +925,6 @@ static int check_confirmation(modbus_t *ctx, uint8_t *req,
     return rc;
 }
 
-static int response_io_status(int address, int nb,
-                              uint8_t *tab_io_status,
-                              uint8_t *rsp, int offset)
-{
-    int shift = 0;
-    /* Instead of byte (not allowed in Win32) */
-    int one_byte = 0;
-    int i;
-
-    for (i = address; i < address+nb; i++) {
-        one_byte |= tab_io_status[i] << shift;
-        if (shift == 7) {
-            /* Byte is full */
-            rsp[offset++] = one_byte;
-            one_byte = shift = 0;
-        } else {
-            shift++;
-        }
-    }
-
-    if (shift != 0)
-        rsp[offset++] = one_byte;
-
-    return offset;
-}
-
 /* Build the exception response */
 static int response_exception(modbus_t *ctx, sft_t *sft,
                               int exception_code, uint8_t *rsp)
@@ -701,28 +940,23 @@ static int response_exception(modbus_t *ctx, sft_t *sft,
     return rsp_length;
 }
 
-/* Send a response to the received request.
-   Analyses the request and constructs a response.
+/* Analyses the request and constructs the response in rsp (without the
+   checksum or the final header update of send_msg_pre).
 
    If an error occurs, this function construct the response
    accordingly.
 */
-int modbus_reply(modbus_t *ctx, const uint8_t *req,
-                 int req_length, modbus_mapping_t *mb_mapping)
+static int build_reply(modbus_t *ctx, const uint8_t *req,
+                       int req_length, modbus_mapping_t *mb_mapping,
+                       uint8_t *rsp)
 {
     int offset = ctx->backend->header_length;
     int slave = req[offset - 1];
     int function = req[offset];
     uint16_t address = (req[offset + 1] << 8) + req[offset + 2];
-    uint8_t rsp[MAX_MESSAGE_LENGTH];
     int rsp_length = 0;
     sft_t sft;
 
-    if (ctx == NULL) {
-        errno = EINVAL;
-        return -1;
-    }
-
     sft.slave = slave;
     sft.function = function;
     sft.t_id = ctx->backend->prepare_response_tid(req, &req_length);
@@ -751,9 +985,8 @@ int modbus_reply(modbus_t *ctx, const uint8_t *req,
         } else {
             rsp_length = ctx->backend->build_response_basis(&sft, rsp);
             rsp[rsp_length++] = (nb / 8) + ((nb % 8) ? 1 : 0);
-            rsp_length = response_io_status(address, nb,
-                                            mb_mapping->tab_bits,
-                                            rsp, rsp_length);
+            rsp_length += _modbus_mapping_get_bits(
+                mb_mapping, MODBUS_MAPPING_BITS, address, nb, rsp + rsp_length);
         }
     }
         break;
@@ -782,9 +1015,8 @@ int modbus_reply(modbus_t *ctx, const uint8_t *req,
         } else {
             rsp_length = ctx->backend->build_response_basis(&sft, rsp);
             rsp[rsp_length++] = (nb / 8) + ((nb % 8) ? 1 : 0);
-            rsp_length = response_io_status(address, nb,
-                                            mb_mapping->tab_input_bits,
-                                            rsp, rsp_length);
+            rsp_length += _modbus_mapping_get_bits(
+                mb_mapping, MODBUS_MAPPING_INPUT_BITS, address, nb, rsp + rsp_length);
         }
     }
         break;
@@ -809,14 +1041,14 @@ int modbus_reply(modbus_t *ctx, const uint8_t *req,
                 ctx, &sft,
                 MODBUS_EXCEPTION_ILLEGAL_DATA_ADDRESS, rsp);
         } else {
-            int i;
+            uint16_t registers[MODBUS_MAX_READ_REGISTERS];
+            const uint16_t *src = _modbus_mapping_snapshot(
+                mb_mapping, MODBUS_MAPPING_REGISTERS, address, nb, registers);
 
             rsp_length = ctx->backend->build_response_basis(&sft, rsp);
             rsp[rsp_length++] = nb << 1;
-            for (i = address; i < address + nb; i++) {
-                rsp[rsp_length++] = mb_mapping->tab_registers[i] >> 8;
-                rsp[rsp_length++] = mb_mapping->tab_registers[i] & 0xFF;
-            }
+            modbus_set_bytes_from_registers(rsp + rsp_length, nb, src);
+            rsp_length += nb << 1;
         }
     }
         break;
@@ -843,14 +1075,15 @@ int modbus_reply(modbus_t *ctx, const uint8_t *req,
                 ctx, &sft,
                 MODBUS_EXCEPTION_ILLEGAL_DATA_ADDRESS, rsp);
         } else {
-            int i;
+            uint16_t registers[MODBUS_MAX_READ_REGISTERS];
+            const uint16_t *src = _modbus_mapping_snapshot(
+                mb_mapping, MODBUS_MAPPING_INPUT_REGISTERS, address, nb,
+                registers);
 
             rsp_length = ctx->backend->build_response_basis(&sft, rsp);
             rsp[rsp_length++] = nb << 1;
-            for (i = address; i < address + nb; i++) {
-                rsp[rsp_length++] = mb_mapping->tab_input_registers[i] >> 8;
-                rsp[rsp_length++] = mb_mapping->tab_input_registers[i] & 0xFF;
-            }
+            modbus_set_bytes_from_registers(rsp + rsp_length, nb, src);
+            rsp_length += nb << 1;
         }
     }
         break;
@@ -868,7 +1101,10 @@ int modbus_reply(modbus_t *ctx, const uint8_t *req,
             int data = (req[offset + 3] << 8) + req[offset + 4];
 
             if (data == 0xFF00 || data == 0x0) {
-                mb_mapping->tab_bits[address] = (data) ? ON : OFF;
+                uint8_t bit = (data) ? ON : OFF;
+
+                _modbus_mapping_set_bits(mb_mapping, MODBUS_MAPPING_BITS,
+                                         address, 1, &bit);
                 memcpy(rsp, req, req_length);
                 rsp_length = req_length;
             } else {
@@ -895,15 +1131,30 @@ int modbus_reply(modbus_t *ctx, const uint8_t *req,
         } else {
             int data = (req[offset + 3] << 8) + req[offset + 4];
 
+            _modbus_mapping_write_begin(mb_mapping, MODBUS_MAPPING_REGISTERS,
+                                        address, 1);
             mb_mapping->tab_registers[address] = data;
+            _modbus_mapping_write_end(mb_mapping, MODBUS_MAPPING_REGISTERS,
+                                      address, 1);
             memcpy(rsp, req, req_length);
             rsp_length = req_length;
         }
         break;
     case _FC_WRITE_MULTIPLE_COILS: {
         int nb = (req[offset + 3] << 8) + req[offset + 4];
+        int nb_bytes = req[offset + 5];
 
-        if ((address + nb) > mb_mapping->nb_bits) {
+        if (nb < 1 || MODBUS_MAX_WRITE_BITS < nb ||
+            nb_bytes != (nb / 8) + ((nb % 8) ? 1 : 0)) {
+            if (ctx->debug) {
+                fprintf(stderr,
+                        "Illegal nb of values %d in write_bits (max %d)\n",
+                        nb, MODBUS_MAX_WRITE_BITS);
+            }
+            rsp_length = response_exception(
+                ctx, &sft,
+                MODBUS_EXCEPTION_ILLEGAL_DATA_VALUE, rsp);
+        } else if ((address + nb) > mb_mapping->nb_bits) {
             if (ctx->debug) {
                 fprintf(stderr, "Illegal data address %0X in write_bits\n",
                         address + nb);
@@ -913,7 +1164,8 @@ int modbus_reply(modbus_t *ctx, const uint8_t *req,
                 MODBUS_EXCEPTION_ILLEGAL_DATA_ADDRESS, rsp);
         } else {
             /* 6 = byte count */
-            modbus_set_bits_from_bytes(mb_mapping->tab_bits, address, nb, &req[offset + 6]);
+            _modbus_mapping_set_bits(mb_mapping, MODBUS_MAPPING_BITS,
+                                     address, nb, &req[offset + 6]);
 
             rsp_length = ctx->backend->build_response_basis(&sft, rsp);
             /* 4 to copy the bit address (2) and the quantity of bits */
@@ -924,8 +1176,19 @@ int modbus_reply(modbus_t *ctx, const uint8_t *req,
         break;
     case _FC_WRITE_MULTIPLE_REGISTERS: {
         int nb = (req[offset + 3] << 8) + req[offset + 4];
+        int nb_bytes = req[offset + 5];
 
-        if ((address + nb) > mb_mapping->nb_registers) {
+        if (nb < 1 || MODBUS_MAX_WRITE_REGISTERS < nb ||
+            nb_bytes != nb * 2) {
+            if (ctx->debug) {
+                fprintf(stderr,
+                        "Illegal nb of values %d in write_registers (max %d)\n",
+                        nb, MODBUS_MAX_WRITE_REGISTERS);
+            }
+            rsp_length = response_exception(
+                ctx, &sft,
+                MODBUS_EXCEPTION_ILLEGAL_DATA_VALUE, rsp);
+        } else if ((address + nb) > mb_mapping->nb_registers) {
             if (ctx->debug) {
                 fprintf(stderr, "Illegal data address %0X in write_registers\n",
                         address + nb);
@@ -934,12 +1197,13 @@ int modbus_reply(modbus_t *ctx, const uint8_t *req,
                 ctx, &sft,
                 MODBUS_EXCEPTION_ILLEGAL_DATA_ADDRESS, rsp);
         } else {
-            int i, j;
-            for (i = address, j = 6; i < address + nb; i++, j += 2) {
-                /* 6 and 7 = first value */
-                mb_mapping->tab_registers[i] =
-                    (req[offset + j] << 8) + req[offset + j + 1];
-            }
+            _modbus_mapping_write_begin(mb_mapping, MODBUS_MAPPING_REGISTERS,
+                                        address, nb);
+            /* 6 and 7 = first value */
+            modbus_set_registers_from_bytes(mb_mapping->tab_registers + address,
+                                            nb, &req[offset + 6]);
+            _modbus_mapping_write_end(mb_mapping, MODBUS_MAPPING_REGISTERS,
+                                      address, nb);
 
             rsp_length = ctx->backend->build_response_basis(&sft, rsp);
             /* 4 to copy the address (2) and the no. of registers */
@@ -982,12 +1246,17 @@ int modbus_reply(modbus_t *ctx, const uint8_t *req,
                 ctx, &sft,
                 MODBUS_EXCEPTION_ILLEGAL_DATA_ADDRESS, rsp);
         } else {
-            uint16_t data = mb_mapping->tab_registers[address];
+            uint16_t data;
             uint16_t and = (req[offset + 3] << 8) + req[offset + 4];
             uint16_t or = (req[offset + 5] << 8) + req[offset + 6];
 
+            _modbus_mapping_write_begin(mb_mapping, MODBUS_MAPPING_REGISTERS,
+                                        address, 1);
+            data = mb_mapping->tab_registers[address];
             data = (data & and) | (or & (~and));
             mb_mapping->tab_registers[address] = data;
+            _modbus_mapping_write_end(mb_mapping, MODBUS_MAPPING_REGISTERS,
+                                      address, 1);
             memcpy(rsp, req, req_length);
             rsp_length = req_length;
         }
@@ -1020,22 +1289,26 @@ int modbus_reply(modbus_t *ctx, const uint8_t *req,
             rsp_length = response_exception(ctx, &sft,
                                             MODBUS_EXCEPTION_ILLEGAL_DATA_ADDRESS, rsp);
         } else {
-            int i, j;
+            uint16_t registers[MODBUS_MAX_WR_READ_REGISTERS];
+            const uint16_t *src;
             rsp_length = ctx->backend->build_response_basis(&sft, rsp);
             rsp[rsp_length++] = nb << 1;
 
             /* Write first.
                10 and 11 are the offset of the first values to write */
-            for (i = address_write, j = 10; i < address_write + nb_write; i++, j += 2) {
-                mb_mapping->tab_registers[i] =
-                    (req[offset + j] << 8) + req[offset + j + 1];
-            }
+            _modbus_mapping_write_begin(mb_mapping, MODBUS_MAPPING_REGISTERS,
+                                        address_write, nb_write);
+            modbus_set_registers_from_bytes(
+                mb_mapping->tab_registers + address_write, nb_write,
+                &req[offset + 10]);
+            _modbus_mapping_write_end(mb_mapping, MODBUS_MAPPING_REGISTERS,
+                                      address_write, nb_write);
 
             /* and read the data for the response */
-            for (i = address; i < address + nb; i++) {
-                rsp[rsp_length++] = mb_mapping->tab_registers[i] >> 8;
-                rsp[rsp_length++] = mb_mapping->tab_registers[i] & 0xFF;
-            }
+            src = _modbus_mapping_snapshot(mb_mapping, MODBUS_MAPPING_REGISTERS,
+                                           address, nb, registers);
+            modbus_set_bytes_from_registers(rsp + rsp_length, nb, src);
+            rsp_length += nb << 1;
         }
     }
         break;
@@ -1047,9 +1320,90 @@ int modbus_reply(modbus_t *ctx, const uint8_t *req,
         break;
     }
 
+    return rsp_length;
+}
+
+/* Send a response to the received request.
+   Analyses the request and constructs a response.
+
+   If an error occurs, this function construct the response
+   accordingly.
+*/
+int modbus_reply(modbus_t *ctx, const uint8_t *req,
+                 int req_length, modbus_mapping_t *mb_mapping)
+{
+    uint8_t rsp[MAX_MESSAGE_LENGTH];
+    int rsp_length;
+
+    if (ctx == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    rsp_length = build_reply(ctx, req, req_length, mb_mapping, rsp);
+    if (rsp_length == -1)
+        return -1;
+
     return send_msg(ctx, rsp, rsp_length);
 }
 
+/* Builds the complete response to the request in out without sending it.
+   The response is built in place when out can hold any response. */
+int modbus_build_reply(modbus_t *ctx, const uint8_t *req, int req_length,
+                       modbus_mapping_t *mb_mapping, uint8_t *out, int out_cap)
+{
+    uint8_t rsp[MAX_MESSAGE_LENGTH];
+    int rsp_length;
+
+    if (ctx == NULL || req == NULL || mb_mapping == NULL || out == NULL ||
+        req_length <= (int)ctx->backend->header_length) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (out_cap >= MAX_MESSAGE_LENGTH) {
+        rsp_length = build_reply(ctx, req, req_length, mb_mapping, out);
+        if (rsp_length == -1)
+            return -1;
+
+        return ctx->backend->send_msg_pre(out, rsp_length);
+    }
+
+    /* The mapping is left untouched when the response doesn't fit so the
+       length of a write response is checked before building it */
+    switch (req[ctx->backend->header_length]) {
+    case _FC_WRITE_AND_READ_REGISTERS:
+        if (req_length < (int)ctx->backend->header_length + 5)
+            break;
+        /* Fall through */
+    case _FC_WRITE_SINGLE_COIL:
+    case _FC_WRITE_SINGLE_REGISTER:
+    case _FC_WRITE_MULTIPLE_COILS:
+    case _FC_WRITE_MULTIPLE_REGISTERS:
+    case _FC_MASK_WRITE_REGISTER:
+        if ((int)compute_response_length_from_request(ctx, (uint8_t *)req) > out_cap) {
+            errno = ENOBUFS;
+            return -1;
+        }
+        break;
+    default:
+        break;
+    }
+
+    rsp_length = build_reply(ctx, req, req_length, mb_mapping, rsp);
+    if (rsp_length == -1)
+        return -1;
+
+    rsp_length = ctx->backend->send_msg_pre(rsp, rsp_length);
+    if (rsp_length > out_cap) {
+        errno = ENOBUFS;
+        return -1;
+    }
+    memcpy(out, rsp, rsp_length);
+
+    return rsp_length;
+}
+
 int modbus_reply_exception(modbus_t *ctx, const uint8_t *req,
                            unsigned int exception_code)
 {
@@ -1101,6 +1455,37 @@ int modbus_set_trace_callback(modbus_t *ctx, void (*traceCallback)(uint8_t*, int
     return 0;
 }
 
+/* Unpacks nb bits (LSB first) of the bytes of a response to one byte per bit
+   in dest */
+static void decode_bits(const uint8_t *src, int nb, uint8_t *dest)
+{
+    modbus_set_bits_from_bytes(dest, 0, nb, src);
+}
+
+/* Packs nb bits (one byte per bit) of src in the bytes of a request and
+   returns the number of bytes written */
+static int encode_bits(uint8_t *dest, int nb, const uint8_t *src)
+{
+    modbus_set_bytes_from_bits(dest, src, 0, nb);
+
+    return (nb / 8) + ((nb % 8) ? 1 : 0);
+}
+
+/* Converts nb big-endian registers of a response to host order */
+static void decode_registers(const uint8_t *src, int nb, uint16_t *dest)
+{
+    modbus_set_registers_from_bytes(dest, nb, src);
+}
+
+/* Writes nb registers in big-endian order in a request and returns the number
+   of bytes written */
+static int encode_registers(uint8_t *dest, int nb, const uint16_t *src)
+{
+    modbus_set_bytes_from_registers(dest, nb, src);
+
+    return nb * 2;
+}
+
 /* Reads IO status */
 static int read_io_status(modbus_t *ctx, int function,
                           int addr, int nb, uint8_t *dest)
@@ -1117,10 +1502,7 @@ static int read_io_status(modbus_t *ctx, int function,
 
     rc = send_msg(ctx, req, req_length);
     if (rc > 0) {
-        int i, temp, bit;
-        int pos = 0;
         int offset;
-        int offset_end;
 
         rc = _modbus_receive_msg(ctx, rsp, MSG_CONFIRMATION, NULL);
         if (rc == -1)
@@ -1131,17 +1513,7 @@ static int read_io_status(modbus_t *ctx, int function,
             return -1;
 
         offset = ctx->backend->header_length + 2;
-        offset_end = offset + rc;
-        for (i = offset; i < offset_end; i++) {
-            /* Shift reg hi_byte to temp */
-            temp = rsp[i];
-
-            for (bit = 0x01; (bit & 0xff) && (pos < nb);) {
-                dest[pos++] = (temp & bit) ? TRUE : FALSE;
-                bit = bit << 1;
-            }
-
-        }
+        decode_bits(rsp + offset, nb, dest);
     }
 
     return rc;
@@ -1229,7 +1601,6 @@ static int read_registers(modbus_t *ctx, int function, int addr, int nb,
     rc = send_msg(ctx, req, req_length);
     if (rc > 0) {
         int offset;
-        int i;
 
         rc = _modbus_receive_msg(ctx, rsp, MSG_CONFIRMATION, NULL);
         if (rc == -1)
@@ -1240,12 +1611,7 @@ static int read_registers(modbus_t *ctx, int function, int addr, int nb,
             return -1;
 
         offset = ctx->backend->header_length;
-
-        for (i = 0; i < rc; i++) {
-            /* shift reg hi_byte to temp OR with lo_byte */
-            if (i < nb)
-                dest[i] = (rsp[offset + 2 + (i << 1)] << 8) | rsp[offset + 3 + (i << 1)];
-        }
+        decode_registers(rsp + offset + 2, rc, dest);
     }
 
     return rc;
@@ -1359,11 +1725,8 @@ int modbus_write_register(modbus_t *ctx, int addr, int value)
 int modbus_write_bits(modbus_t *ctx, int addr, int nb, const uint8_t *src)
 {
     int rc;
-    int i;
     int byte_count;
     int req_length;
-    int bit_check = 0;
-    int pos = 0;
     uint8_t req[MAX_MESSAGE_LENGTH];
 
     if (ctx == NULL) {
@@ -1383,25 +1746,9 @@ int modbus_write_bits(modbus_t *ctx, int addr, int nb, const uint8_t *src)
     req_length = ctx->backend->build_request_basis(ctx,
                                                    _FC_WRITE_MULTIPLE_COILS,
                                                    addr, nb, req);
-    byte_count = (nb / 8) + ((nb % 8) ? 1 : 0);
+    byte_count = encode_bits(req + req_length + 1, nb, src);
     req[req_length++] = byte_count;
-
-    for (i = 0; i < byte_count; i++) {
-        int bit;
-
-        bit = 0x01;
-        req[req_length] = 0;
-
-        while ((bit & 0xFF) && (bit_check++ < nb)) {
-            if (src[pos++])
-                req[req_length] |= bit;
-            else
-                req[req_length] &=~ bit;
-
-            bit = bit << 1;
-        }
-        req_length++;
-    }
+    req_length += byte_count;
 
     rc = send_msg(ctx, req, req_length);
     if (rc > 0) {
@@ -1422,7 +1769,6 @@ int modbus_write_bits(modbus_t *ctx, int addr, int nb, const uint8_t *src)
 int modbus_write_registers(modbus_t *ctx, int addr, int nb, const uint16_t *src)
 {
     int rc;
-    int i;
     int req_length;
     int byte_count;
     uint8_t req[MAX_MESSAGE_LENGTH];
@@ -1445,13 +1791,9 @@ int modbus_write_registers(modbus_t *ctx, int addr, int nb, const uint16_t *src)
     req_length = ctx->backend->build_request_basis(ctx,
                                                    _FC_WRITE_MULTIPLE_REGISTERS,
                                                    addr, nb, req);
-    byte_count = nb * 2;
+    byte_count = encode_registers(req + req_length + 1, nb, src);
     req[req_length++] = byte_count;
-
-    for (i = 0; i < nb; i++) {
-        req[req_length++] = src[i] >> 8;
-        req[req_length++] = src[i] & 0x00FF;
-    }
+    req_length += byte_count;
 
     rc = send_msg(ctx, req, req_length);
     if (rc > 0) {
@@ -1507,7 +1849,6 @@ int modbus_write_and_read_registers(modbus_t *ctx,
 {
     int rc;
     int req_length;
-    int i;
     int byte_count;
     uint8_t req[MAX_MESSAGE_LENGTH];
     uint8_t rsp[MAX_MESSAGE_LENGTH];
@@ -1544,13 +1885,9 @@ int modbus_write_and_read_registers(modbus_t *ctx,
     req[req_length++] = write_addr & 0x00ff;
     req[req_length++] = write_nb >> 8;
     req[req_length++] = write_nb & 0x00ff;
-    byte_count = write_nb * 2;
+    byte_count = encode_registers(req + req_length + 1, write_nb, src);
     req[req_length++] = byte_count;
-
-    for (i = 0; i < write_nb; i++) {
-        req[req_length++] = src[i] >> 8;
-        req[req_length++] = src[i] & 0x00FF;
-    }
+    req_length += byte_count;
 
     rc = send_msg(ctx, req, req_length);
     if (rc > 0) {
@@ -1565,11 +1902,7 @@ int modbus_write_and_read_registers(modbus_t *ctx,
             return -1;
 
         offset = ctx->backend->header_length;
-        for (i = 0; i < rc; i++) {
-            /* shift reg hi_byte to temp OR with lo_byte */
-            dest[i] = (rsp[offset + 2 + (i << 1)] << 8) |
-                rsp[offset + 3 + (i << 1)];
-        }
+        decode_registers(rsp + offset + 2, rc, dest);
     }
 
     return rc;
@@ -1620,16 +1953,765 @@ int modbus_report_slave_id(modbus_t *ctx, uint8_t *dest)
     return rc;
 }
 
-void _modbus_init_common(modbus_t *ctx)
+/* Builds the request described by r and returns its length */
+static int build_request(modbus_t *ctx, const modbus_request_t *r, uint8_t *req)
 {
-    /* Slave and socket are initialized to -1 */
-    ctx->slave = -1;
-    ctx->s = -1;
-
-    ctx->debug = FALSE;
-    ctx->error_recovery = MODBUS_ERROR_RECOVERY_NONE;
+    int req_length;
+    int byte_count;
 
-    ctx->response_timeout.tv_sec = 0;
+    switch (r->function) {
+    case _FC_READ_COILS:
+    case _FC_READ_DISCRETE_INPUTS:
+        if (r->nb > MODBUS_MAX_READ_BITS) {
+            errno = EMBMDATA;
+            return -1;
+        }
+        return ctx->backend->build_request_basis(ctx, r->function,
+                                                 r->addr, r->nb, req);
+    case _FC_READ_HOLDING_REGISTERS:
+    case _FC_READ_INPUT_REGISTERS:
+        if (r->nb > MODBUS_MAX_READ_REGISTERS) {
+            errno = EMBMDATA;
+            return -1;
+        }
+        return ctx->backend->build_request_basis(ctx, r->function,
+                                                 r->addr, r->nb, req);
+    case _FC_WRITE_SINGLE_COIL:
+        return ctx->backend->build_request_basis(
+            ctx, r->function, r->addr,
+            ((const uint8_t *)r->data)[0] ? 0xFF00 : 0, req);
+    case _FC_WRITE_SINGLE_REGISTER:
+        return ctx->backend->build_request_basis(
+            ctx, r->function, r->addr, ((const uint16_t *)r->data)[0], req);
+    case _FC_WRITE_MULTIPLE_COILS:
+        if (r->nb > MODBUS_MAX_WRITE_BITS) {
+            errno = EMBMDATA;
+            return -1;
+        }
+        req_length = ctx->backend->build_request_basis(ctx, r->function,
+                                                       r->addr, r->nb, req);
+        byte_count = encode_bits(req + req_length + 1, r->nb, r->data);
+        req[req_length++] = byte_count;
+        return req_length + byte_count;
+    case _FC_WRITE_MULTIPLE_REGISTERS:
+        if (r->nb > MODBUS_MAX_WRITE_REGISTERS) {
+            errno = EMBMDATA;
+            return -1;
+        }
+        req_length = ctx->backend->build_request_basis(ctx, r->function,
+                                                       r->addr, r->nb, req);
+        byte_count = encode_registers(req + req_length + 1, r->nb, r->data);
+        req[req_length++] = byte_count;
+        return req_length + byte_count;
+    default:
+        errno = EINVAL;
+        return -1;
+    }
+}
+
+/* Checks the response rsp of the request req described by r and stores the
+   values read in r->data. Returns the number of values read or written. */
+static int decode_response(modbus_t *ctx, const modbus_request_t *r,
+                           uint8_t *req, uint8_t *rsp, int rsp_length)
+{
+    const int offset = ctx->backend->header_length;
+    int rc;
+
+    rc = check_confirmation(ctx, req, rsp, rsp_length);
+    if (rc == -1)
+        return -1;
+
+    switch (r->function) {
+    case _FC_READ_COILS:
+    case _FC_READ_DISCRETE_INPUTS:
+        decode_bits(rsp + offset + 2, r->nb, r->data);
+        rc = r->nb;
+        break;
+    case _FC_READ_HOLDING_REGISTERS:
+    case _FC_READ_INPUT_REGISTERS:
+        decode_registers(rsp + offset + 2, rc, r->data);
+        break;
+    default:
+        break;
+    }
+
+    return rc;
+}
+
+/* A request of modbus_pipeline() waiting for its response */
+typedef struct {
+    int t_id;
+    modbus_request_t *request;
+    uint8_t req[MAX_MESSAGE_LENGTH];
+} pending_t;
+
+/* Returns the transaction ID of a message (always 0 in RTU) */
+static int message_tid(modbus_t *ctx, const uint8_t *msg)
+{
+    int dummy_length = MAX_MESSAGE_LENGTH;
+
+    return ctx->backend->prepare_response_tid(msg, &dummy_length);
+}
+
+/* Sends the nb_reqs requests of reqs without waiting for the responses in
+   between, up to max_in_flight requests are outstanding at the same time.
+
+   The responses are associated to their requests by the transaction ID of the
+   MBAP header so the server is free to reply in any order. Without
+   transaction ID (RTU), the requests are sent one by one.
+
+   The function shall return the number of successful requests, the result of
+   each request is stored in its rc and errnum fields. If the link fails,
+   all the remaining requests are set in error and -1 is returned.
+*/
+int modbus_pipeline(modbus_t *ctx, modbus_request_t *reqs, int nb_reqs,
+                    int max_in_flight)
+{
+    int rc;
+    int nb_ok = 0;
+    int nb_pending = 0;
+    int next = 0;
+    int saved_error_recovery;
+    pending_t *pending;
+    uint8_t rsp[MAX_MESSAGE_LENGTH];
+
+    if (ctx == NULL || nb_reqs < 0 || (nb_reqs > 0 && reqs == NULL) ||
+        max_in_flight < 1) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (ctx->backend->backend_type != _MODBUS_BACKEND_TYPE_TCP)
+        max_in_flight = 1;
+    if (max_in_flight > nb_reqs)
+        max_in_flight = nb_reqs;
+    if (nb_reqs == 0)
+        return 0;
+
+    pending = (pending_t *) malloc(max_in_flight * sizeof(pending_t));
+    if (pending == NULL) {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    /* A flush on a protocol error would drop the responses of the other
+       requests in flight */
+    saved_error_recovery = ctx->error_recovery;
+    if (max_in_flight > 1)
+        ctx->error_recovery &= ~MODBUS_ERROR_RECOVERY_PROTOCOL;
+
+    while (next < nb_reqs || nb_pending > 0) {
+        int i;
+        int t_id;
+        modbus_request_t *r;
+
+        /* Fill the pipeline */
+        while (next < nb_reqs && nb_pending < max_in_flight) {
+            pending_t *p = &pending[nb_pending];
+            int req_length;
+
+            r = &reqs[next++];
+            req_length = build_request(ctx, r, p->req);
+            if (req_length == -1) {
+                r->rc = -1;
+                r->errnum = errno;
+                continue;
+            }
+
+            rc = send_msg(ctx, p->req, req_length);
+            if (rc == -1) {
+                next--;
+                goto fail;
+            }
+
+            p->t_id = message_tid(ctx, p->req);
+            p->request = r;
+            nb_pending++;
+        }
+
+        if (nb_pending == 0)
+            break;
+
+        rc = _modbus_receive_msg(ctx, rsp, MSG_CONFIRMATION, NULL);
+        if (rc == -1)
+            goto fail;
+
+        t_id = message_tid(ctx, rsp);
+        for (i = 0; i < nb_pending && pending[i].t_id != t_id; i++)
+            ;
+        if (i == nb_pending) {
+            /* Late response to a request of a previous exchange */
+            if (ctx->debug) {
+                fprintf(stderr, "Response with unknown TID 0x%X ignored\n",
+                        t_id);
+            }
+            continue;
+        }
+
+        r = pending[i].request;
+        rc = decode_response(ctx, r, pending[i].req, rsp, rc);
+        if (rc == -1) {
+            r->rc = -1;
+            r->errnum = errno;
+        } else {
+            r->rc = rc;
+            r->errnum = 0;
+            nb_ok++;
+        }
+
+        /* The last pending request takes the free slot */
+        nb_pending--;
+        if (i != nb_pending)
+            memcpy(&pending[i], &pending[nb_pending], sizeof(pending_t));
+    }
+
+    ctx->error_recovery = saved_error_recovery;
+    free(pending);
+
+    return nb_ok;
+
+fail:
+    {
+        int saved_errno = errno;
+        int i;
+
+        for (i = 0; i < nb_pending; i++) {
+            pending[i].request->rc = -1;
+            pending[i].request->errnum = saved_errno;
+        }
+        for (; next < nb_reqs; next++) {
+            reqs[next].rc = -1;
+            reqs[next].errnum = saved_errno;
+        }
+
+        ctx->error_recovery = saved_error_recovery;
+        free(pending);
+        errno = saved_errno;
+    }
+
+    return -1;
+}
+
+/* Splits a range larger than a PDU into the largest requests, up to
+   max_in_flight of them are outstanding in TCP. The data are an array of
+   uint8_t for bits or uint16_t for registers. */
+static int range_requests(modbus_t *ctx, int function, int max_nb, int addr,
+                          int nb, void *data, int max_in_flight)
+{
+    modbus_request_t *reqs;
+    int nb_reqs;
+    int done;
+    int rc;
+    int i;
+
+    if (ctx == NULL || data == NULL || max_in_flight < 1) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (nb < 1 || addr < 0 || addr + nb > 0x10000) {
+        if (ctx->debug) {
+            fprintf(stderr, "ERROR Invalid range (%d values at %d)\n",
+                    nb, addr);
+        }
+        errno = EMBMDATA;
+        return -1;
+    }
+
+    nb_reqs = (nb + max_nb - 1) / max_nb;
+    reqs = (modbus_request_t *) malloc(nb_reqs * sizeof(modbus_request_t));
+    if (reqs == NULL) {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    for (i = 0, done = 0; i < nb_reqs; i++, done += max_nb) {
+        reqs[i].function = function;
+        reqs[i].addr = addr + done;
+        reqs[i].nb = (nb - done < max_nb) ? nb - done : max_nb;
+        if (function == _FC_READ_COILS || function == _FC_READ_DISCRETE_INPUTS ||
+            function == _FC_WRITE_MULTIPLE_COILS)
+            reqs[i].data = (uint8_t *) data + done;
+        else
+            reqs[i].data = (uint16_t *) data + done;
+    }
+
+    rc = modbus_pipeline(ctx, reqs, nb_reqs, max_in_flight);
+    if (rc == nb_reqs) {
+        rc = nb;
+    } else if (rc != -1) {
+        /* Report the error of the first failed chunk */
+        for (i = 0; reqs[i].rc != -1; i++)
+            ;
+        errno = reqs[i].errnum;
+        rc = -1;
+    }
+    free(reqs);
+
+    return rc;
+}
+
+/* Reads a range of bits of any length */
+int modbus_read_bits_range(modbus_t *ctx, int addr, int nb, uint8_t *dest,
+                           int max_in_flight)
+{
+    return range_requests(ctx, _FC_READ_COILS, MODBUS_MAX_READ_BITS,
+                          addr, nb, dest, max_in_flight);
+}
+
+/* Reads a range of input bits of any length */
+int modbus_read_input_bits_range(modbus_t *ctx, int addr, int nb,
+                                 uint8_t *dest, int max_in_flight)
+{
+    return range_requests(ctx, _FC_READ_DISCRETE_INPUTS, MODBUS_MAX_READ_BITS,
+                          addr, nb, dest, max_in_flight);
+}
+
+/* Reads a range of holding registers of any length */
+int modbus_read_registers_range(modbus_t *ctx, int addr, int nb,
+                                uint16_t *dest, int max_in_flight)
+{
+    return range_requests(ctx, _FC_READ_HOLDING_REGISTERS,
+                          MODBUS_MAX_READ_REGISTERS, addr, nb, dest,
+                          max_in_flight);
+}
+
+/* Reads a range of input registers of any length */
+int modbus_read_input_registers_range(modbus_t *ctx, int addr, int nb,
+                                      uint16_t *dest, int max_in_flight)
+{
+    return range_requests(ctx, _FC_READ_INPUT_REGISTERS,
+                          MODBUS_MAX_READ_REGISTERS, addr, nb, dest,
+                          max_in_flight);
+}
+
+/* Writes a range of bits of any length */
+int modbus_write_bits_range(modbus_t *ctx, int addr, int nb,
+                            const uint8_t *src, int max_in_flight)
+{
+    return range_requests(ctx, _FC_WRITE_MULTIPLE_COILS, MODBUS_MAX_WRITE_BITS,
+                          addr, nb, (uint8_t *) src, max_in_flight);
+}
+
+/* Writes a range of registers of any length */
+int modbus_write_registers_range(modbus_t *ctx, int addr, int nb,
+                                 const uint16_t *src, int max_in_flight)
+{
+    return range_requests(ctx, _FC_WRITE_MULTIPLE_REGISTERS,
+                          MODBUS_MAX_WRITE_REGISTERS, addr, nb,
+                          (uint16_t *) src, max_in_flight);
+}
+
+/* A request submitted with modbus_submit_request() */
+typedef struct {
+    modbus_request_t request;
+    modbus_callback_t cb;
+    void *user;
+    int sent;
+    int t_id;
+    /* Broadcast in RTU, completed without response */
+    int broadcast;
+    /* Monotonic time (ms) after which the response is too late */
+    int64_t deadline;
+    int req_length;
+    uint8_t req[MAX_MESSAGE_LENGTH];
+} _async_request_t;
+
+/* Requests of the context in submission order and the message being
+   received, kept between the calls of modbus_process_events() */
+struct _modbus_async {
+    _async_request_t *requests;
+    int nb_requests;
+    int max_requests;
+    _step_t step;
+    int msg_length;
+    int length_to_read;
+    uint8_t msg[MAX_MESSAGE_LENGTH];
+};
+
+static void async_reset_msg(modbus_t *ctx, struct _modbus_async *async)
+{
+    async->step = _STEP_FUNCTION;
+    async->msg_length = 0;
+    async->length_to_read = ctx->backend->header_length + 1;
+}
+
+/* Removes the request i and calls its callback */
+static void async_complete(modbus_t *ctx, int i, int rc, int errnum)
+{
+    struct _modbus_async *async = ctx->async;
+    modbus_callback_t cb = async->requests[i].cb;
+    void *user = async->requests[i].user;
+
+    async->nb_requests--;
+    memmove(&async->requests[i], &async->requests[i + 1],
+            (async->nb_requests - i) * sizeof(_async_request_t));
+
+    cb(ctx, rc, errnum, user);
+}
+
+/* Completes all the requests with the error errnum */
+static int async_fail_all(modbus_t *ctx, int errnum)
+{
+    struct _modbus_async *async = ctx->async;
+    int nb_completed = 0;
+
+    async_reset_msg(ctx, async);
+    while (async->nb_requests > 0) {
+        async_complete(ctx, 0, -1, errnum);
+        nb_completed++;
+    }
+
+    return nb_completed;
+}
+
+static int async_send(modbus_t *ctx, _async_request_t *r)
+{
+    if (send_msg(ctx, r->req, r->req_length) == -1)
+        return -1;
+
+    r->sent = TRUE;
+    r->t_id = message_tid(ctx, r->req);
+    r->broadcast = ctx->backend->backend_type == _MODBUS_BACKEND_TYPE_RTU &&
+        r->req[0] == MODBUS_BROADCAST_ADDRESS;
+    if (r->broadcast) {
+        r->deadline = _modbus_time_ms();
+    } else {
+        r->deadline = _modbus_time_ms() + ctx->response_timeout.tv_sec * 1000 +
+            ctx->response_timeout.tv_usec / 1000;
+    }
+
+    return 0;
+}
+
+/* Sends the first request not sent yet when the link is free. Without
+   transaction ID (RTU), only one request is sent at a time. */
+static int async_send_next(modbus_t *ctx)
+{
+    struct _modbus_async *async = ctx->async;
+    int nb_completed = 0;
+
+    if (ctx->backend->backend_type != _MODBUS_BACKEND_TYPE_RTU)
+        return 0;
+
+    while (async->nb_requests > 0 && !async->requests[0].sent) {
+        if (async_send(ctx, &async->requests[0]) == 0)
+            break;
+        async_complete(ctx, 0, -1, errno);
+        nb_completed++;
+    }
+
+    return nb_completed;
+}
+
+/* Handles the complete message received and returns the number of requests
+   completed */
+static int async_receive_msg(modbus_t *ctx)
+{
+    struct _modbus_async *async = ctx->async;
+    modbus_request_t *r;
+    int msg_length;
+    int t_id;
+    int rc;
+    int i;
+
+    if (ctx->debug)
+        printf("\n");
+
+    if (ctx->traceCallback) {
+        ctx->traceCallback(async->msg, async->msg_length, 1, ctx->traceState);
+    }
+
+    msg_length = async->msg_length;
+    async_reset_msg(ctx, async);
+    rc = ctx->backend->check_integrity(ctx, async->msg, msg_length);
+    if (rc == -1) {
+        /* The request of a corrupted response can't be known but only one
+           request is sent at a time without transaction ID */
+        if (ctx->backend->backend_type == _MODBUS_BACKEND_TYPE_RTU &&
+            async->nb_requests > 0 && async->requests[0].sent) {
+            async_complete(ctx, 0, -1, errno);
+            return 1;
+        }
+        return 0;
+    }
+
+    t_id = message_tid(ctx, async->msg);
+    for (i = 0; i < async->nb_requests; i++) {
+        if (async->requests[i].sent && async->requests[i].t_id == t_id)
+            break;
+    }
+    if (i == async->nb_requests) {
+        /* Late response to a request which has timed out */
+        if (ctx->debug) {
+            fprintf(stderr, "Response with unknown TID 0x%X ignored\n", t_id);
+        }
+        return 0;
+    }
+
+    r = &async->requests[i].request;
+    rc = decode_response(ctx, r, async->requests[i].req, async->msg, rc);
+    async_complete(ctx, i, rc, (rc == -1) ? errno : 0);
+
+    return 1;
+}
+
+/* Submits a request without waiting for its response: cb is called by
+   modbus_process_events() when the response is received or when the
+   request fails. Returns -1 if the request can't be sent. */
+int modbus_submit_request(modbus_t *ctx, const modbus_request_t *r,
+                          modbus_callback_t cb, void *user)
+{
+    struct _modbus_async *async;
+    _async_request_t *ar;
+
+    if (ctx == NULL || r == NULL || cb == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (ctx->async == NULL) {
+        ctx->async = (struct _modbus_async *) calloc(1, sizeof(struct _modbus_async));
+        if (ctx->async == NULL) {
+            errno = ENOMEM;
+            return -1;
+        }
+        async_reset_msg(ctx, ctx->async);
+    }
+    async = ctx->async;
+
+    if (async->nb_requests == async->max_requests) {
+        int max_requests = async->max_requests ? async->max_requests * 2 : 8;
+        _async_request_t *requests;
+
+        requests = (_async_request_t *) realloc(
+            async->requests, max_requests * sizeof(_async_request_t));
+        if (requests == NULL) {
+            errno = ENOMEM;
+            return -1;
+        }
+        async->requests = requests;
+        async->max_requests = max_requests;
+    }
+
+    ar = &async->requests[async->nb_requests];
+    ar->req_length = build_request(ctx, r, ar->req);
+    if (ar->req_length == -1)
+        return -1;
+    ar->request = *r;
+    ar->cb = cb;
+    ar->user = user;
+    ar->sent = FALSE;
+
+    /* Queued behind the request in flight without transaction ID */
+    if (ctx->backend->backend_type != _MODBUS_BACKEND_TYPE_RTU ||
+        async->nb_requests == 0) {
+        if (async_send(ctx, ar) == -1)
+            return -1;
+    }
+    async->nb_requests++;
+
+    return 0;
+}
+
+int modbus_submit_read_registers(modbus_t *ctx, int addr, int nb,
+                                 uint16_t *dest, modbus_callback_t cb,
+                                 void *user)
+{
+    modbus_request_t r;
+
+    if (nb > MODBUS_MAX_READ_REGISTERS) {
+        if (ctx != NULL && ctx->debug) {
+            fprintf(stderr,
+                    "ERROR Too many registers requested (%d > %d)\n",
+                    nb, MODBUS_MAX_READ_REGISTERS);
+        }
+        errno = EMBMDATA;
+        return -1;
+    }
+
+    memset(&r, 0, sizeof(r));
+    r.function = _FC_READ_HOLDING_REGISTERS;
+    r.addr = addr;
+    r.nb = nb;
+    r.data = dest;
+
+    return modbus_submit_request(ctx, &r, cb, user);
+}
+
+/* Returns the descriptor to watch for reading on behalf of the submitted
+   requests and stores in timeout the delay (ms) before the next request times
+   out, -1 if there is no request in flight */
+int modbus_get_pollfd(modbus_t *ctx, int *timeout)
+{
+    struct _modbus_async *async;
+
+    if (ctx == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (timeout != NULL) {
+        int64_t now = _modbus_time_ms();
+        int i;
+
+        async = ctx->async;
+        *timeout = -1;
+        for (i = 0; async != NULL && i < async->nb_requests; i++) {
+            int64_t delay;
+
+            if (!async->requests[i].sent)
+                continue;
+            delay = async->requests[i].deadline - now;
+            if (delay < 0)
+                delay = 0;
+            if (*timeout == -1 || delay < *timeout)
+                *timeout = (delay > INT_MAX) ? INT_MAX : (int)delay;
+        }
+    }
+
+    return ctx->s;
+}
+
+/* Reads the bytes received without blocking, completes the requests whose
+   response is received or which have timed out and sends the queued ones.
+
+   The function shall return the number of requests completed. If the link
+   fails, all the requests are completed with the error and -1 is returned.
+*/
+int modbus_process_events(modbus_t *ctx)
+{
+    struct _modbus_async *async;
+    int saved_error_recovery;
+    int nb_completed = 0;
+    int64_t now;
+    int rc;
+    int i;
+
+    if (ctx == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    async = ctx->async;
+    if (async == NULL)
+        return 0;
+
+    /* The recovery of protocol errors sleeps and flushes the responses of the
+       other requests in flight */
+    saved_error_recovery = ctx->error_recovery;
+    ctx->error_recovery &= ~MODBUS_ERROR_RECOVERY_PROTOCOL;
+    /* The frames are assembled from the lengths (RTU), the silence ending
+       them isn't waited */
+    ctx->recv_nowait = TRUE;
+
+    for (;;) {
+        struct timeval tv;
+
+        tv.tv_sec = 0;
+        tv.tv_usec = 0;
+        rc = ctx->backend->wait(ctx, &tv, async->length_to_read, NULL);
+        if (rc == -1) {
+            if (errno == ETIMEDOUT)
+                break;
+            _error_print(ctx, "wait");
+            goto fail;
+        }
+
+        rc = ctx->backend->recv(ctx, async->msg + async->msg_length,
+                                async->length_to_read);
+        if (rc == 0) {
+            errno = ECONNRESET;
+            rc = -1;
+        }
+        if (rc == -1) {
+            _error_print(ctx, "read");
+            goto fail;
+        }
+
+        if (ctx->debug) {
+            for (i = 0; i < rc; i++)
+                printf("<%.2X>", async->msg[async->msg_length + i]);
+        }
+
+        async->msg_length += rc;
+        async->length_to_read -= rc;
+        if (async->length_to_read == 0) {
+            async->length_to_read = next_step(ctx, async->msg,
+                                              async->msg_length,
+                                              MSG_CONFIRMATION, &async->step);
+            if (async->length_to_read == -1) {
+                /* The start of the next message is unknown */
+                ctx->backend->flush(ctx);
+                errno = EMBBADDATA;
+                goto fail;
+            }
+        }
+        /* Negative when the backend reads the whole frame at once (RTU) */
+        if (async->length_to_read <= 0)
+            nb_completed += async_receive_msg(ctx);
+    }
+
+    now = _modbus_time_ms();
+    for (i = 0; i < async->nb_requests; ) {
+        if (async->requests[i].broadcast) {
+            const modbus_request_t *r = &async->requests[i].request;
+
+            async_complete(ctx, i, (r->function == _FC_WRITE_SINGLE_COIL ||
+                                    r->function == _FC_WRITE_SINGLE_REGISTER) ?
+                           1 : r->nb, 0);
+            nb_completed++;
+        } else if (async->requests[i].sent && async->requests[i].deadline <= now) {
+            /* The end of a response can't be told from the start of the
+               next one without transaction ID */
+            if (ctx->backend->backend_type == _MODBUS_BACKEND_TYPE_RTU)
+                async_reset_msg(ctx, async);
+            async_complete(ctx, i, -1, ETIMEDOUT);
+            nb_completed++;
+        } else {
+            i++;
+        }
+    }
+
+    ctx->recv_nowait = FALSE;
+    nb_completed += async_send_next(ctx);
+    ctx->error_recovery = saved_error_recovery;
+
+    return nb_completed;
+
+fail:
+    {
+        int saved_errno = errno;
+
+        ctx->recv_nowait = FALSE;
+        async_fail_all(ctx, saved_errno);
+        ctx->error_recovery = saved_error_recovery;
+        errno = saved_errno;
+    }
+
+    return -1;
+}
+
+void _modbus_async_free(modbus_t *ctx)
+{
+    if (ctx->async == NULL)
+        return;
+
+    free(ctx->async->requests);
+    free(ctx->async);
+    ctx->async = NULL;
+}
+
+void _modbus_init_common(modbus_t *ctx)
+{
+    /* Slave and socket are initialized to -1 */
+    ctx->slave = -1;
+    ctx->s = -1;
+
+    ctx->debug = FALSE;
+    ctx->error_recovery = MODBUS_ERROR_RECOVERY_NONE;
+
+    ctx->response_timeout.tv_sec = 0;
     ctx->response_timeout.tv_usec = _RESPONSE_TIMEOUT;
 
     ctx->byte_timeout.tv_sec = 0;
@@ -1637,7 +2719,16 @@ void _modbus_init_common(modbus_t *ctx)
 
     ctx->traceCallback = 0;
     ctx->traceState = 0;
-
+    ctx->async = NULL;
+    ctx->cancel = NULL;
+    ctx->pool_endpoint = NULL;
+
+    ctx->has_reconnect_policy = FALSE;
+    ctx->nb_connect_failures = 0;
+    ctx->next_connect = 0;
+    ctx->connecting = FALSE;
+    ctx->jitter_seed = (unsigned int)_modbus_time_ms() ^ (unsigned int)(size_t)ctx;
+    ctx->recv_nowait = FALSE;
 }
 
 /* Define the slave number */
@@ -1671,7 +2762,7 @@ int modbus_set_socket(modbus_t *ctx, int s)
         return -1;
     }
 
-    ctx->s = s;
+    ctx->backend->set_socket(ctx, s);
     return 0;
 }
 
@@ -1685,6 +2776,131 @@ int modbus_get_socket(modbus_t *ctx)
     return ctx->s;
 }
 
+/* Creates a handle to interrupt the waits of the contexts it's set on. Once
+   signaled, the handle stays signaled until it's reset so a single call
+   interrupts all the threads waiting on it. */
+modbus_cancel_t* modbus_cancel_new(void)
+{
+#ifdef _WIN32
+    errno = ENOTSUP;
+    return NULL;
+#else
+    modbus_cancel_t *cancel;
+
+    cancel = (modbus_cancel_t *) malloc(sizeof(modbus_cancel_t));
+    if (cancel == NULL) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+#if HAVE_SYS_EVENTFD_H
+    cancel->fd_read = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (cancel->fd_read == -1) {
+        free(cancel);
+        return NULL;
+    }
+    cancel->fd_write = cancel->fd_read;
+#else
+    {
+        int fds[2];
+        int i;
+
+        if (pipe(fds) == -1) {
+            free(cancel);
+            return NULL;
+        }
+        for (i = 0; i < 2; i++) {
+            fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+            fcntl(fds[i], F_SETFL, fcntl(fds[i], F_GETFL) | O_NONBLOCK);
+        }
+        cancel->fd_read = fds[0];
+        cancel->fd_write = fds[1];
+    }
+#endif
+
+    return cancel;
+#endif
+}
+
+/* Can be called from another thread or a signal handler */
+int modbus_cancel_signal(modbus_cancel_t *cancel)
+{
+#ifdef _WIN32
+    errno = ENOTSUP;
+    return -1;
+#else
+#if HAVE_SYS_EVENTFD_H
+    uint64_t value = 1;
+#else
+    uint8_t value = 1;
+#endif
+
+    if (cancel == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (write(cancel->fd_write, &value, sizeof(value)) != sizeof(value)) {
+        /* The pipe is full of previous signals */
+        if (errno != EAGAIN)
+            return -1;
+    }
+
+    return 0;
+#endif
+}
+
+int modbus_cancel_reset(modbus_cancel_t *cancel)
+{
+#ifdef _WIN32
+    errno = ENOTSUP;
+    return -1;
+#else
+    uint8_t buf[64];
+
+    if (cancel == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    /* Reads the counter or empties the pipe */
+    while (read(cancel->fd_read, buf, sizeof(buf)) > 0) {
+    }
+
+    return 0;
+#endif
+}
+
+void modbus_cancel_free(modbus_cancel_t *cancel)
+{
+    if (cancel == NULL)
+        return;
+
+#ifndef _WIN32
+    if (cancel->fd_write != cancel->fd_read)
+        close(cancel->fd_write);
+    close(cancel->fd_read);
+#endif
+    free(cancel);
+}
+
+/* The handle can be shared by many contexts, NULL removes it */
+int modbus_set_cancel(modbus_t *ctx, modbus_cancel_t *cancel)
+{
+    if (ctx == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    ctx->cancel = cancel;
+    return 0;
+}
+
+int _modbus_cancel_fd(modbus_t *ctx)
+{
+    return ctx->cancel != NULL ? ctx->cancel->fd_read : -1;
+}
+
 /* Get the timeout interval used to wait for a response */
 int modbus_get_response_timeout(modbus_t *ctx, struct timeval *timeout)
 {
@@ -1743,12 +2959,78 @@ int modbus_get_header_length(modbus_t *ctx)
 
 int modbus_connect(modbus_t *ctx)
 {
+    int rc;
+
     if (ctx == NULL) {
         errno = EINVAL;
         return -1;
     }
 
-    return ctx->backend->connect(ctx);
+    if (ctx->connecting)
+        modbus_close(ctx);
+
+    rc = ctx->backend->connect(ctx);
+    _connect_done(ctx, rc);
+
+    return rc;
+}
+
+/* Connects without waiting, to be called again when the socket is writable
+   while -1 is returned with errno set to EINPROGRESS. The attempts follow
+   the reconnection policy of the context. */
+int modbus_connect_async(modbus_t *ctx)
+{
+    int rc;
+
+    if (ctx == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (ctx->s != -1 && !ctx->connecting)
+        return 0;
+
+    if (!ctx->connecting && _connect_allowed(ctx) == -1)
+        return -1;
+
+    rc = ctx->backend->connect_async(ctx);
+    if (rc == -1 && errno == EINPROGRESS) {
+        ctx->connecting = TRUE;
+        return -1;
+    }
+    _connect_done(ctx, rc);
+
+    return rc;
+}
+
+int modbus_set_reconnect_policy(modbus_t *ctx,
+                                const modbus_reconnect_policy_t *policy)
+{
+    if (ctx == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (policy == NULL) {
+        ctx->has_reconnect_policy = FALSE;
+    } else {
+        if (_timeval_to_ms(&policy->min_delay) < 0 ||
+            _timeval_to_ms(&policy->max_delay) <
+            _timeval_to_ms(&policy->min_delay) ||
+            policy->jitter < 0 || policy->jitter > 100 ||
+            policy->max_attempts < 0) {
+            errno = EINVAL;
+            return -1;
+        }
+        ctx->reconnect_policy = *policy;
+        ctx->has_reconnect_policy = TRUE;
+    }
+
+    /* A new policy allows the attempts again */
+    ctx->nb_connect_failures = 0;
+    ctx->next_connect = 0;
+
+    return 0;
 }
 
 void modbus_close(modbus_t *ctx)
@@ -1756,6 +3038,7 @@ void modbus_close(modbus_t *ctx)
     if (ctx == NULL)
         return;
 
+    ctx->connecting = FALSE;
     ctx->backend->close(ctx);
 }
 
@@ -1764,6 +3047,7 @@ void modbus_free(modbus_t *ctx)
     if (ctx == NULL)
         return;
 
+    _modbus_async_free(ctx);
     ctx->backend->free(ctx);
 }
 
@@ -1867,6 +3151,7 @@ void modbus_mapping_free(modbus_mapping_t *mb_mapping)
         return;
     }
 
+    _modbus_mapping_free_ext(mb_mapping);
     free(mb_mapping->tab_input_registers);
     free(mb_mapping->tab_registers);
     free(mb_mapping->tab_input_bits);
@@ -71,6 +71,20 @@ MODBUS_BEGIN_DECLS
 #define ON 1
 #endif
 
+/* Modbus function codes */
+#define MODBUS_FC_READ_COILS                0x01
+#define MODBUS_FC_READ_DISCRETE_INPUTS      0x02
+#define MODBUS_FC_READ_HOLDING_REGISTERS    0x03
+#define MODBUS_FC_READ_INPUT_REGISTERS      0x04
+#define MODBUS_FC_WRITE_SINGLE_COIL         0x05
+#define MODBUS_FC_WRITE_SINGLE_REGISTER     0x06
+#define MODBUS_FC_READ_EXCEPTION_STATUS     0x07
+#define MODBUS_FC_WRITE_MULTIPLE_COILS      0x0F
+#define MODBUS_FC_WRITE_MULTIPLE_REGISTERS  0x10
+#define MODBUS_FC_REPORT_SLAVE_ID           0x11
+#define MODBUS_FC_MASK_WRITE_REGISTER       0x16
+#define MODBUS_FC_WRITE_AND_READ_REGISTERS  0x17
+
 #define MODBUS_BROADCAST_ADDRESS    0
 
 /* Modbus_Application_Protocol_V1_1b.pdf (chapter 6 section 1 page 12)
@@ -136,6 +150,8 @@ extern const unsigned int libmodbus_version_minor;
 extern const unsigned int libmodbus_version_micro;
 
 typedef struct _modbus modbus_t;
+/* Handle to interrupt the waits of one or many contexts */
+typedef struct _modbus_cancel modbus_cancel_t;
 
 typedef struct {
     int nb_bits;
@@ -148,6 +164,51 @@ typedef struct {
     uint16_t *tab_registers;
 } modbus_mapping_t;
 
+/* Flags of modbus_mapping_new_ext() */
+#define MODBUS_MAPPING_CONCURRENT       (1 << 0)
+/* tab_bits and tab_input_bits hold 8 bits by byte, the least significant bit
+   first (as in the Modbus frames) */
+#define MODBUS_MAPPING_PACKED_BITS      (1 << 1)
+
+/* Tables of a mapping */
+#define MODBUS_MAPPING_BITS             0
+#define MODBUS_MAPPING_INPUT_BITS       1
+#define MODBUS_MAPPING_REGISTERS        2
+#define MODBUS_MAPPING_INPUT_REGISTERS  3
+
+/* Request of a batch sent with modbus_pipeline() */
+typedef struct {
+    /* Function code (MODBUS_FC_*), start address and number of values */
+    int function;
+    int addr;
+    int nb;
+    /* Destination of the values read or source of the values written
+       (uint8_t * for bits, uint16_t * for registers). Single write functions
+       only use the first element. */
+    void *data;
+    /* Set on completion: number of values read or written, or -1 and the
+       error code in errnum */
+    int rc;
+    int errnum;
+} modbus_request_t;
+
+/* Completion of a request submitted with modbus_submit_request(): rc is the
+   number of values read or written, or -1 and errnum is the error code */
+typedef void (*modbus_callback_t)(modbus_t *ctx, int rc, int errnum, void *user);
+
+/* Delays between the connection attempts after a failure, see
+   modbus_set_reconnect_policy() */
+typedef struct {
+    /* Delay after the first failure, doubled after each failure in a row up
+       to max_delay */
+    struct timeval min_delay;
+    struct timeval max_delay;
+    /* Part of each delay removed at random, in percent (0 to 100) */
+    int jitter;
+    /* Failures in a row before giving up (0 for no limit) */
+    int max_attempts;
+} modbus_reconnect_policy_t;
+
 typedef enum
 {
     MODBUS_ERROR_RECOVERY_NONE          = 0,
@@ -160,6 +221,12 @@ MODBUS_API int modbus_set_error_recovery(modbus_t *ctx, modbus_error_recovery_mo
 MODBUS_API int modbus_set_socket(modbus_t *ctx, int s);
 MODBUS_API int modbus_get_socket(modbus_t *ctx);
 
+MODBUS_API modbus_cancel_t* modbus_cancel_new(void);
+MODBUS_API int modbus_cancel_signal(modbus_cancel_t *cancel);
+MODBUS_API int modbus_cancel_reset(modbus_cancel_t *cancel);
+MODBUS_API void modbus_cancel_free(modbus_cancel_t *cancel);
+MODBUS_API int modbus_set_cancel(modbus_t *ctx, modbus_cancel_t *cancel);
+
 MODBUS_API int modbus_get_response_timeout(modbus_t *ctx, struct timeval *timeout);
 MODBUS_API int modbus_set_response_timeout(modbus_t *ctx, const struct timeval *timeout);
 
@@ -169,6 +236,9 @@ MODBUS_API int modbus_set_byte_timeout(modbus_t *ctx, const struct timeval *time
 MODBUS_API int modbus_get_header_length(modbus_t *ctx);
 
 MODBUS_API int modbus_connect(modbus_t *ctx);
+MODBUS_API int modbus_connect_async(modbus_t *ctx);
+MODBUS_API int modbus_set_reconnect_policy(modbus_t *ctx,
+                                           const modbus_reconnect_policy_t *policy);
 MODBUS_API void modbus_close(modbus_t *ctx);
 
 MODBUS_API void modbus_free(modbus_t *ctx);
@@ -191,10 +261,41 @@ MODBUS_API int modbus_write_and_read_registers(modbus_t *ctx, int write_addr, in
                                            const uint16_t *src, int read_addr, int read_nb,
                                            uint16_t *dest);
 MODBUS_API int modbus_report_slave_id(modbus_t *ctx, uint8_t *dest);
+MODBUS_API int modbus_read_bits_range(modbus_t *ctx, int addr, int nb, uint8_t *dest,
+                                      int max_in_flight);
+MODBUS_API int modbus_read_input_bits_range(modbus_t *ctx, int addr, int nb, uint8_t *dest,
+                                            int max_in_flight);
+MODBUS_API int modbus_read_registers_range(modbus_t *ctx, int addr, int nb, uint16_t *dest,
+                                           int max_in_flight);
+MODBUS_API int modbus_read_input_registers_range(modbus_t *ctx, int addr, int nb, uint16_t *dest,
+                                                 int max_in_flight);
+MODBUS_API int modbus_write_bits_range(modbus_t *ctx, int addr, int nb, const uint8_t *src,
+                                       int max_in_flight);
+MODBUS_API int modbus_write_registers_range(modbus_t *ctx, int addr, int nb, const uint16_t *src,
+                                            int max_in_flight);
+MODBUS_API int modbus_pipeline(modbus_t *ctx, modbus_request_t *reqs, int nb_reqs,
+                               int max_in_flight);
+
+MODBUS_API int modbus_submit_request(modbus_t *ctx, const modbus_request_t *r,
+                                     modbus_callback_t cb, void *user);
+MODBUS_API int modbus_submit_read_registers(modbus_t *ctx, int addr, int nb,
+                                            uint16_t *dest, modbus_callback_t cb,
+                                            void *user);
+MODBUS_API int modbus_get_pollfd(modbus_t *ctx, int *timeout);
+MODBUS_API int modbus_process_events(modbus_t *ctx);
 
 MODBUS_API modbus_mapping_t* modbus_mapping_new(int nb_bits, int nb_input_bits,
                                             int nb_registers, int nb_input_registers);
 MODBUS_API void modbus_mapping_free(modbus_mapping_t *mb_mapping);
+MODBUS_API modbus_mapping_t* modbus_mapping_new_concurrent(int nb_bits, int nb_input_bits,
+                                                       int nb_registers, int nb_input_registers);
+MODBUS_API modbus_mapping_t* modbus_mapping_new_ext(int nb_bits, int nb_input_bits,
+                                                int nb_registers, int nb_input_registers,
+                                                int flags);
+MODBUS_API int modbus_mapping_read(modbus_mapping_t *mb_mapping, int table,
+                                   int addr, int nb, void *dest);
+MODBUS_API int modbus_mapping_write(modbus_mapping_t *mb_mapping, int table,
+                                    int addr, int nb, const void *src);
 
 MODBUS_API int modbus_send_raw_request(modbus_t *ctx, uint8_t *raw_req, int raw_req_length);
 
@@ -207,6 +308,9 @@ MODBUS_API int modbus_reply(modbus_t *ctx, const uint8_t *req,
                         int req_length, modbus_mapping_t *mb_mapping);
 MODBUS_API int modbus_reply_exception(modbus_t *ctx, const uint8_t *req,
                                   unsigned int exception_code);
+MODBUS_API int modbus_build_reply(modbus_t *ctx, const uint8_t *req,
+                                  int req_length, modbus_mapping_t *mb_mapping,
+                                  uint8_t *out, int out_cap);
 
 MODBUS_API int modbus_set_trace_callback(modbus_t *ctx, void (*traceCallback)(uint8_t*, int, int, void *), void *);
 
@@ -228,7 +332,11 @@ MODBUS_API int modbus_set_trace_callback(modbus_t *ctx, void (*traceCallback)(ui
 MODBUS_API void modbus_set_bits_from_byte(uint8_t *dest, int index, const uint8_t value);
 MODBUS_API void modbus_set_bits_from_bytes(uint8_t *dest, int index, unsigned int nb_bits,
                                        const uint8_t *tab_byte);
+MODBUS_API void modbus_set_bytes_from_bits(uint8_t *dest, const uint8_t *src, int index,
+                                           unsigned int nb_bits);
 MODBUS_API uint8_t modbus_get_byte_from_bits(const uint8_t *src, int index, unsigned int nb_bits);
+MODBUS_API void modbus_set_registers_from_bytes(uint16_t *dest, int nb, const uint8_t *tab_byte);
+MODBUS_API void modbus_set_bytes_from_registers(uint8_t *dest, int nb, const uint16_t *src);
 MODBUS_API float modbus_get_float(const uint16_t *src);
 MODBUS_API float modbus_get_float_dcba(const uint16_t *src);
 MODBUS_API void modbus_set_float(float f, uint16_t *dest);
@@ -241,6 +349,10 @@ MODBUS_API void modbus_set_double_dcba(double f, uint16_t *dest);
 
 #include "modbus-tcp.h"
 #include "modbus-rtu.h"
+#include "modbus-server.h"
+#include "modbus-plan.h"
+#include "modbus-pool.h"
+#include "modbus-scheduler.h"
 
 MODBUS_END_DECLS
 
@@ -29,6 +29,9 @@
 
 #define G_MSEC_PER_SEC 1000
 
+/* Number of requests in flight in the pipelined test */
+#define NB_PIPELINED 8
+
 static uint32_t gettime_ms(void)
 {
     struct timeval tv;
@@ -55,6 +58,7 @@ int main(int argc, char *argv[])
 {
     uint8_t *tab_bit;
     uint16_t *tab_reg;
+    modbus_request_t reqs[NB_PIPELINED];
     modbus_t *ctx;
     int i;
     int nb_points;
@@ -86,6 +90,7 @@ int main(int argc, char *argv[])
 
     if (use_backend == TCP) {
         ctx = modbus_new_tcp("127.0.0.1", 1502);
+        modbus_tcp_set_read_ahead(ctx, TRUE);
     } else {
         ctx = modbus_new_rtu("/dev/ttyUSB1", 115200, 'N', 8, 1);
         modbus_set_slave(ctx, 1);
@@ -179,6 +184,43 @@ int main(int argc, char *argv[])
     printf("* %d KiB/s\n", rate);
     printf("\n\n");
 
+    printf("READ REGISTERS (PIPELINED)\n\n");
+
+    nb_points = MODBUS_MAX_READ_REGISTERS;
+    for (i=0; i<NB_PIPELINED; i++) {
+        reqs[i].function = MODBUS_FC_READ_HOLDING_REGISTERS;
+        reqs[i].addr = 0;
+        reqs[i].nb = nb_points;
+        reqs[i].data = tab_reg;
+    }
+    start = gettime_ms();
+    for (i=0; i<n_loop; i += NB_PIPELINED) {
+        /* The last batch holds the remainder of n_loop */
+        int nb_reqs = (n_loop - i < NB_PIPELINED) ? n_loop - i : NB_PIPELINED;
+
+        rc = modbus_pipeline(ctx, reqs, nb_reqs, NB_PIPELINED);
+        if (rc != nb_reqs) {
+            fprintf(stderr, "%s\n", modbus_strerror(errno));
+            return -1;
+        }
+    }
+    end = gettime_ms();
+    elapsed = end - start;
+
+    rate = (n_loop * nb_points) * G_MSEC_PER_SEC / (end - start);
+    printf("Transfert rate in points/seconds:\n");
+    printf("* %d registers/s\n", rate);
+    printf("\n");
+
+    bytes = n_loop * nb_points * sizeof(uint16_t);
+    rate = bytes / 1024 * G_MSEC_PER_SEC / (end - start);
+    printf("Values:\n");
+    printf("* %d x %d values (%d requests in flight)\n", n_loop, nb_points,
+           NB_PIPELINED);
+    printf("* %.3f ms for %d bytes\n", elapsed, bytes);
+    printf("* %d KiB/s\n", rate);
+    printf("\n\n");
+
     printf("WRITE AND READ REGISTERS\n\n");
 
     nb_points = MODBUS_MAX_WR_WRITE_REGISTERS;
@@ -218,6 +260,42 @@ int main(int argc, char *argv[])
     printf("* %d KiB/s\n", rate);
     printf("\n");
 
+    if (use_backend == RTU) {
+        /* The throughput is bound by the baud rate so the receive modes are
+           compared on the CPU time used to read the responses */
+        const int tab_mode[] = { MODBUS_RTU_RECV_BYTE, MODBUS_RTU_RECV_BULK };
+        const char *tab_mode_name[] = { "byte", "bulk" };
+        int m;
+
+        printf("\nREAD REGISTERS (RTU RECEIVE MODES)\n\n");
+
+        nb_points = MODBUS_MAX_READ_REGISTERS;
+        for (m=0; m<2; m++) {
+            clock_t cpu_start;
+            clock_t cpu_end;
+
+            modbus_rtu_set_recv_mode(ctx, tab_mode[m]);
+            cpu_start = clock();
+            start = gettime_ms();
+            for (i=0; i<n_loop; i++) {
+                rc = modbus_read_registers(ctx, 0, nb_points, tab_reg);
+                if (rc == -1) {
+                    fprintf(stderr, "%s\n", modbus_strerror(errno));
+                    return -1;
+                }
+            }
+            end = gettime_ms();
+            cpu_end = clock();
+
+            printf("Receive mode %s:\n", tab_mode_name[m]);
+            printf("* %d x %d values in %d ms\n", n_loop, nb_points, end - start);
+            printf("* %.3f ms of CPU time per request\n",
+                   (double)(cpu_end - cpu_start) * 1000 / CLOCKS_PER_SEC / n_loop);
+            printf("\n");
+        }
+        modbus_rtu_set_recv_mode(ctx, MODBUS_RTU_RECV_BYTE);
+    }
+
     /* Free the memory */
     free(tab_bit);
     free(tab_reg);
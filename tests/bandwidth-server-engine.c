@@ -0,0 +1,98 @@
+/*
+ * Copyright © 2009-2010 Stéphane Raimbault <stephane.raimbault@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <signal.h>
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+#include <modbus.h>
+
+static modbus_server_t *server = NULL;
+
+static void stop_sigint(int dummy)
+{
+    (void)dummy;
+    modbus_server_stop(server);
+}
+
+int main(int argc, char *argv[])
+{
+    modbus_t *ctx;
+    modbus_mapping_t *mb_mapping;
+    int nb_threads = 1;
+    int rc;
+
+    if (argc > 1) {
+        nb_threads = atoi(argv[1]);
+    }
+
+#ifndef _WIN32
+    /* Each connection uses a file descriptor */
+    struct rlimit limit;
+
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+#endif
+
+    ctx = modbus_new_tcp("127.0.0.1", 1502);
+
+    mb_mapping = modbus_mapping_new(MODBUS_MAX_READ_BITS, 0,
+                                    MODBUS_MAX_READ_REGISTERS, 0);
+    if (mb_mapping == NULL) {
+        fprintf(stderr, "Failed to allocate the mapping: %s\n",
+                modbus_strerror(errno));
+        modbus_free(ctx);
+        return -1;
+    }
+
+    server = modbus_server_new(ctx, mb_mapping);
+    if (server == NULL) {
+        fprintf(stderr, "Failed to create the server: %s\n",
+                modbus_strerror(errno));
+        modbus_mapping_free(mb_mapping);
+        modbus_free(ctx);
+        return -1;
+    }
+
+    if (modbus_server_set_nb_threads(server, nb_threads) == -1) {
+        fprintf(stderr, "Unable to use %d threads: %s\n", nb_threads,
+                modbus_strerror(errno));
+        modbus_server_free(server);
+        modbus_mapping_free(mb_mapping);
+        modbus_free(ctx);
+        return -1;
+    }
+
+    signal(SIGINT, stop_sigint);
+
+    /* The connections are served until SIGINT */
+    rc = modbus_server_run(server);
+    if (rc == -1) {
+        fprintf(stderr, "Server failure: %s\n", modbus_strerror(errno));
+    }
+
+    modbus_server_free(server);
+    modbus_mapping_free(mb_mapping);
+    modbus_free(ctx);
+
+    return (rc == -1) ? -1 : 0;
+}
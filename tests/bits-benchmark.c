@@ -0,0 +1,177 @@
+/*
+ * Copyright © 2008-2010 Stéphane Raimbault <stephane.raimbault@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <modbus.h>
+
+#define MAX_CHECK_BITS 2048
+/* Bits converted by each implementation */
+#define NB_BENCH_BITS (256 * 1024 * 1024)
+
+/* Previous per-bit loops of the library (modbus_set_bits_from_bytes and
+   response_io_status) */
+static void unpack_reference(uint8_t *dest, int index, unsigned int nb_bits,
+                             const uint8_t *tab_byte)
+{
+    unsigned int i;
+    int shift = 0;
+
+    for (i = index; i < index + nb_bits; i++) {
+        dest[i] = tab_byte[(i - index) / 8] & (1 << shift) ? 1 : 0;
+        shift++;
+        shift %= 8;
+    }
+}
+
+static void pack_reference(uint8_t *dest, const uint8_t *src, int index,
+                           unsigned int nb_bits)
+{
+    int shift = 0;
+    int one_byte = 0;
+    int i;
+
+    for (i = index; i < index + (int)nb_bits; i++) {
+        one_byte |= src[i] << shift;
+        if (shift == 7) {
+            *dest++ = one_byte;
+            one_byte = shift = 0;
+        } else {
+            shift++;
+        }
+    }
+
+    if (shift != 0)
+        *dest = one_byte;
+}
+
+/* Called through volatile pointers so the calls can't be merged */
+typedef void (*unpack_t)(uint8_t *, int, unsigned int, const uint8_t *);
+typedef void (*pack_t)(uint8_t *, const uint8_t *, int, unsigned int);
+
+static double bench_unpack(unpack_t unpack, uint8_t *dest, int nb,
+                           const uint8_t *src)
+{
+    volatile unpack_t f = unpack;
+    long nb_loops = NB_BENCH_BITS / nb;
+    clock_t start;
+    long i;
+
+    start = clock();
+    for (i = 0; i < nb_loops; i++) {
+        f(dest, 0, nb, src);
+    }
+
+    return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+static double bench_pack(pack_t pack, uint8_t *dest, int nb,
+                         const uint8_t *src)
+{
+    volatile pack_t f = pack;
+    long nb_loops = NB_BENCH_BITS / nb;
+    clock_t start;
+    long i;
+
+    start = clock();
+    for (i = 0; i < nb_loops; i++) {
+        f(dest, src, 0, nb);
+    }
+
+    return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+int main(void)
+{
+    const int nbs[] = { 16, 256, MODBUS_MAX_WRITE_BITS, MODBUS_MAX_READ_BITS };
+    uint8_t bytes[MAX_CHECK_BITS / 8 + 1];
+    uint8_t bits[MAX_CHECK_BITS + 8];
+    uint8_t dest[MAX_CHECK_BITS + 8];
+    uint8_t dest_ref[MAX_CHECK_BITS + 8];
+    int nb;
+    int index;
+    unsigned int i;
+
+    srand(time(NULL));
+    for (i = 0; i < sizeof(bytes); i++) {
+        bytes[i] = rand();
+    }
+    for (i = 0; i < sizeof(bits); i++) {
+        bits[i] = rand() & 1;
+    }
+
+    /* Every number of bits and index must give the same result */
+    printf("CHECK:\n");
+    for (nb = 0; nb <= MAX_CHECK_BITS; nb++) {
+        for (index = 0; index < 8; index++) {
+            memset(dest, 0xAA, sizeof(dest));
+            memset(dest_ref, 0xAA, sizeof(dest_ref));
+            unpack_reference(dest_ref, index, nb, bytes);
+            modbus_set_bits_from_bytes(dest, index, nb, bytes);
+            if (memcmp(dest, dest_ref, sizeof(dest)) != 0) {
+                printf("FAILED (unpack of %d bits at %d)\n", nb, index);
+                return -1;
+            }
+
+            pack_reference(dest_ref, bits, index, nb);
+            modbus_set_bytes_from_bits(dest, bits, index, nb);
+            if (memcmp(dest, dest_ref, (nb + 7) / 8) != 0) {
+                printf("FAILED (pack of %d bits at %d)\n", nb, index);
+                return -1;
+            }
+        }
+    }
+    /* Any byte which isn't null is a bit set */
+    for (i = 0; i < sizeof(bits); i++) {
+        dest[i] = bits[i] ? 1 + rand() % 255 : 0;
+    }
+    modbus_set_bytes_from_bits(dest_ref, bits, 0, MAX_CHECK_BITS);
+    modbus_set_bytes_from_bits(dest, dest, 0, MAX_CHECK_BITS);
+    if (memcmp(dest, dest_ref, MAX_CHECK_BITS / 8) != 0 ||
+        modbus_get_byte_from_bits(bits, 3, 5) != dest_ref[0] >> 3) {
+        printf("FAILED (pack of values other than 1)\n");
+        return -1;
+    }
+    printf("* 0 to %d bits, 8 indexes: OK\n\n", MAX_CHECK_BITS);
+
+    printf("BENCHMARK:\n");
+    for (i = 0; i < sizeof(nbs) / sizeof(nbs[0]); i++) {
+        double reference_time;
+        double kernel_time;
+
+        reference_time = bench_unpack(unpack_reference, dest_ref, nbs[i], bytes);
+        kernel_time = bench_unpack(modbus_set_bits_from_bytes, dest, nbs[i], bytes);
+        printf("* %4d bits: unpack reference %8.1f Mbit/s, "
+               "modbus_set_bits_from_bytes %8.1f Mbit/s (x%.1f)\n",
+               nbs[i], NB_BENCH_BITS / reference_time / 1e6,
+               NB_BENCH_BITS / kernel_time / 1e6,
+               reference_time / kernel_time);
+
+        reference_time = bench_pack(pack_reference, dest_ref, nbs[i], bits);
+        kernel_time = bench_pack(modbus_set_bytes_from_bits, dest, nbs[i], bits);
+        printf("* %4d bits: pack reference   %8.1f Mbit/s, "
+               "modbus_set_bytes_from_bits %8.1f Mbit/s (x%.1f)\n",
+               nbs[i], NB_BENCH_BITS / reference_time / 1e6,
+               NB_BENCH_BITS / kernel_time / 1e6,
+               reference_time / kernel_time);
+    }
+
+    return 0;
+}
@@ -0,0 +1,154 @@
+/*
+ * Copyright © 2008-2010 Stéphane Raimbault <stephane.raimbault@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <modbus.h>
+
+#define MAX_CHECK_REGISTERS 256
+/* Registers converted by each implementation */
+#define NB_BENCH_REGISTERS (64 * 1024 * 1024)
+
+/* Previous per-register loops of the library */
+static void decode_reference(uint16_t *dest, int nb, const uint8_t *src)
+{
+    int i;
+
+    for (i = 0; i < nb; i++) {
+        dest[i] = (src[i << 1] << 8) | src[(i << 1) + 1];
+    }
+}
+
+static void encode_reference(uint8_t *dest, int nb, const uint16_t *src)
+{
+    int i;
+
+    for (i = 0; i < nb; i++) {
+        dest[i << 1] = src[i] >> 8;
+        dest[(i << 1) + 1] = src[i] & 0x00FF;
+    }
+}
+
+/* Called through volatile pointers so the calls can't be merged */
+typedef void (*decode_t)(uint16_t *, int, const uint8_t *);
+typedef void (*encode_t)(uint8_t *, int, const uint16_t *);
+
+static double bench_decode(decode_t decode, uint16_t *dest, int nb,
+                           const uint8_t *src)
+{
+    volatile decode_t f = decode;
+    long nb_loops = NB_BENCH_REGISTERS / nb;
+    clock_t start;
+    long i;
+
+    start = clock();
+    for (i = 0; i < nb_loops; i++) {
+        f(dest, nb, src);
+    }
+
+    return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+static double bench_encode(encode_t encode, uint8_t *dest, int nb,
+                           const uint16_t *src)
+{
+    volatile encode_t f = encode;
+    long nb_loops = NB_BENCH_REGISTERS / nb;
+    clock_t start;
+    long i;
+
+    start = clock();
+    for (i = 0; i < nb_loops; i++) {
+        f(dest, nb, src);
+    }
+
+    return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+int main(void)
+{
+    const int nbs[] = { 8, 32, MODBUS_MAX_READ_REGISTERS };
+    /* One more byte to convert from odd addresses as in the frames */
+    uint8_t bytes[MAX_CHECK_REGISTERS * 2 + 1];
+    uint8_t bytes_ref[MAX_CHECK_REGISTERS * 2 + 1];
+    uint16_t registers[MAX_CHECK_REGISTERS];
+    uint16_t registers_ref[MAX_CHECK_REGISTERS];
+    int nb;
+    int offset;
+    unsigned int i;
+
+    srand(time(NULL));
+    for (i = 0; i < sizeof(bytes); i++) {
+        bytes[i] = rand();
+    }
+    for (i = 0; i < MAX_CHECK_REGISTERS; i++) {
+        registers[i] = rand();
+    }
+
+    /* Every number of registers and alignment must give the same result */
+    printf("CHECK:\n");
+    for (nb = 0; nb <= MAX_CHECK_REGISTERS; nb++) {
+        for (offset = 0; offset < 2 && nb * 2 + offset <= (int)sizeof(bytes);
+             offset++) {
+            uint16_t decoded[MAX_CHECK_REGISTERS];
+            uint8_t encoded[MAX_CHECK_REGISTERS * 2 + 1];
+
+            decode_reference(registers_ref, nb, bytes + offset);
+            modbus_set_registers_from_bytes(decoded, nb, bytes + offset);
+            encode_reference(bytes_ref + offset, nb, registers);
+            modbus_set_bytes_from_registers(encoded + offset, nb, registers);
+            if (memcmp(decoded, registers_ref, nb * 2) != 0 ||
+                memcmp(encoded + offset, bytes_ref + offset, nb * 2) != 0) {
+                printf("FAILED (%d registers, offset %d)\n", nb, offset);
+                return -1;
+            }
+        }
+    }
+    printf("* 0 to %d registers, 2 alignments: OK\n\n", MAX_CHECK_REGISTERS);
+
+    printf("BENCHMARK:\n");
+    for (i = 0; i < sizeof(nbs) / sizeof(nbs[0]); i++) {
+        double reference_time;
+        double bswap_time;
+
+        /* Odd address of the registers in a TCP response */
+        reference_time = bench_decode(decode_reference, registers_ref, nbs[i],
+                                      bytes + 1);
+        bswap_time = bench_decode(modbus_set_registers_from_bytes, registers,
+                                  nbs[i], bytes + 1);
+        printf("* %3d registers: decode reference %7.1f M/s, "
+               "modbus_set_registers_from_bytes %7.1f M/s (x%.1f)\n",
+               nbs[i], NB_BENCH_REGISTERS / reference_time / 1e6,
+               NB_BENCH_REGISTERS / bswap_time / 1e6,
+               reference_time / bswap_time);
+
+        reference_time = bench_encode(encode_reference, bytes_ref + 1, nbs[i],
+                                      registers_ref);
+        bswap_time = bench_encode(modbus_set_bytes_from_registers, bytes + 1,
+                                  nbs[i], registers);
+        printf("* %3d registers: encode reference %7.1f M/s, "
+               "modbus_set_bytes_from_registers %7.1f M/s (x%.1f)\n",
+               nbs[i], NB_BENCH_REGISTERS / reference_time / 1e6,
+               NB_BENCH_REGISTERS / bswap_time / 1e6,
+               reference_time / bswap_time);
+    }
+
+    return 0;
+}
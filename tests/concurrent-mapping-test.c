@@ -0,0 +1,181 @@
+/*
+ * Copyright © 2009-2010 Stéphane Raimbault <stephane.raimbault@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include <modbus.h>
+
+/* All the registers read at once must hold the same value although a
+   control loop keeps on writing them while the server answers */
+#define NB_REGISTERS     MODBUS_MAX_READ_REGISTERS
+#define NB_CLIENTS       4
+#define NB_READS      5000
+
+static modbus_mapping_t *mb_mapping;
+static modbus_server_t *server;
+static volatile int running = 1;
+static int nb_errors = 0;
+static pthread_mutex_t errors_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static int check_snapshot(const uint16_t *tab_reg, int nb, const char *context)
+{
+    int i;
+
+    for (i = 1; i < nb; i++) {
+        if (tab_reg[i] != tab_reg[0]) {
+            pthread_mutex_lock(&errors_mutex);
+            nb_errors++;
+            pthread_mutex_unlock(&errors_mutex);
+            printf("FAILED (%s: register %d 0x%04X != 0x%04X)\n",
+                   context, i, tab_reg[i], tab_reg[0]);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static void *writer(void *arg)
+{
+    uint16_t tab_reg[NB_REGISTERS];
+    uint16_t value = 0;
+    int i;
+
+    (void)arg;
+    while (running) {
+        value++;
+        for (i = 0; i < NB_REGISTERS; i++)
+            tab_reg[i] = value;
+        modbus_mapping_write(mb_mapping, MODBUS_MAPPING_REGISTERS, 0,
+                             NB_REGISTERS, tab_reg);
+    }
+
+    return NULL;
+}
+
+static void *server_thread(void *arg)
+{
+    (void)arg;
+    modbus_server_run(server);
+
+    return NULL;
+}
+
+static void *client(void *arg)
+{
+    uint16_t tab_reg[NB_REGISTERS];
+    modbus_t *ctx;
+    int i;
+
+    (void)arg;
+    ctx = modbus_new_tcp("127.0.0.1", 1502);
+    if (modbus_connect(ctx) == -1) {
+        fprintf(stderr, "Connection failed: %s\n", modbus_strerror(errno));
+        modbus_free(ctx);
+        pthread_mutex_lock(&errors_mutex);
+        nb_errors++;
+        pthread_mutex_unlock(&errors_mutex);
+        return NULL;
+    }
+
+    for (i = 0; i < NB_READS; i++) {
+        if (modbus_read_registers(ctx, 0, NB_REGISTERS, tab_reg) != NB_REGISTERS) {
+            printf("FAILED (read: %s)\n", modbus_strerror(errno));
+            pthread_mutex_lock(&errors_mutex);
+            nb_errors++;
+            pthread_mutex_unlock(&errors_mutex);
+            break;
+        }
+        if (check_snapshot(tab_reg, NB_REGISTERS, "server") == -1)
+            break;
+    }
+
+    modbus_close(ctx);
+    modbus_free(ctx);
+
+    return NULL;
+}
+
+int main(void)
+{
+    uint16_t tab_reg[NB_REGISTERS];
+    pthread_t writer_thread;
+    pthread_t server_tid;
+    pthread_t clients[NB_CLIENTS];
+    modbus_t *ctx;
+    int i;
+
+    mb_mapping = modbus_mapping_new_concurrent(0, 0, NB_REGISTERS, 0);
+    if (mb_mapping == NULL) {
+        fprintf(stderr, "Failed to allocate the mapping: %s\n",
+                modbus_strerror(errno));
+        return -1;
+    }
+
+    ctx = modbus_new_tcp("127.0.0.1", 1502);
+    server = modbus_server_new(ctx, mb_mapping);
+    if (server == NULL) {
+        fprintf(stderr, "Failed to create the server: %s\n",
+                modbus_strerror(errno));
+        modbus_free(ctx);
+        modbus_mapping_free(mb_mapping);
+        return -1;
+    }
+    modbus_server_set_nb_threads(server, 2);
+
+    pthread_create(&writer_thread, NULL, writer, NULL);
+    pthread_create(&server_tid, NULL, server_thread, NULL);
+    /* Lets the server listen */
+    usleep(200000);
+
+    printf("** CONCURRENT MAPPING **\n");
+    for (i = 0; i < NB_CLIENTS; i++)
+        pthread_create(&clients[i], NULL, client, NULL);
+
+    /* Direct reads of the application */
+    for (i = 0; i < NB_READS * 10; i++) {
+        modbus_mapping_read(mb_mapping, MODBUS_MAPPING_REGISTERS, 0,
+                            NB_REGISTERS, tab_reg);
+        if (check_snapshot(tab_reg, NB_REGISTERS, "application") == -1)
+            break;
+    }
+
+    for (i = 0; i < NB_CLIENTS; i++)
+        pthread_join(clients[i], NULL);
+
+    running = 0;
+    pthread_join(writer_thread, NULL);
+    modbus_server_stop(server);
+    pthread_join(server_tid, NULL);
+
+    modbus_server_free(server);
+    modbus_free(ctx);
+    modbus_mapping_free(mb_mapping);
+
+    if (nb_errors == 0) {
+        printf("%d clients x %d reads of %d registers: OK\n",
+               NB_CLIENTS, NB_READS, NB_REGISTERS);
+        printf("\nALL TESTS PASS WITH SUCCESS.\n");
+        return 0;
+    }
+
+    return -1;
+}
@@ -0,0 +1,168 @@
+/*
+ * Copyright © 2009-2010 Stéphane Raimbault <stephane.raimbault@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include <modbus.h>
+
+/* The requests of a client to a server of a packed mapping are checked
+   against a table of one byte by bit */
+#define NB_BITS      65536
+#define NB_LOOPS      5000
+
+static modbus_server_t *server;
+static uint8_t ref_bits[NB_BITS];
+static uint8_t ref_input_bits[NB_BITS];
+
+static void *server_thread(void *arg)
+{
+    (void)arg;
+    modbus_server_run(server);
+
+    return NULL;
+}
+
+static int check_bits(const uint8_t *bits, const uint8_t *ref, int addr,
+                      int nb, const char *context)
+{
+    int i;
+
+    for (i = 0; i < nb; i++) {
+        if (bits[i] != ref[addr + i]) {
+            printf("FAILED (%s: bit %d at %d of %d bits)\n",
+                   context, addr + i, addr, nb);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+int main(void)
+{
+    uint8_t bits[MODBUS_MAX_READ_BITS];
+    uint8_t packed[MODBUS_MAX_READ_BITS / 8 + 1];
+    modbus_mapping_t *mb_mapping;
+    pthread_t server_tid;
+    modbus_t *ctx;
+    modbus_t *ctx_server;
+    int nb_errors = 0;
+    int i;
+    int j;
+
+    mb_mapping = modbus_mapping_new_ext(NB_BITS, NB_BITS, 0, 0,
+                                        MODBUS_MAPPING_PACKED_BITS);
+    if (mb_mapping == NULL) {
+        fprintf(stderr, "Failed to allocate the mapping: %s\n",
+                modbus_strerror(errno));
+        return -1;
+    }
+
+    ctx_server = modbus_new_tcp("127.0.0.1", 1502);
+    server = modbus_server_new(ctx_server, mb_mapping);
+    if (server == NULL) {
+        fprintf(stderr, "Failed to create the server: %s\n",
+                modbus_strerror(errno));
+        modbus_free(ctx_server);
+        modbus_mapping_free(mb_mapping);
+        return -1;
+    }
+    pthread_create(&server_tid, NULL, server_thread, NULL);
+    /* Lets the server listen */
+    usleep(200000);
+
+    ctx = modbus_new_tcp("127.0.0.1", 1502);
+    if (modbus_connect(ctx) == -1) {
+        fprintf(stderr, "Connection failed: %s\n", modbus_strerror(errno));
+        modbus_free(ctx);
+        nb_errors++;
+        goto close;
+    }
+
+    printf("** PACKED MAPPING **\n");
+    srand(1);
+    for (i = 0; i < NB_LOOPS && nb_errors == 0; i++) {
+        int nb = 1 + rand() % MODBUS_MAX_WRITE_BITS;
+        int addr = rand() % (NB_BITS - nb + 1);
+
+        /* Coils written by the client */
+        for (j = 0; j < nb; j++) {
+            bits[j] = rand() & 1;
+            ref_bits[addr + j] = bits[j];
+        }
+        if (nb == 1) {
+            if (modbus_write_bit(ctx, addr, bits[0]) != 1)
+                nb_errors++;
+        } else {
+            if (modbus_write_bits(ctx, addr, nb, bits) != nb)
+                nb_errors++;
+        }
+
+        /* Discrete inputs written packed by the application */
+        memset(packed, 0, sizeof(packed));
+        for (j = 0; j < nb; j++) {
+            ref_input_bits[addr + j] = rand() & 1;
+            packed[j / 8] |= ref_input_bits[addr + j] << (j % 8);
+        }
+        modbus_mapping_write(mb_mapping, MODBUS_MAPPING_INPUT_BITS, addr, nb,
+                             packed);
+
+        /* Reads at another random address */
+        nb = 1 + rand() % MODBUS_MAX_READ_BITS;
+        addr = rand() % (NB_BITS - nb + 1);
+        if (modbus_read_bits(ctx, addr, nb, bits) != nb ||
+            check_bits(bits, ref_bits, addr, nb, "read_bits") == -1)
+            nb_errors++;
+        if (modbus_read_input_bits(ctx, addr, nb, bits) != nb ||
+            check_bits(bits, ref_input_bits, addr, nb, "read_input_bits") == -1)
+            nb_errors++;
+
+        modbus_mapping_read(mb_mapping, MODBUS_MAPPING_BITS, addr, nb, packed);
+        for (j = 0; j < nb; j++)
+            bits[j] = (packed[j / 8] >> (j % 8)) & 1;
+        if (check_bits(bits, ref_bits, addr, nb, "mapping_read") == -1)
+            nb_errors++;
+        /* The unused bits of the last byte are cleared */
+        if (nb % 8 && packed[nb / 8] >> (nb % 8)) {
+            printf("FAILED (mapping_read: unused bits 0x%02X)\n", packed[nb / 8]);
+            nb_errors++;
+        }
+    }
+
+    modbus_close(ctx);
+    modbus_free(ctx);
+
+close:
+    modbus_server_stop(server);
+    pthread_join(server_tid, NULL);
+    modbus_server_free(server);
+    modbus_free(ctx_server);
+    modbus_mapping_free(mb_mapping);
+
+    if (nb_errors == 0) {
+        printf("%d random writes and reads of %d packed bits: OK\n",
+               NB_LOOPS, NB_BITS);
+        printf("\nALL TESTS PASS WITH SUCCESS.\n");
+        return 0;
+    }
+
+    return -1;
+}
@@ -0,0 +1,191 @@
+/*
+ * Copyright © 2009-2010 Stéphane Raimbault <stephane.raimbault@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include <modbus.h>
+
+/* The workers share NB_CONNECTIONS connections to reach NB_ROUTES devices
+   behind the same server */
+#define NB_WORKERS        8
+#define NB_ROUTES         4
+#define NB_CONNECTIONS    2
+#define NB_GETS        2000
+#define NB_REGISTERS     10
+
+/* Route to a port without server */
+#define DEAD_ROUTE      100
+#define DEAD_PORT      1599
+
+static modbus_pool_t *pool;
+static modbus_server_t *server;
+static modbus_t *tab_ctx[NB_WORKERS * NB_GETS];
+static int nb_ctx = 0;
+static int nb_errors = 0;
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void *server_thread(void *arg)
+{
+    (void)arg;
+    modbus_server_run(server);
+
+    return NULL;
+}
+
+/* Records the distinct contexts handed out */
+static void record_ctx(modbus_t *ctx)
+{
+    int i;
+
+    pthread_mutex_lock(&mutex);
+    for (i = 0; i < nb_ctx; i++) {
+        if (tab_ctx[i] == ctx)
+            break;
+    }
+    if (i == nb_ctx)
+        tab_ctx[nb_ctx++] = ctx;
+    pthread_mutex_unlock(&mutex);
+}
+
+static void *worker(void *arg)
+{
+    uint16_t tab_reg[NB_REGISTERS];
+    int n = *(int *)arg;
+    int i;
+
+    for (i = 0; i < NB_GETS; i++) {
+        int id = 1 + (n + i) % NB_ROUTES;
+        modbus_t *ctx;
+        int rc;
+
+        ctx = modbus_pool_get(pool, id);
+        if (ctx == NULL) {
+            printf("FAILED (get: %s)\n", modbus_strerror(errno));
+            pthread_mutex_lock(&mutex);
+            nb_errors++;
+            pthread_mutex_unlock(&mutex);
+            break;
+        }
+        record_ctx(ctx);
+
+        rc = modbus_read_registers(ctx, 0, NB_REGISTERS, tab_reg);
+        modbus_pool_release(pool, ctx);
+        if (rc != NB_REGISTERS || tab_reg[NB_REGISTERS - 1] != NB_REGISTERS - 1) {
+            printf("FAILED (read: %s)\n", modbus_strerror(errno));
+            pthread_mutex_lock(&mutex);
+            nb_errors++;
+            pthread_mutex_unlock(&mutex);
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+int main(void)
+{
+    modbus_mapping_t *mb_mapping;
+    pthread_t server_tid;
+    pthread_t workers[NB_WORKERS];
+    int tab_n[NB_WORKERS];
+    modbus_t *ctx;
+    int i;
+
+    mb_mapping = modbus_mapping_new(0, 0, NB_REGISTERS, 0);
+    for (i = 0; i < NB_REGISTERS; i++)
+        mb_mapping->tab_registers[i] = i;
+    ctx = modbus_new_tcp("127.0.0.1", 1502);
+    server = modbus_server_new(ctx, mb_mapping);
+    if (server == NULL) {
+        fprintf(stderr, "Failed to create the server: %s\n",
+                modbus_strerror(errno));
+        modbus_free(ctx);
+        modbus_mapping_free(mb_mapping);
+        return -1;
+    }
+    pthread_create(&server_tid, NULL, server_thread, NULL);
+    /* Lets the server listen */
+    usleep(200000);
+
+    pool = modbus_pool_new(NB_CONNECTIONS);
+    for (i = 1; i <= NB_ROUTES; i++)
+        modbus_pool_add_route(pool, i, "127.0.0.1", 1502, i);
+    modbus_pool_add_route(pool, DEAD_ROUTE, "127.0.0.1", DEAD_PORT, 1);
+
+    printf("** CONNECTION POOL **\n");
+
+    /* The routes share the connection to the same server */
+    printf("1/3 Connection kept between the routes: ");
+    for (i = 1; i <= NB_ROUTES; i++) {
+        ctx = modbus_pool_get(pool, i);
+        if (ctx == NULL || modbus_get_socket(ctx) == -1) {
+            printf("FAILED (%s)\n", modbus_strerror(errno));
+            return -1;
+        }
+        record_ctx(ctx);
+        modbus_pool_release(pool, ctx);
+    }
+    if (nb_ctx != 1) {
+        printf("FAILED (%d contexts)\n", nb_ctx);
+        return -1;
+    }
+    printf("OK\n");
+
+    /* The connections are reused by all the workers */
+    printf("2/3 %d workers x %d requests on %d connections: ", NB_WORKERS,
+           NB_GETS, NB_CONNECTIONS);
+    fflush(stdout);
+    for (i = 0; i < NB_WORKERS; i++) {
+        tab_n[i] = i;
+        pthread_create(&workers[i], NULL, worker, &tab_n[i]);
+    }
+    for (i = 0; i < NB_WORKERS; i++)
+        pthread_join(workers[i], NULL);
+    if (nb_errors == 0 && nb_ctx <= NB_CONNECTIONS) {
+        printf("OK\n");
+    } else {
+        printf("FAILED (%d errors, %d contexts)\n", nb_errors, nb_ctx);
+        return -1;
+    }
+
+    printf("3/3 Reconnection delayed after a failure: ");
+    ctx = modbus_pool_get(pool, DEAD_ROUTE);
+    if (ctx != NULL || errno != ECONNREFUSED) {
+        printf("FAILED (first attempt: %s)\n", modbus_strerror(errno));
+        return -1;
+    }
+    ctx = modbus_pool_get(pool, DEAD_ROUTE);
+    if (ctx != NULL || errno != EAGAIN) {
+        printf("FAILED (second attempt: %s)\n", modbus_strerror(errno));
+        return -1;
+    }
+    printf("OK\n");
+
+    modbus_pool_free(pool);
+    modbus_server_stop(server);
+    pthread_join(server_tid, NULL);
+    modbus_server_free(server);
+    modbus_mapping_free(mb_mapping);
+
+    printf("\nALL TESTS PASS WITH SUCCESS.\n");
+
+    return 0;
+}
@@ -0,0 +1,318 @@
+/*
+ * Copyright © 2009-2010 Stéphane Raimbault <stephane.raimbault@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+#include <modbus.h>
+
+/* The serial lines are pseudo-terminals, a server thread answers as slave
+   SERVER_ID on the master side of each line */
+#define NB_BUSES           4
+#define NB_REQUESTS      200
+#define NB_REGISTERS      10
+#define SERVER_ID          1
+/* No slaves with these addresses */
+#define ABSENT_ID          5
+#define DEAD_ID            6
+#define TURNAROUND_MS     50
+
+typedef struct {
+    modbus_t *ctx;
+    modbus_mapping_t *mb_mapping;
+    modbus_cancel_t *cancel;
+    pthread_t tid;
+} line_t;
+
+typedef struct {
+    int bus;
+    uint16_t tab_reg[NB_REGISTERS];
+    int rc;
+    int errnum;
+    struct timeval done;
+    int order;
+} result_t;
+
+static line_t lines[NB_BUSES];
+static int nb_callbacks = 0;
+
+static void *server_thread(void *arg)
+{
+    line_t *line = (line_t *) arg;
+    uint8_t query[MODBUS_RTU_MAX_ADU_LENGTH];
+
+    for (;;) {
+        int rc = modbus_receive(line->ctx, query, NULL);
+
+        if (rc > 0) {
+            modbus_reply(line->ctx, query, rc, line->mb_mapping);
+        } else if (rc == -1 && errno == ECANCELED) {
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+static void on_complete(modbus_t *ctx, int rc, int errnum, void *user)
+{
+    result_t *result = (result_t *) user;
+
+    (void)ctx;
+    result->rc = rc;
+    result->errnum = errnum;
+    gettimeofday(&result->done, NULL);
+    result->order = nb_callbacks++;
+}
+
+/* Processes the events until all the requests are completed */
+static int run(modbus_scheduler_t *sched)
+{
+    while (modbus_scheduler_get_nb_pending(sched) > 0) {
+        if (modbus_scheduler_process(sched, 1000) == -1)
+            return -1;
+    }
+
+    return 0;
+}
+
+static long elapsed_ms(const struct timeval *start, const struct timeval *end)
+{
+    return (end->tv_sec - start->tv_sec) * 1000 +
+        (end->tv_usec - start->tv_usec) / 1000;
+}
+
+int main(void)
+{
+    modbus_scheduler_t *sched;
+    modbus_t *tab_ctx[NB_BUSES];
+    static result_t results[NB_BUSES][NB_REQUESTS];
+    result_t broadcast_result;
+    result_t read_result;
+    result_t absent_result;
+    result_t queued_results[5];
+    result_t dead_results[3];
+    modbus_request_t r;
+    struct timeval timeout;
+    uint16_t value = 0x1234;
+    int i, j;
+
+    sched = modbus_scheduler_new();
+    timeout.tv_sec = 0;
+    timeout.tv_usec = 100000;
+
+    for (i = 0; i < NB_BUSES; i++) {
+        line_t *line = &lines[i];
+        int fd;
+
+        fd = posix_openpt(O_RDWR | O_NOCTTY);
+        if (fd == -1 || grantpt(fd) == -1 || unlockpt(fd) == -1) {
+            fprintf(stderr, "Unable to create a pseudo-terminal: %s\n",
+                    strerror(errno));
+            return -1;
+        }
+
+        /* Server on the master side */
+        line->ctx = modbus_new_rtu("/dev/null", 115200, 'N', 8, 1);
+        modbus_set_slave(line->ctx, SERVER_ID);
+        modbus_set_socket(line->ctx, fd);
+        line->cancel = modbus_cancel_new();
+        modbus_set_cancel(line->ctx, line->cancel);
+        line->mb_mapping = modbus_mapping_new(0, 0, NB_REGISTERS, 0);
+        for (j = 0; j < NB_REGISTERS; j++)
+            line->mb_mapping->tab_registers[j] = i * 100 + j;
+        pthread_create(&line->tid, NULL, server_thread, line);
+
+        /* Client on the slave side */
+        tab_ctx[i] = modbus_new_rtu(ptsname(fd), 115200, 'N', 8, 1);
+        if (modbus_connect(tab_ctx[i]) == -1) {
+            fprintf(stderr, "Connection failed: %s\n", modbus_strerror(errno));
+            return -1;
+        }
+        modbus_set_response_timeout(tab_ctx[i], &timeout);
+        modbus_scheduler_add_bus(sched, tab_ctx[i]);
+    }
+
+    printf("** RTU BUS SCHEDULER **\n");
+
+    printf("1/5 %d lines x %d requests from one thread: ", NB_BUSES,
+           NB_REQUESTS);
+    fflush(stdout);
+    memset(&r, 0, sizeof(r));
+    r.function = MODBUS_FC_READ_HOLDING_REGISTERS;
+    r.addr = 0;
+    r.nb = NB_REGISTERS;
+    for (j = 0; j < NB_REQUESTS; j++) {
+        for (i = 0; i < NB_BUSES; i++) {
+            results[i][j].bus = i;
+            r.data = results[i][j].tab_reg;
+            modbus_scheduler_submit(sched, i, SERVER_ID, &r, on_complete,
+                                    &results[i][j]);
+        }
+    }
+    if (run(sched) == -1 || nb_callbacks != NB_BUSES * NB_REQUESTS) {
+        printf("FAILED (%d callbacks)\n", nb_callbacks);
+        return -1;
+    }
+    for (i = 0; i < NB_BUSES; i++) {
+        for (j = 0; j < NB_REQUESTS; j++) {
+            if (results[i][j].rc != NB_REGISTERS ||
+                results[i][j].tab_reg[NB_REGISTERS - 1] !=
+                i * 100 + NB_REGISTERS - 1) {
+                printf("FAILED (line %d, request %d: %s)\n", i, j,
+                       modbus_strerror(results[i][j].errnum));
+                return -1;
+            }
+        }
+    }
+    printf("OK\n");
+
+    printf("2/5 Turnaround delay after a broadcast: ");
+    timeout.tv_sec = 0;
+    timeout.tv_usec = TURNAROUND_MS * 1000;
+    modbus_scheduler_set_turnaround(sched, 0, &timeout);
+    memset(&r, 0, sizeof(r));
+    r.function = MODBUS_FC_WRITE_SINGLE_REGISTER;
+    r.addr = 0;
+    r.nb = 1;
+    r.data = &value;
+    modbus_scheduler_submit(sched, 0, MODBUS_BROADCAST_ADDRESS, &r,
+                            on_complete, &broadcast_result);
+    r.function = MODBUS_FC_READ_HOLDING_REGISTERS;
+    r.data = read_result.tab_reg;
+    modbus_scheduler_submit(sched, 0, SERVER_ID, &r, on_complete, &read_result);
+    if (run(sched) == -1 || broadcast_result.rc != 1 || read_result.rc != 1 ||
+        read_result.tab_reg[0] != value ||
+        elapsed_ms(&broadcast_result.done, &read_result.done) < TURNAROUND_MS) {
+        printf("FAILED (%d, %d)\n", broadcast_result.rc, read_result.rc);
+        return -1;
+    }
+    printf("OK\n");
+
+    printf("3/5 Timeout of a slave absent: ");
+    r.data = absent_result.tab_reg;
+    modbus_scheduler_submit(sched, 1, ABSENT_ID, &r, on_complete,
+                            &absent_result);
+    r.data = read_result.tab_reg;
+    modbus_scheduler_submit(sched, 2, SERVER_ID, &r, on_complete, &read_result);
+    if (run(sched) == -1 || absent_result.rc != -1 ||
+        absent_result.errnum != ETIMEDOUT || read_result.rc != 1) {
+        printf("FAILED (%d, %s)\n", absent_result.rc,
+               modbus_strerror(absent_result.errnum));
+        return -1;
+    }
+    printf("OK\n");
+
+    printf("4/5 Priority classes and earliest deadline first: ");
+    /* The line is held by the timeout of the request sent first so the
+       deadline of the last one expires in the queue */
+    r.data = absent_result.tab_reg;
+    modbus_scheduler_submit_priority(sched, 3, ABSENT_ID, &r,
+                                     MODBUS_SCHEDULER_PRIORITY_HIGH, NULL,
+                                     on_complete, &absent_result);
+    modbus_scheduler_process(sched, 0);
+    r.data = queued_results[0].tab_reg;
+    modbus_scheduler_submit_priority(sched, 3, SERVER_ID, &r,
+                                     MODBUS_SCHEDULER_PRIORITY_LOW, NULL,
+                                     on_complete, &queued_results[0]);
+    r.data = queued_results[1].tab_reg;
+    timeout.tv_sec = 0;
+    timeout.tv_usec = 500000;
+    modbus_scheduler_submit_priority(sched, 3, SERVER_ID, &r,
+                                     MODBUS_SCHEDULER_PRIORITY_NORMAL, &timeout,
+                                     on_complete, &queued_results[1]);
+    r.data = queued_results[2].tab_reg;
+    timeout.tv_usec = 300000;
+    modbus_scheduler_submit_priority(sched, 3, SERVER_ID, &r,
+                                     MODBUS_SCHEDULER_PRIORITY_NORMAL, &timeout,
+                                     on_complete, &queued_results[2]);
+    r.data = queued_results[3].tab_reg;
+    modbus_scheduler_submit_priority(sched, 3, SERVER_ID, &r,
+                                     MODBUS_SCHEDULER_PRIORITY_HIGH, NULL,
+                                     on_complete, &queued_results[3]);
+    r.data = queued_results[4].tab_reg;
+    timeout.tv_usec = 10000;
+    modbus_scheduler_submit_priority(sched, 3, SERVER_ID, &r,
+                                     MODBUS_SCHEDULER_PRIORITY_HIGH, &timeout,
+                                     on_complete, &queued_results[4]);
+    if (run(sched) == -1 || absent_result.errnum != ETIMEDOUT ||
+        queued_results[4].rc != -1 || queued_results[4].errnum != ETIMEDOUT ||
+        queued_results[4].order != absent_result.order + 1 ||
+        queued_results[3].order != absent_result.order + 2 ||
+        queued_results[2].order != absent_result.order + 3 ||
+        queued_results[1].order != absent_result.order + 4 ||
+        queued_results[0].order != absent_result.order + 5 ||
+        queued_results[0].rc != 1) {
+        printf("FAILED\n");
+        return -1;
+    }
+    printf("OK\n");
+
+    printf("5/5 Requests to a dead slave dropped until the probe: ");
+    timeout.tv_sec = 0;
+    timeout.tv_usec = 200000;
+    modbus_scheduler_set_probe(sched, 2, &timeout, &timeout);
+    for (i = 0; i < 3; i++) {
+        r.data = dead_results[i].tab_reg;
+        modbus_scheduler_submit(sched, 2, DEAD_ID, &r, on_complete,
+                                &dead_results[i]);
+    }
+    r.data = read_result.tab_reg;
+    modbus_scheduler_submit(sched, 2, SERVER_ID, &r, on_complete, &read_result);
+    if (run(sched) == -1 || dead_results[0].errnum != ETIMEDOUT ||
+        dead_results[1].errnum != ETIMEDOUT ||
+        dead_results[2].errnum != EAGAIN || read_result.rc != 1 ||
+        elapsed_ms(&dead_results[1].done, &dead_results[2].done) > 50) {
+        printf("FAILED (%s)\n", modbus_strerror(dead_results[2].errnum));
+        return -1;
+    }
+    /* Probed again after the delay */
+    usleep(250000);
+    r.data = dead_results[0].tab_reg;
+    modbus_scheduler_submit(sched, 2, DEAD_ID, &r, on_complete,
+                            &dead_results[0]);
+    r.data = dead_results[1].tab_reg;
+    modbus_scheduler_submit(sched, 2, DEAD_ID, &r, on_complete,
+                            &dead_results[1]);
+    if (run(sched) == -1 || dead_results[0].errnum != ETIMEDOUT ||
+        dead_results[1].errnum != EAGAIN) {
+        printf("FAILED (probe: %s)\n", modbus_strerror(dead_results[0].errnum));
+        return -1;
+    }
+    printf("OK\n");
+
+    modbus_scheduler_free(sched);
+    for (i = 0; i < NB_BUSES; i++) {
+        modbus_cancel_signal(lines[i].cancel);
+        pthread_join(lines[i].tid, NULL);
+        modbus_close(tab_ctx[i]);
+        modbus_free(tab_ctx[i]);
+        close(modbus_get_socket(lines[i].ctx));
+        modbus_free(lines[i].ctx);
+        modbus_cancel_free(lines[i].cancel);
+        modbus_mapping_free(lines[i].mb_mapping);
+    }
+
+    printf("\nALL TESTS PASS WITH SUCCESS.\n");
+
+    return 0;
+}
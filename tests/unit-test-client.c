@@ -20,18 +20,173 @@
 #include <string.h>
 #include <stdlib.h>
 #include <errno.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/resource.h>
+#include <sys/select.h>
+#include <sys/socket.h>
 #include <modbus.h>
 
+#include "modbus-rtu-private.h"
 #include "unit-test.h"
 
 enum {
     TCP,
     TCP_PI,
+    TCP_URING,
     RTU
 };
 
 int test_raw_request(modbus_t *, int);
 
+/* Result of an asynchronous request */
+typedef struct {
+    int done;
+    int rc;
+    int errnum;
+} async_result_t;
+
+static void async_callback(modbus_t *ctx, int rc, int errnum, void *user)
+{
+    async_result_t *result = user;
+
+    (void)ctx;
+    result->done = 1;
+    result->rc = rc;
+    result->errnum = errnum;
+}
+
+static int64_t time_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* Listening context of a raw server */
+typedef struct {
+    modbus_t *ctx;
+    int server_socket;
+} raw_server_t;
+
+/* Raw server answering two pipelined requests of one register in the reverse
+   order, the value of a register is 0x1000 plus its address */
+static void *reverse_server(void *arg)
+{
+    raw_server_t *server = arg;
+    uint8_t req[2 * 12];
+    uint8_t rsp[11];
+    int length = 0;
+    int s;
+    int i;
+
+    s = modbus_tcp_accept(server->ctx, &server->server_socket);
+    if (s == -1)
+        return NULL;
+
+    while (length < (int)sizeof(req)) {
+        ssize_t rc = recv(s, req + length, sizeof(req) - length, 0);
+
+        if (rc <= 0)
+            goto end;
+        length += rc;
+    }
+
+    for (i = 1; i >= 0; i--) {
+        const uint8_t *r = req + i * 12;
+        int addr = (r[8] << 8) | r[9];
+
+        /* Transaction and protocol identifiers of the request */
+        memcpy(rsp, r, 4);
+        rsp[4] = 0;
+        rsp[5] = 5;
+        rsp[6] = r[6];
+        rsp[7] = r[7];
+        rsp[8] = 2;
+        rsp[9] = (0x1000 + addr) >> 8;
+        rsp[10] = (0x1000 + addr) & 0xFF;
+        if (send(s, rsp, sizeof(rsp), MSG_NOSIGNAL) != sizeof(rsp))
+            goto end;
+    }
+
+    /* Until the client closes the connection */
+    while (recv(s, req, sizeof(req), 0) > 0);
+
+end:
+    close(s);
+    return NULL;
+}
+
+/* Cancels the blocking call of the main thread */
+static void *cancel_later(void *arg)
+{
+    usleep(100000);
+    modbus_cancel_signal(arg);
+
+    return NULL;
+}
+
+/* Writes stale bytes on the line of the client then exchanges a request with
+   the server on the other side of the pseudo-terminal. Returns the result of
+   modbus_receive_confirmation(). */
+static int stale_exchange(modbus_t *ctx, modbus_t *ctx_srv,
+                          modbus_mapping_t *mb_mapping)
+{
+    const uint8_t stale[] = { 0x00, 0xFF, 0x00 };
+    uint8_t raw_req[] = { SERVER_ID, MODBUS_FC_READ_HOLDING_REGISTERS,
+                          0x00, 0x00, 0x00, 0x01 };
+    uint8_t msg[MODBUS_RTU_MAX_ADU_LENGTH];
+    struct pollfd pfd;
+    int rc;
+
+    if (write(modbus_get_socket(ctx_srv), stale, sizeof(stale)) != sizeof(stale))
+        return -1;
+    /* Received by the client before its request */
+    pfd.fd = modbus_get_socket(ctx);
+    pfd.events = POLLIN;
+    poll(&pfd, 1, 1000);
+
+    if (modbus_send_raw_request(ctx, raw_req, sizeof(raw_req)) == -1)
+        return -1;
+    rc = modbus_receive(ctx_srv, msg, NULL);
+    if (rc == -1 || modbus_reply(ctx_srv, msg, rc, mb_mapping) == -1)
+        return -1;
+
+    return modbus_receive_confirmation(ctx, msg);
+}
+
+/* Server of the reconnection test, it serves two connections in turn */
+typedef struct {
+    modbus_t *ctx;
+    int server_socket;
+    modbus_mapping_t *mb_mapping;
+} reconnect_server_t;
+
+static void *reconnect_server(void *arg)
+{
+    reconnect_server_t *server = arg;
+    uint8_t query[MODBUS_TCP_MAX_ADU_LENGTH];
+    int i;
+
+    for (i = 0; i < 2; i++) {
+        int rc;
+
+        if (modbus_tcp_accept(server->ctx, &server->server_socket) == -1)
+            break;
+        do {
+            rc = modbus_receive(server->ctx, query, NULL);
+            if (rc > 0)
+                rc = modbus_reply(server->ctx, query, rc, server->mb_mapping);
+        } while (rc != -1);
+        modbus_close(server->ctx);
+    }
+
+    return NULL;
+}
+
 int main(int argc, char *argv[])
 {
     uint8_t *tab_rp_bits;
@@ -53,10 +208,12 @@ int main(int argc, char *argv[])
             use_backend = TCP;
         } else if (strcmp(argv[1], "tcppi") == 0) {
             use_backend = TCP_PI;
+        } else if (strcmp(argv[1], "tcpuring") == 0) {
+            use_backend = TCP_URING;
         } else if (strcmp(argv[1], "rtu") == 0) {
             use_backend = RTU;
         } else {
-            printf("Usage:\n  %s [tcp|tcppi|rtu] - Modbus client for unit testing\n\n", argv[0]);
+            printf("Usage:\n  %s [tcp|tcppi|tcpuring|rtu] - Modbus client for unit testing\n\n", argv[0]);
             exit(1);
         }
     } else {
@@ -68,6 +225,8 @@ int main(int argc, char *argv[])
         ctx = modbus_new_tcp("127.0.0.1", 1502);
     } else if (use_backend == TCP_PI) {
         ctx = modbus_new_tcp_pi("::1", "1502");
+    } else if (use_backend == TCP_URING) {
+        ctx = modbus_new_tcp_uring("127.0.0.1", 1502);
     } else {
         ctx = modbus_new_rtu("/dev/ttyUSB1", 115200, 'N', 8, 1);
     }
@@ -320,6 +479,1021 @@ int main(int argc, char *argv[])
     }
     printf("OK\n");
 
+    printf("\nTEST PIPELINE:\n");
+    {
+        uint16_t tab_reg[UT_REGISTERS_NB];
+        uint8_t tab_bit[UT_INPUT_BITS_NB];
+        modbus_request_t reqs[3];
+
+        memset(tab_rp_registers, 0, UT_REGISTERS_NB * sizeof(uint16_t));
+        memset(reqs, 0, sizeof(reqs));
+
+        memcpy(tab_reg, UT_REGISTERS_TAB, sizeof(tab_reg));
+        reqs[0].function = MODBUS_FC_WRITE_MULTIPLE_REGISTERS;
+        reqs[0].addr = UT_REGISTERS_ADDRESS;
+        reqs[0].nb = UT_REGISTERS_NB;
+        reqs[0].data = tab_reg;
+
+        reqs[1].function = MODBUS_FC_READ_HOLDING_REGISTERS;
+        reqs[1].addr = UT_REGISTERS_ADDRESS;
+        reqs[1].nb = UT_REGISTERS_NB;
+        reqs[1].data = tab_rp_registers;
+
+        reqs[2].function = MODBUS_FC_READ_DISCRETE_INPUTS;
+        reqs[2].addr = UT_INPUT_BITS_ADDRESS;
+        reqs[2].nb = UT_INPUT_BITS_NB;
+        reqs[2].data = tab_bit;
+
+        rc = modbus_pipeline(ctx, reqs, 3, 3);
+        printf("1/3 modbus_pipeline: ");
+        if (rc != 3 || reqs[0].rc != UT_REGISTERS_NB ||
+            reqs[1].rc != UT_REGISTERS_NB || reqs[2].rc != UT_INPUT_BITS_NB) {
+            printf("FAILED (%d)\n", rc);
+            goto close;
+        }
+
+        for (i=0; i < UT_REGISTERS_NB; i++) {
+            if (tab_rp_registers[i] != UT_REGISTERS_TAB[i]) {
+                printf("FAILED (%0X != %0X)\n",
+                       tab_rp_registers[i], UT_REGISTERS_TAB[i]);
+                goto close;
+            }
+        }
+
+        for (i=0; i < UT_INPUT_BITS_NB; i++) {
+            if (tab_bit[i] != ((UT_INPUT_BITS_TAB[i / 8] >> (i % 8)) & 1)) {
+                printf("FAILED (bit %d)\n", i);
+                goto close;
+            }
+        }
+        printf("OK\n");
+
+        /* The server replies with an exception to the second request */
+        reqs[1].addr = UT_REGISTERS_ADDRESS_SPECIAL;
+        rc = modbus_pipeline(ctx, reqs, 3, 3);
+        printf("2/3 modbus_pipeline with an exception: ");
+        if (rc == 2 && reqs[1].rc == -1 && reqs[1].errnum == EMBXSBUSY &&
+            reqs[2].rc == UT_INPUT_BITS_NB) {
+            printf("OK\n");
+        } else {
+            printf("FAILED (%d)\n", rc);
+            goto close;
+        }
+    }
+
+    {
+        raw_server_t server;
+        pthread_t thread;
+        modbus_t *ctx_rev;
+        modbus_request_t reqs[2];
+        uint16_t values[2] = { 0, 0 };
+
+        /* TCP server answering in the reverse order whatever the backend */
+        server.ctx = modbus_new_tcp("127.0.0.1", 1596);
+        server.server_socket = modbus_tcp_listen(server.ctx, 1);
+        pthread_create(&thread, NULL, reverse_server, &server);
+
+        memset(reqs, 0, sizeof(reqs));
+        for (i = 0; i < 2; i++) {
+            reqs[i].function = MODBUS_FC_READ_HOLDING_REGISTERS;
+            reqs[i].addr = 5 + i * 4;
+            reqs[i].nb = 1;
+            reqs[i].data = &values[i];
+        }
+        ctx_rev = modbus_new_tcp("127.0.0.1", 1596);
+        rc = modbus_connect(ctx_rev);
+        if (rc == 0)
+            rc = modbus_pipeline(ctx_rev, reqs, 2, 2);
+        modbus_close(ctx_rev);
+        modbus_free(ctx_rev);
+        /* Wakes up the server if the connection failed */
+        shutdown(server.server_socket, SHUT_RDWR);
+        pthread_join(thread, NULL);
+        close(server.server_socket);
+        modbus_free(server.ctx);
+
+        printf("3/3 Responses in the reverse order matched by TID: ");
+        if (rc == 2 && reqs[0].rc == 1 && reqs[1].rc == 1 &&
+            values[0] == 0x1005 && values[1] == 0x1009) {
+            printf("OK\n");
+        } else {
+            printf("FAILED (%d, 0x%X 0x%X)\n", rc, values[0], values[1]);
+            goto close;
+        }
+    }
+
+    printf("\nTEST READ PLAN:\n");
+    {
+        uint16_t tab_reg[3];
+        uint16_t tab_long[250];
+        uint8_t tab_bit[13];
+        modbus_request_t tags[5];
+        modbus_plan_t *plan;
+
+        memset(tags, 0, sizeof(tags));
+        memset(tab_reg, 0, sizeof(tab_reg));
+        memset(tab_bit, 0, sizeof(tab_bit));
+
+        /* Registers 0, 2 and 1-2 (read by the pipeline test) */
+        tags[0].function = MODBUS_FC_READ_HOLDING_REGISTERS;
+        tags[0].addr = UT_REGISTERS_ADDRESS;
+        tags[0].nb = 1;
+        tags[0].data = &tab_reg[0];
+        tags[1].function = MODBUS_FC_READ_DISCRETE_INPUTS;
+        tags[1].addr = UT_INPUT_BITS_ADDRESS + 10;
+        tags[1].nb = 5;
+        tags[1].data = &tab_bit[8];
+        tags[2].function = MODBUS_FC_READ_HOLDING_REGISTERS;
+        tags[2].addr = UT_REGISTERS_ADDRESS + 2;
+        tags[2].nb = 1;
+        tags[2].data = &tab_reg[2];
+        tags[3].function = MODBUS_FC_READ_DISCRETE_INPUTS;
+        tags[3].addr = UT_INPUT_BITS_ADDRESS;
+        tags[3].nb = 8;
+        tags[3].data = &tab_bit[0];
+        tags[4].function = MODBUS_FC_READ_HOLDING_REGISTERS;
+        tags[4].addr = UT_REGISTERS_ADDRESS + 1;
+        tags[4].nb = 2;
+        tags[4].data = &tab_reg[1];
+
+        /* One request by table when the gap of 2 bits is allowed */
+        plan = modbus_plan_new(tags, 5, 2);
+        printf("1/3 modbus_plan_execute: ");
+        if (plan == NULL || modbus_plan_get_nb_requests(plan) != 2) {
+            printf("FAILED (plan)\n");
+            goto close;
+        }
+        rc = modbus_plan_execute(ctx, plan, 2);
+        modbus_plan_free(plan);
+        if (rc != 5 || tags[1].rc != 5 || tags[4].rc != 2 ||
+            tab_reg[0] != UT_REGISTERS_TAB[0] ||
+            tab_reg[1] != UT_REGISTERS_TAB[1] ||
+            tab_reg[2] != UT_REGISTERS_TAB[2]) {
+            printf("FAILED (%d)\n", rc);
+            goto close;
+        }
+        for (i = 0; i < 13; i++) {
+            int bit = i < 8 ? i : i + 2;
+
+            if (tab_bit[i] != ((UT_INPUT_BITS_TAB[bit / 8] >> (bit % 8)) & 1)) {
+                printf("FAILED (bit %d)\n", bit);
+                goto close;
+            }
+        }
+        printf("OK\n");
+
+        /* The adjacent registers are still merged */
+        plan = modbus_plan_new(tags, 5, 0);
+        printf("2/3 modbus_plan_new without gap: ");
+        if (plan != NULL && modbus_plan_get_nb_requests(plan) == 3) {
+            printf("OK\n");
+        } else {
+            printf("FAILED\n");
+            goto close;
+        }
+        modbus_plan_free(plan);
+
+        /* 250 adjacent registers in 3 tags, 2 requests of 125 registers */
+        tags[0].function = MODBUS_FC_READ_HOLDING_REGISTERS;
+        tags[0].addr = 0;
+        tags[0].nb = 100;
+        tags[0].data = tab_long;
+        tags[1] = tags[0];
+        tags[1].addr = 100;
+        tags[1].nb = 30;
+        tags[1].data = tab_long + 100;
+        tags[2] = tags[0];
+        tags[2].addr = 130;
+        tags[2].nb = 120;
+        tags[2].data = tab_long + 130;
+        plan = modbus_plan_new(tags, 3, 0);
+        printf("3/3 modbus_plan_new split at the limit of the protocol: ");
+        if (plan != NULL && modbus_plan_get_nb_requests(plan) == 2) {
+            printf("OK\n");
+        } else {
+            printf("FAILED (%d requests)\n",
+                   plan != NULL ? modbus_plan_get_nb_requests(plan) : -1);
+            modbus_plan_free(plan);
+            goto close;
+        }
+        modbus_plan_free(plan);
+    }
+
+    printf("\nTEST RANGES:\n");
+    {
+        /* Below UT_REGISTERS_ADDRESS, split into 3 writes and 2 reads */
+        const int nb = 2 * MODBUS_MAX_READ_REGISTERS;
+        uint16_t tab_src[2 * MODBUS_MAX_READ_REGISTERS];
+        uint16_t tab_dest[2 * MODBUS_MAX_READ_REGISTERS];
+
+        for (i = 0; i < nb; i++)
+            tab_src[i] = 0x1000 + i;
+        memset(tab_dest, 0, sizeof(tab_dest));
+
+        /* One request at a time */
+        rc = modbus_write_registers_range(ctx, 0, nb, tab_src, 1);
+        printf("1/4 modbus_write_registers_range: ");
+        if (rc == nb) {
+            printf("OK\n");
+        } else {
+            printf("FAILED (nb points %d)\n", rc);
+            goto close;
+        }
+
+        /* Pipelined in TCP */
+        rc = modbus_read_registers_range(ctx, 0, nb, tab_dest, 4);
+        printf("2/4 modbus_read_registers_range: ");
+        if (rc != nb || memcmp(tab_src, tab_dest, sizeof(tab_src)) != 0) {
+            printf("FAILED (nb points %d)\n", rc);
+            goto close;
+        }
+        printf("OK\n");
+
+        rc = modbus_read_registers_range(ctx, 0xFFFF, 2, tab_dest, 1);
+        printf("3/4 modbus_read_registers_range beyond 0xFFFF: ");
+        if (rc == -1 && errno == EMBMDATA) {
+            printf("OK\n");
+        } else {
+            printf("FAILED (%d)\n", rc);
+            goto close;
+        }
+
+        rc = modbus_read_registers_range(ctx, 0, nb, tab_dest, 0);
+        printf("4/4 modbus_read_registers_range without request in flight: ");
+        if (rc == -1 && errno == EINVAL) {
+            printf("OK\n");
+        } else {
+            printf("FAILED (%d)\n", rc);
+            goto close;
+        }
+    }
+
+    printf("\nTEST ASYNCHRONOUS REQUESTS:\n");
+    {
+        uint16_t tab_reg[2][UT_REGISTERS_NB];
+        async_result_t results[3];
+        int nb_done = 0;
+
+        memset(results, 0, sizeof(results));
+        memset(tab_reg, 0, sizeof(tab_reg));
+
+        rc = modbus_submit_read_registers(ctx, UT_REGISTERS_ADDRESS,
+                                          UT_REGISTERS_NB, tab_reg[0],
+                                          async_callback, &results[0]);
+        rc |= modbus_submit_read_registers(ctx, UT_REGISTERS_ADDRESS_SPECIAL,
+                                           UT_REGISTERS_NB, tab_reg[1],
+                                           async_callback, &results[1]);
+        rc |= modbus_submit_read_registers(ctx, UT_REGISTERS_ADDRESS, 1,
+                                           tab_reg[1], async_callback,
+                                           &results[2]);
+        printf("1/3 modbus_submit_read_registers: ");
+        if (rc == -1) {
+            printf("FAILED (%s)\n", modbus_strerror(errno));
+            goto close;
+        }
+        printf("OK\n");
+
+        /* Event loop */
+        while (nb_done < 3) {
+            struct pollfd pfd;
+            int timeout;
+
+            pfd.fd = modbus_get_pollfd(ctx, &timeout);
+            pfd.events = POLLIN;
+            if (poll(&pfd, 1, timeout) == -1)
+                break;
+            rc = modbus_process_events(ctx);
+            if (rc == -1)
+                break;
+            nb_done += rc;
+        }
+
+        printf("2/3 modbus_process_events: ");
+        if (nb_done != 3 || results[0].rc != UT_REGISTERS_NB ||
+            results[2].rc != 1 || tab_reg[1][0] != UT_REGISTERS_TAB[0]) {
+            printf("FAILED (%d, %d, %d)\n", nb_done, results[0].rc,
+                   results[2].rc);
+            goto close;
+        }
+        for (i=0; i < UT_REGISTERS_NB; i++) {
+            if (tab_reg[0][i] != UT_REGISTERS_TAB[i]) {
+                printf("FAILED (%0X != %0X)\n",
+                       tab_reg[0][i], UT_REGISTERS_TAB[i]);
+                goto close;
+            }
+        }
+        printf("OK\n");
+
+        printf("3/3 exception of an asynchronous request: ");
+        if (results[1].rc == -1 && results[1].errnum == EMBXSBUSY) {
+            printf("OK\n");
+        } else {
+            printf("FAILED (%d)\n", results[1].rc);
+            goto close;
+        }
+    }
+
+    /** BUILD REPLY **/
+    printf("\nTEST BUILD REPLY:\n");
+    {
+        modbus_mapping_t *mb_mapping;
+        uint8_t req[MODBUS_TCP_MAX_ADU_LENGTH];
+        uint8_t rsp[MODBUS_TCP_MAX_ADU_LENGTH];
+        int header_length = modbus_get_header_length(ctx);
+        /* Read 2 holding registers at address 1 */
+        const uint8_t pdu[] = { 0x03, 0x00, 0x01, 0x00, 0x02 };
+        const uint8_t rsp_pdu[] = { 0x03, 0x04, 0x12, 0x34, 0xAB, 0xCD };
+        int rsp_length = header_length + sizeof(rsp_pdu) +
+            (use_backend == RTU ? 2 : 0);
+
+        mb_mapping = modbus_mapping_new(0, 0, 3, 0);
+        mb_mapping->tab_registers[1] = 0x1234;
+        mb_mapping->tab_registers[2] = 0xABCD;
+
+        memset(req, 0, sizeof(req));
+        if (use_backend == RTU) {
+            req[0] = SERVER_ID;
+        } else {
+            /* Transaction ID, protocol ID, length and unit ID */
+            req[0] = 0x12;
+            req[1] = 0x34;
+            req[5] = 1 + sizeof(pdu);
+            req[6] = 0xFF;
+        }
+        memcpy(req + header_length, pdu, sizeof(pdu));
+
+        printf("1/3 modbus_build_reply: ");
+        rc = modbus_build_reply(ctx, req, header_length + sizeof(pdu),
+                                mb_mapping, rsp, sizeof(rsp));
+        if (rc != rsp_length || rsp[header_length - 1] != req[header_length - 1] ||
+            memcmp(rsp + header_length, rsp_pdu, sizeof(rsp_pdu)) != 0 ||
+            (use_backend != RTU &&
+             (rsp[0] != 0x12 || rsp[1] != 0x34 || rsp[5] != 1 + sizeof(rsp_pdu))) ||
+            (use_backend == RTU &&
+             modbus_crc16(rsp, rsp_length - 2) !=
+             ((rsp[rsp_length - 2] << 8) | rsp[rsp_length - 1]))) {
+            printf("FAILED (%d)\n", rc);
+            modbus_mapping_free(mb_mapping);
+            goto close;
+        }
+        printf("OK\n");
+
+        printf("2/3 modbus_build_reply with a too small buffer: ");
+        rc = modbus_build_reply(ctx, req, header_length + sizeof(pdu),
+                                mb_mapping, rsp, rsp_length - 1);
+        if (rc == -1 && errno == ENOBUFS) {
+            printf("OK\n");
+        } else {
+            printf("FAILED (%d)\n", rc);
+            modbus_mapping_free(mb_mapping);
+            goto close;
+        }
+
+        /* Write 0x5678 at address 1, the response has the same length */
+        req[header_length] = 0x06;
+        req[header_length + 3] = 0x56;
+        req[header_length + 4] = 0x78;
+        printf("3/3 modbus_build_reply of a write with a too small buffer: ");
+        rc = modbus_build_reply(ctx, req, header_length + 5,
+                                mb_mapping, rsp, header_length + 4);
+        if (rc == -1 && errno == ENOBUFS &&
+            mb_mapping->tab_registers[1] == 0x1234) {
+            printf("OK\n");
+        } else {
+            printf("FAILED (%d, 0x%X)\n", rc, mb_mapping->tab_registers[1]);
+            modbus_mapping_free(mb_mapping);
+            goto close;
+        }
+        modbus_mapping_free(mb_mapping);
+    }
+
+    /** DESCRIPTOR ABOVE FD_SETSIZE **/
+    printf("\nTEST HIGH DESCRIPTOR:\n");
+    {
+        struct rlimit rlim;
+        int s_orig = modbus_get_socket(ctx);
+        int s_high = -1;
+
+        /* The descriptor can't be stored in a fd_set */
+        if (getrlimit(RLIMIT_NOFILE, &rlim) == 0 &&
+            (rlim.rlim_max == RLIM_INFINITY || rlim.rlim_max > FD_SETSIZE + 16)) {
+            if (rlim.rlim_cur != RLIM_INFINITY && rlim.rlim_cur <= FD_SETSIZE + 16) {
+                rlim.rlim_cur = FD_SETSIZE + 17;
+                setrlimit(RLIMIT_NOFILE, &rlim);
+            }
+            s_high = fcntl(s_orig, F_DUPFD, FD_SETSIZE + 16);
+        }
+
+        printf("1/1 Read registers with a descriptor above %d: ", FD_SETSIZE);
+        if (s_high == -1) {
+            printf("SKIPPED (%s)\n", strerror(errno));
+        } else {
+            modbus_set_socket(ctx, s_high);
+            rc = modbus_read_registers(ctx, UT_REGISTERS_ADDRESS,
+                                       UT_REGISTERS_NB, tab_rp_registers);
+            modbus_set_socket(ctx, s_orig);
+            close(s_high);
+            if (rc != UT_REGISTERS_NB) {
+                printf("FAILED (%d)\n", rc);
+                goto close;
+            }
+            printf("OK\n");
+        }
+    }
+
+    /** READ-AHEAD **/
+    printf("\nTEST READ-AHEAD:\n");
+    if (use_backend == RTU) {
+        rc = modbus_tcp_set_read_ahead(ctx, TRUE);
+        printf("1/1 modbus_tcp_set_read_ahead rejected in RTU: ");
+        if (rc == -1 && errno == EINVAL) {
+            printf("OK\n");
+        } else {
+            printf("FAILED\n");
+            goto close;
+        }
+    } else {
+        /* Server waiting with its own poll() on the other end of a socket
+           pair, two requests are sent in one write */
+        modbus_t *ctx_server;
+        uint8_t req[MODBUS_TCP_MAX_ADU_LENGTH];
+        uint8_t two_reqs[24];
+        struct pollfd pfd;
+        int read_ahead_ok = FALSE;
+        int sv[2];
+
+        for (i = 0; i < 2; i++) {
+            const uint8_t raw_req[] = { 0x00, i + 1, 0x00, 0x00, 0x00, 0x06,
+                                        0xFF, 0x03, 0x00, i + 1, 0x00, 0x01 };
+            memcpy(two_reqs + i * 12, raw_req, 12);
+        }
+
+        if (use_backend == TCP_URING) {
+            ctx_server = modbus_new_tcp_uring("127.0.0.1", 1502);
+        } else {
+            ctx_server = modbus_new_tcp("127.0.0.1", 1502);
+        }
+        socketpair(AF_UNIX, SOCK_STREAM, 0, sv);
+        modbus_set_socket(ctx_server, sv[1]);
+        pfd.fd = sv[1];
+        pfd.events = POLLIN;
+
+        printf("1/3 Each request seen by the poll of the application: ");
+        rc = write(sv[0], two_reqs, sizeof(two_reqs));
+        for (i = 0; i < 2; i++) {
+            if (poll(&pfd, 1, 100) != 1)
+                break;
+            rc = modbus_receive(ctx_server, req, NULL);
+            if (rc != 12 || req[9] != i + 1)
+                break;
+        }
+        if (i == 2) {
+            printf("OK\n");
+        } else {
+            printf("FAILED (request %d)\n", i + 1);
+            goto close_read_ahead;
+        }
+
+        printf("2/3 Requests buffered in read-ahead mode: ");
+        modbus_tcp_set_read_ahead(ctx_server, TRUE);
+        rc = write(sv[0], two_reqs, sizeof(two_reqs));
+        rc = modbus_receive(ctx_server, req, NULL);
+        if (rc == 12 && req[9] == 1 && poll(&pfd, 1, 0) == 0 &&
+            modbus_receive(ctx_server, req, NULL) == 12 && req[9] == 2) {
+            printf("OK\n");
+        } else {
+            printf("FAILED\n");
+            goto close_read_ahead;
+        }
+
+        /* The application gives the same descriptor, possibly for a new
+           connection */
+        printf("3/3 Buffer dropped by modbus_set_socket: ");
+        rc = write(sv[0], two_reqs, sizeof(two_reqs));
+        rc = modbus_receive(ctx_server, req, NULL);
+        modbus_set_socket(ctx_server, sv[1]);
+        /* Request to the address 3 */
+        two_reqs[1] = 3;
+        two_reqs[9] = 3;
+        rc = write(sv[0], two_reqs, 12);
+        rc = modbus_receive(ctx_server, req, NULL);
+        if (rc == 12 && req[9] == 3) {
+            printf("OK\n");
+            read_ahead_ok = TRUE;
+        } else {
+            printf("FAILED\n");
+        }
+
+    close_read_ahead:
+        close(sv[0]);
+        close(sv[1]);
+        modbus_free(ctx_server);
+        if (!read_ahead_ok)
+            goto close;
+    }
+
+    printf("\nTEST REPLY BATCHING:\n");
+    {
+        /* Server at the other end of a socket pair, 4 requests of one
+           register are pipelined in one write and each response is 11
+           bytes long */
+        modbus_t *ctx_server;
+        modbus_mapping_t *mb_mapping;
+        uint8_t req[MODBUS_TCP_MAX_ADU_LENGTH];
+        uint8_t four_reqs[4 * 12];
+        uint8_t rsps[4 * 11 + 1];
+        int batching_ok = FALSE;
+        int sv[2];
+
+        for (i = 0; i < 4; i++) {
+            const uint8_t raw_req[] = { 0x00, i + 1, 0x00, 0x00, 0x00, 0x06,
+                                        0xFF, 0x03, 0x00, i, 0x00, 0x01 };
+            memcpy(four_reqs + i * 12, raw_req, 12);
+        }
+        mb_mapping = modbus_mapping_new(0, 0, 4, 0);
+        ctx_server = modbus_new_tcp("127.0.0.1", 1502);
+        socketpair(AF_UNIX, SOCK_STREAM, 0, sv);
+        modbus_set_socket(ctx_server, sv[1]);
+
+        printf("1/2 Each response sent at once by default: ");
+        rc = write(sv[0], four_reqs, sizeof(four_reqs));
+        for (i = 0; i < 4; i++) {
+            rc = modbus_receive(ctx_server, req, NULL);
+            if (rc != 12 || modbus_reply(ctx_server, req, rc, mb_mapping) == -1)
+                break;
+        }
+        rc = recv(sv[0], rsps, sizeof(rsps), MSG_DONTWAIT);
+        if (i == 4 && rc == 4 * 11) {
+            printf("OK\n");
+        } else {
+            printf("FAILED (%d bytes)\n", rc);
+            goto close_batching;
+        }
+
+        /* The responses are only queued while the next request is already
+           received */
+        printf("2/2 Responses to the pipelined requests sent together: ");
+        modbus_tcp_set_reply_batching(ctx_server, TRUE);
+        rc = write(sv[0], four_reqs, sizeof(four_reqs));
+        for (i = 0; i < 4; i++) {
+            rc = modbus_receive(ctx_server, req, NULL);
+            if (rc != 12 || modbus_reply(ctx_server, req, rc, mb_mapping) == -1)
+                break;
+        }
+        rc = recv(sv[0], rsps, sizeof(rsps), MSG_DONTWAIT);
+        if (i != 4 || rc != -1 || errno != EAGAIN) {
+            printf("FAILED (%d bytes before the flush)\n", rc);
+            goto close_batching;
+        }
+        /* Sends the queue */
+        modbus_tcp_set_reply_batching(ctx_server, FALSE);
+        rc = recv(sv[0], rsps, sizeof(rsps), MSG_DONTWAIT);
+        if (rc == 4 * 11) {
+            printf("OK\n");
+            batching_ok = TRUE;
+        } else {
+            printf("FAILED (%d bytes)\n", rc);
+        }
+
+    close_batching:
+        close(sv[0]);
+        close(sv[1]);
+        modbus_free(ctx_server);
+        modbus_mapping_free(mb_mapping);
+        if (!batching_ok)
+            goto close;
+    }
+
+    /** CANCELLATION **/
+    printf("\nTEST CANCELLATION:\n");
+    {
+        modbus_cancel_t *cancel;
+        uint8_t req[MODBUS_TCP_MAX_ADU_LENGTH];
+        modbus_t *ctx_listen;
+        modbus_t *ctx_silent;
+        pthread_t thread;
+        int server_socket;
+        int cancel_ok;
+        int64_t start;
+
+        cancel = modbus_cancel_new();
+        printf("1/5 modbus_cancel_new: ");
+        if (cancel == NULL) {
+            printf("FAILED (%s)\n", modbus_strerror(errno));
+            goto close;
+        }
+        modbus_set_cancel(ctx, cancel);
+        printf("OK\n");
+
+        /* Without cancellation, waits for an indication forever */
+        modbus_cancel_signal(cancel);
+        rc = modbus_receive(ctx, req, NULL);
+        printf("2/5 modbus_receive interrupted by modbus_cancel_signal: ");
+        if (rc == -1 && errno == ECANCELED) {
+            printf("OK\n");
+        } else {
+            printf("FAILED (%d)\n", rc);
+            modbus_set_cancel(ctx, NULL);
+            modbus_cancel_free(cancel);
+            goto close;
+        }
+
+        /* Signaled by another thread while modbus_receive waits */
+        modbus_cancel_reset(cancel);
+        pthread_create(&thread, NULL, cancel_later, cancel);
+        start = time_ms();
+        rc = modbus_receive(ctx, req, NULL);
+        pthread_join(thread, NULL);
+        printf("3/5 modbus_receive interrupted while blocked: ");
+        if (rc == -1 && errno == ECANCELED && time_ms() - start < 500) {
+            printf("OK\n");
+        } else {
+            printf("FAILED (%d in %d ms)\n", rc, (int)(time_ms() - start));
+            modbus_set_cancel(ctx, NULL);
+            modbus_cancel_free(cancel);
+            goto close;
+        }
+
+        /* Server accepting the connection without ever answering */
+        ctx_listen = modbus_new_tcp("127.0.0.1", 1597);
+        server_socket = modbus_tcp_listen(ctx_listen, 1);
+        ctx_silent = modbus_new_tcp("127.0.0.1", 1597);
+        response_timeout.tv_sec = 5;
+        response_timeout.tv_usec = 0;
+        modbus_set_response_timeout(ctx_silent, &response_timeout);
+        modbus_cancel_reset(cancel);
+        modbus_set_cancel(ctx_silent, cancel);
+        rc = modbus_connect(ctx_silent);
+        if (rc == 0) {
+            pthread_create(&thread, NULL, cancel_later, cancel);
+            start = time_ms();
+            rc = modbus_read_registers(ctx_silent, UT_REGISTERS_ADDRESS,
+                                       UT_REGISTERS_NB, tab_rp_registers);
+            pthread_join(thread, NULL);
+        }
+        printf("4/5 modbus_read_registers interrupted while blocked: ");
+        cancel_ok = (rc == -1 && errno == ECANCELED && time_ms() - start < 500);
+        if (cancel_ok) {
+            printf("OK\n");
+        } else {
+            printf("FAILED (%d in %d ms)\n", rc, (int)(time_ms() - start));
+        }
+        modbus_set_cancel(ctx_silent, NULL);
+        modbus_close(ctx_silent);
+        modbus_free(ctx_silent);
+        close(server_socket);
+        modbus_free(ctx_listen);
+        if (!cancel_ok) {
+            modbus_set_cancel(ctx, NULL);
+            modbus_cancel_free(cancel);
+            goto close;
+        }
+
+        modbus_cancel_reset(cancel);
+        rc = modbus_read_registers(ctx, UT_REGISTERS_ADDRESS,
+                                   UT_REGISTERS_NB, tab_rp_registers);
+        modbus_set_cancel(ctx, NULL);
+        modbus_cancel_free(cancel);
+        printf("5/5 Read registers after modbus_cancel_reset: ");
+        if (rc != UT_REGISTERS_NB) {
+            printf("FAILED (%d)\n", rc);
+            goto close;
+        }
+        printf("OK\n");
+    }
+
+    /** RECONNECTION POLICY **/
+    printf("\nTEST RECONNECTION POLICY:\n");
+    if (use_backend == RTU) {
+        printf("SKIPPED (TCP only)\n");
+    } else {
+        modbus_reconnect_policy_t policy;
+        modbus_t *ctx_down;
+        const char *step[] = { "1/6 Connection refused", "2/6 Attempt delayed",
+                               "3/6 Given up after 2 failures" };
+        reconnect_server_t server;
+        pthread_t thread;
+        modbus_t *ctx_rc;
+        int reconnect_ok = FALSE;
+        int64_t start;
+        const int step_errno[] = { ECONNREFUSED, EAGAIN, ENOTCONN };
+
+        /* No server on this port */
+        if (use_backend == TCP_PI) {
+            ctx_down = modbus_new_tcp_pi("::1", "1599");
+        } else {
+            ctx_down = modbus_new_tcp("127.0.0.1", 1599);
+        }
+        policy.min_delay.tv_sec = 0;
+        policy.min_delay.tv_usec = 200000;
+        policy.max_delay.tv_sec = 1;
+        policy.max_delay.tv_usec = 0;
+        policy.jitter = 0;
+        policy.max_attempts = 2;
+        modbus_set_reconnect_policy(ctx_down, &policy);
+
+        for (i = 0; i < 3; i++) {
+            /* The second failure is only allowed after the delay */
+            if (i == 2)
+                usleep(250000);
+            rc = modbus_connect_async(ctx_down);
+            while (rc == -1 && errno == EINPROGRESS) {
+                struct pollfd pfd;
+
+                pfd.fd = modbus_get_socket(ctx_down);
+                pfd.events = POLLOUT;
+                poll(&pfd, 1, 1000);
+                rc = modbus_connect_async(ctx_down);
+            }
+            if (i == 2 && rc == -1 && errno == ECONNREFUSED) {
+                /* Second failure, the next attempt is refused by the
+                   policy */
+                rc = modbus_connect_async(ctx_down);
+            }
+
+            printf("%s: ", step[i]);
+            if (rc == -1 && errno == step_errno[i]) {
+                printf("OK\n");
+            } else {
+                printf("FAILED (%d, %s)\n", rc, modbus_strerror(errno));
+                modbus_free(ctx_down);
+                goto close;
+            }
+        }
+        modbus_free(ctx_down);
+
+        /* Connection killed by the server in the middle of a session */
+        server.ctx = modbus_new_tcp("127.0.0.1", 1598);
+        server.mb_mapping = modbus_mapping_new(0, 0, UT_REGISTERS_ADDRESS +
+                                               UT_REGISTERS_NB, 0);
+        server.server_socket = modbus_tcp_listen(server.ctx, 1);
+        ctx_rc = modbus_new_tcp("127.0.0.1", 1598);
+        modbus_set_error_recovery(ctx_rc, MODBUS_ERROR_RECOVERY_LINK);
+        policy.max_attempts = 0;
+        modbus_set_reconnect_policy(ctx_rc, &policy);
+        pthread_create(&thread, NULL, reconnect_server, &server);
+
+        rc = modbus_connect(ctx_rc);
+        if (rc == 0) {
+            rc = modbus_read_registers(ctx_rc, UT_REGISTERS_ADDRESS,
+                                       UT_REGISTERS_NB, tab_rp_registers);
+        }
+        printf("4/6 Session opened: ");
+        if (rc != UT_REGISTERS_NB) {
+            printf("FAILED (%s)\n", modbus_strerror(errno));
+            goto reconnect_end;
+        }
+        printf("OK\n");
+
+        shutdown(modbus_get_socket(server.ctx), SHUT_RDWR);
+        start = time_ms();
+        rc = modbus_read_registers(ctx_rc, UT_REGISTERS_ADDRESS,
+                                   UT_REGISTERS_NB, tab_rp_registers);
+        printf("5/6 Request on the killed connection fails at once: ");
+        if (rc != -1 || time_ms() - start >= 250) {
+            printf("FAILED (%d in %d ms)\n", rc, (int)(time_ms() - start));
+            goto reconnect_end;
+        }
+        printf("OK (%s)\n", modbus_strerror(errno));
+
+        /* No failed connection, the policy doesn't delay the attempt */
+        start = time_ms();
+        rc = modbus_read_registers(ctx_rc, UT_REGISTERS_ADDRESS,
+                                   UT_REGISTERS_NB, tab_rp_registers);
+        printf("6/6 Next request reconnects without blocking: ");
+        if (rc != UT_REGISTERS_NB || time_ms() - start >= 250) {
+            printf("FAILED (%d in %d ms)\n", rc, (int)(time_ms() - start));
+            goto reconnect_end;
+        }
+        printf("OK\n");
+        reconnect_ok = TRUE;
+
+    reconnect_end:
+        modbus_close(ctx_rc);
+        modbus_free(ctx_rc);
+        /* Wakes up the server waiting for a connection */
+        shutdown(server.server_socket, SHUT_RDWR);
+        pthread_join(thread, NULL);
+        close(server.server_socket);
+        modbus_free(server.ctx);
+        modbus_mapping_free(server.mb_mapping);
+        if (!reconnect_ok)
+            goto close;
+    }
+
+    printf("\nTEST STALE DATA POLICY:\n");
+    if (use_backend == RTU) {
+        uint64_t nb_bytes;
+
+        rc = modbus_rtu_set_stale_mode(ctx, MODBUS_RTU_STALE_FLUSH);
+        printf("1/2 modbus_rtu_set_stale_mode: ");
+        if (rc == 0 && modbus_rtu_get_stale_mode(ctx) == MODBUS_RTU_STALE_FLUSH &&
+            modbus_rtu_set_stale_mode(ctx, 3) == -1 && errno == EINVAL) {
+            printf("OK\n");
+        } else {
+            printf("FAILED\n");
+            goto close;
+        }
+
+        /* The responses read so far were complete */
+        rc = modbus_rtu_get_stale_bytes(ctx, &nb_bytes);
+        printf("2/2 modbus_rtu_get_stale_bytes: ");
+        if (rc == 0) {
+            printf("OK (%u bytes)\n", (unsigned int) nb_bytes);
+        } else {
+            printf("FAILED\n");
+            goto close;
+        }
+        modbus_rtu_set_stale_mode(ctx, MODBUS_RTU_STALE_CLEAN);
+    } else {
+        rc = modbus_rtu_set_stale_mode(ctx, MODBUS_RTU_STALE_FLUSH);
+        printf("1/1 modbus_rtu_set_stale_mode rejected in TCP: ");
+        if (rc == -1 && errno == EINVAL) {
+            printf("OK\n");
+        } else {
+            printf("FAILED\n");
+            goto close;
+        }
+    }
+
+    printf("\nTEST STALE DATA DISCARD:\n");
+    {
+        const struct {
+            const char *name;
+            int mode;
+            int discarded;
+        } steps[] = {
+            { "1/4 Drained before a request", MODBUS_RTU_STALE_DRAIN, TRUE },
+            { "2/4 Flushed before a request", MODBUS_RTU_STALE_FLUSH, TRUE },
+            { "3/4 Kept after a complete response", MODBUS_RTU_STALE_CLEAN, FALSE },
+            { "4/4 Drained after an invalid response", MODBUS_RTU_STALE_CLEAN, TRUE }
+        };
+        modbus_t *ctx_cli;
+        modbus_t *ctx_srv;
+        modbus_mapping_t *mb_mapping;
+        struct timeval timeout;
+        uint64_t before;
+        uint64_t after;
+        int stale_ok = FALSE;
+        int fd;
+
+        fd = posix_openpt(O_RDWR | O_NOCTTY);
+        if (fd == -1 || grantpt(fd) == -1 || unlockpt(fd) == -1) {
+            printf("FAILED (pseudo-terminal: %s)\n", strerror(errno));
+            goto close;
+        }
+
+        /* Server on the master side, client on the slave side */
+        ctx_srv = modbus_new_rtu("/dev/null", 115200, 'N', 8, 1);
+        modbus_set_slave(ctx_srv, SERVER_ID);
+        modbus_set_socket(ctx_srv, fd);
+        mb_mapping = modbus_mapping_new(0, 0, 1, 0);
+        ctx_cli = modbus_new_rtu(ptsname(fd), 115200, 'N', 8, 1);
+        modbus_set_slave(ctx_cli, SERVER_ID);
+        if (modbus_connect(ctx_cli) == -1) {
+            printf("FAILED (connection: %s)\n", modbus_strerror(errno));
+            goto stale_end;
+        }
+        timeout.tv_sec = 0;
+        timeout.tv_usec = 100000;
+        modbus_set_response_timeout(ctx_cli, &timeout);
+
+        for (i = 0; i < 4; i++) {
+            int discarded;
+
+            modbus_rtu_set_stale_mode(ctx_cli, steps[i].mode);
+            modbus_rtu_get_stale_bytes(ctx_cli, &before);
+            rc = stale_exchange(ctx_cli, ctx_srv, mb_mapping);
+            modbus_rtu_get_stale_bytes(ctx_cli, &after);
+
+            printf("%s: ", steps[i].name);
+            /* The response is only valid without the stale bytes */
+            discarded = (rc == 7 && after >= before + 3);
+            if (steps[i].discarded ? !discarded : (rc != -1 || after != before)) {
+                printf("FAILED (%d, %u bytes discarded)\n", rc,
+                       (unsigned int)(after - before));
+                goto stale_end;
+            }
+            printf("OK\n");
+        }
+        stale_ok = TRUE;
+
+    stale_end:
+        modbus_close(ctx_cli);
+        modbus_free(ctx_cli);
+        modbus_close(ctx_srv);
+        modbus_free(ctx_srv);
+        modbus_mapping_free(mb_mapping);
+        if (!stale_ok)
+            goto close;
+    }
+
+    printf("\nTEST ADAPTIVE TIMING:\n");
+    if (use_backend == RTU) {
+        modbus_rtu_timing_bounds_t bounds;
+        modbus_rtu_slave_stats_t stats;
+        struct timeval saved_timeout;
+        struct timeval timeout;
+
+        modbus_get_response_timeout(ctx, &saved_timeout);
+        bounds.min_frame_gap.tv_sec = 0;
+        bounds.min_frame_gap.tv_usec = 500;
+        bounds.max_frame_gap.tv_sec = 0;
+        bounds.max_frame_gap.tv_usec = 20000;
+        bounds.min_response_timeout.tv_sec = 0;
+        bounds.min_response_timeout.tv_usec = 10000;
+        bounds.max_response_timeout.tv_sec = 1;
+        bounds.max_response_timeout.tv_usec = 0;
+        rc = modbus_rtu_set_adaptive_timing(ctx, &bounds);
+        printf("1/3 modbus_rtu_set_adaptive_timing: ");
+        if (rc == 0) {
+            printf("OK\n");
+        } else {
+            printf("FAILED\n");
+            goto close;
+        }
+
+        /* Two tunings */
+        for (i = 0; i < 32; i++) {
+            rc = modbus_read_registers(ctx, UT_REGISTERS_ADDRESS,
+                                       UT_REGISTERS_NB, tab_rp_registers);
+            if (rc != UT_REGISTERS_NB)
+                break;
+        }
+        rc = modbus_rtu_get_slave_stats(ctx, SERVER_ID, &stats);
+        printf("2/3 modbus_rtu_get_slave_stats: ");
+        if (rc == 0 && stats.nb_responses == 32 &&
+            stats.latency_p50 <= stats.latency_p99 &&
+            stats.latency_p99 <= stats.latency_max &&
+            stats.frame_gap >= 500 && stats.frame_gap <= 20000 &&
+            stats.response_timeout >= 10000 &&
+            stats.response_timeout <= 1000000) {
+            printf("OK (latency %u us, frame gap %u us, timeout %u us)\n",
+                   stats.latency_p99, stats.frame_gap, stats.response_timeout);
+        } else {
+            printf("FAILED (%d responses)\n", stats.nb_responses);
+            goto close;
+        }
+
+        /* The timeout of each slave is kept by the backend */
+        modbus_get_response_timeout(ctx, &timeout);
+        modbus_rtu_set_adaptive_timing(ctx, NULL);
+        printf("3/3 Response timeout of the context unchanged: ");
+        if (timeout.tv_sec == saved_timeout.tv_sec &&
+            timeout.tv_usec == saved_timeout.tv_usec) {
+            printf("OK\n");
+        } else {
+            printf("FAILED\n");
+            goto close;
+        }
+    } else {
+        rc = modbus_rtu_set_adaptive_timing(ctx, NULL);
+        printf("1/1 modbus_rtu_set_adaptive_timing rejected in TCP: ");
+        if (rc == -1 && errno == EINVAL) {
+            printf("OK\n");
+        } else {
+            printf("FAILED\n");
+            goto close;
+        }
+    }
+
+    printf("\nTEST RTS DELAY:\n");
+    if (use_backend == RTU) {
+        int rts_delay = modbus_rtu_get_rts_delay(ctx);
+
+        rc = modbus_rtu_set_rts_delay(ctx, 500);
+        printf("1/2 modbus_rtu_set_rts_delay: ");
+        if (rts_delay > 0 && rc == 0 && modbus_rtu_get_rts_delay(ctx) == 500 &&
+            modbus_rtu_set_rts_delay(ctx, -1) == -1 && errno == EINVAL) {
+            printf("OK\n");
+        } else {
+            printf("FAILED\n");
+            goto close;
+        }
+        modbus_rtu_set_rts_delay(ctx, rts_delay);
+    } else {
+        rc = modbus_rtu_set_rts_delay(ctx, 500);
+        printf("1/2 modbus_rtu_set_rts_delay rejected in TCP: ");
+        if (rc == -1 && errno == EINVAL) {
+            printf("OK\n");
+        } else {
+            printf("FAILED\n");
+            goto close;
+        }
+    }
+
+    /* The time of one character above 19200 bauds isn't waited at all by
+       the kernel */
+    printf("2/2 RS485 delays of the kernel rounded to the ms: ");
+    if (_MODBUS_RTU_RTS_DELAY_MS(0) == 0 && _MODBUS_RTU_RTS_DELAY_MS(286) == 0 &&
+        _MODBUS_RTU_RTS_DELAY_MS(499) == 0 && _MODBUS_RTU_RTS_DELAY_MS(500) == 1 &&
+        _MODBUS_RTU_RTS_DELAY_MS(1499) == 1 && _MODBUS_RTU_RTS_DELAY_MS(2500) == 3) {
+        printf("OK\n");
+    } else {
+        printf("FAILED\n");
+        goto close;
+    }
+
     printf("\nTEST FLOATS\n");
     /** FLOAT **/
     printf("1/4 Set float: ");
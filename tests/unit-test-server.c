@@ -27,6 +27,7 @@
 enum {
     TCP,
     TCP_PI,
+    TCP_URING,
     RTU
 };
 
@@ -38,6 +39,7 @@ int main(int argc, char*argv[])
     int rc;
     int i;
     int use_backend;
+    int use_batching = FALSE;
     uint8_t *query;
     int header_length;
 
@@ -46,12 +48,17 @@ int main(int argc, char*argv[])
             use_backend = TCP;
         } else if (strcmp(argv[1], "tcppi") == 0) {
             use_backend = TCP_PI;
+        } else if (strcmp(argv[1], "tcpuring") == 0) {
+            use_backend = TCP_URING;
         } else if (strcmp(argv[1], "rtu") == 0) {
             use_backend = RTU;
         } else {
-            printf("Usage:\n  %s [tcp|tcppi|rtu] - Modbus server for unit testing\n\n", argv[0]);
+            printf("Usage:\n  %s [tcp|tcppi|tcpuring|rtu] [batch] - Modbus server for unit testing\n\n", argv[0]);
             return -1;
         }
+        /* The responses to the pipelined requests are sent together (TCP) */
+        if (argc > 2 && strcmp(argv[2], "batch") == 0)
+            use_batching = TRUE;
     } else {
         /* By default */
         use_backend = TCP;
@@ -63,6 +70,9 @@ int main(int argc, char*argv[])
     } else if (use_backend == TCP_PI) {
         ctx = modbus_new_tcp_pi("::0", "1502");
         query = malloc(MODBUS_TCP_MAX_ADU_LENGTH);
+    } else if (use_backend == TCP_URING) {
+        ctx = modbus_new_tcp_uring("127.0.0.1", 1502);
+        query = malloc(MODBUS_TCP_MAX_ADU_LENGTH);
     } else {
         ctx = modbus_new_rtu("/dev/ttyUSB0", 115200, 'N', 8, 1);
         modbus_set_slave(ctx, SERVER_ID);
@@ -123,12 +133,14 @@ int main(int argc, char*argv[])
             UT_INPUT_REGISTERS_TAB[i];;
     }
 
-    if (use_backend == TCP) {
+    if (use_backend == TCP || use_backend == TCP_URING) {
         s = modbus_tcp_listen(ctx, 1);
         modbus_tcp_accept(ctx, &s);
+        modbus_tcp_set_reply_batching(ctx, use_batching);
     } else if (use_backend == TCP_PI) {
         s = modbus_tcp_pi_listen(ctx, 1);
         modbus_tcp_pi_accept(ctx, &s);
+        modbus_tcp_set_reply_batching(ctx, use_batching);
     } else {
         rc = modbus_connect(ctx);
         if (rc == -1) {
@@ -186,7 +198,7 @@ int main(int argc, char*argv[])
 
     printf("Quit the loop: %s\n", modbus_strerror(errno));
 
-    if (use_backend == TCP) {
+    if (use_backend == TCP || use_backend == TCP_URING) {
         if (s != -1) {
             close(s);
         }